@@ -0,0 +1,1175 @@
+/*
+ * bench.c — Microbenchmarks for the lock-free hash map
+ *
+ * Usage: bench [name [threads]]   (no name = run all)
+ *        HUGE_KEYS=n bench hugepages   (map size; default 4M keys)
+ *
+ * Author: G.H. Murray
+ * Date:   2026-02-17
+ */
+
+#define _GNU_SOURCE
+#include "hashmap.h"
+#include "numa.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Sorts lat[] in place and prints p50 / p99 / p99.9 / max */
+static void print_latency(const char *label, uint64_t *lat, size_t n)
+{
+    qsort(lat, n, sizeof(*lat), cmp_u64);
+    printf("  %-10s p50 %6lu ns  p99 %7lu ns  p99.9 %8lu ns  max %9lu ns\n",
+           label,
+           (unsigned long)lat[n / 2],
+           (unsigned long)lat[n * 99 / 100],
+           (unsigned long)lat[n * 999 / 1000],
+           (unsigned long)lat[n - 1]);
+}
+
+/* Retry counters, when built with make STATS=1 */
+static void print_stats(hashmap_t *map)
+{
+    hashmap_stats_t st;
+    if (hashmap_stats(map, &st) != 0)
+        return;
+    printf("  %.2f steps/find, restarts %lu, CAS fails: unlink %lu  insert %lu"
+           "  mark %lu  value %lu\n",
+           st.finds ? (double)st.find_steps / (double)st.finds : 0.0,
+           (unsigned long)st.find_restarts, (unsigned long)st.unlink_cas_fails,
+           (unsigned long)st.insert_cas_fails, (unsigned long)st.mark_cas_fails,
+           (unsigned long)st.value_cas_fails);
+}
+
+/* ── contention: many threads deleting adjacent keys ── */
+
+#define CONT_KEYS    4096
+#define CONT_ROUNDS  200
+
+struct cont_args {
+    hashmap_t      *map;
+    const uint64_t *keys;      /* all keys, in list (split) order */
+    int             tid;
+    int             nthreads;
+    uint64_t       *lat;       /* one sample per remove           */
+    size_t          nlat;
+};
+
+/*
+ * Thread t owns keys t, t+T, t+2T, ... of the list order, so every
+ * remove's neighbours are being removed by other threads at the same
+ * time and unlink CASes collide on shared predecessors.
+ */
+static void *cont_worker(void *arg)
+{
+    struct cont_args *a = arg;
+    int slot = hashmap_thread_register(a->map);
+
+    for (int r = 0; r < CONT_ROUNDS; r++) {
+        for (size_t i = (size_t)a->tid; i < CONT_KEYS; i += (size_t)a->nthreads) {
+            uint64_t t0 = now_ns();
+            hashmap_remove(a->map, a->keys[i]);
+            a->lat[a->nlat++] = now_ns() - t0;
+        }
+        for (size_t i = (size_t)a->tid; i < CONT_KEYS; i += (size_t)a->nthreads)
+            hashmap_put(a->map, a->keys[i], (void *)a->keys[i]);
+    }
+
+    hashmap_thread_unregister(a->map, slot);
+    return NULL;
+}
+
+struct key_order {
+    uint64_t *keys;
+    size_t    n;
+};
+
+static void collect_key(uint64_t key, void *value, void *arg)
+{
+    (void)value;
+    struct key_order *o = arg;
+    o->keys[o->n++] = key;
+}
+
+static void bench_contention(int nthreads)
+{
+    printf("=== contention: %d threads removing adjacent keys ===\n", nthreads);
+
+    hashmap_t *map = hashmap_create();
+    int slot = hashmap_thread_register(map);
+    for (uint64_t k = 1; k <= CONT_KEYS; k++)
+        hashmap_put(map, k, (void *)k);
+
+    /* A one-thread scan yields the keys in list order */
+    struct key_order order = { .keys = malloc(CONT_KEYS * sizeof(uint64_t)) };
+    hashmap_parallel_for_each(map, 1, collect_key, &order);
+    assert(order.n == CONT_KEYS);
+
+    pthread_t threads[EPOCH_MAX_THREADS];
+    struct cont_args args[EPOCH_MAX_THREADS];
+    size_t per_thread = (CONT_KEYS / (size_t)nthreads + 1) * CONT_ROUNDS;
+
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < nthreads; i++) {
+        args[i] = (struct cont_args){
+            .map = map, .keys = order.keys, .tid = i, .nthreads = nthreads,
+            .lat = malloc(per_thread * sizeof(uint64_t)),
+        };
+        pthread_create(&threads[i], NULL, cont_worker, &args[i]);
+    }
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    uint64_t elapsed = now_ns() - t0;
+
+    size_t total = 0;
+    for (int i = 0; i < nthreads; i++)
+        total += args[i].nlat;
+    uint64_t *all = malloc(total * sizeof(uint64_t));
+    size_t n = 0;
+    for (int i = 0; i < nthreads; i++) {
+        memcpy(all + n, args[i].lat, args[i].nlat * sizeof(uint64_t));
+        n += args[i].nlat;
+        free(args[i].lat);
+    }
+
+    printf("  %zu removes + %zu puts in %.2f ms\n", total, total, elapsed / 1e6);
+    print_latency("remove", all, total);
+    print_stats(map);
+    assert(hashmap_count(map) == CONT_KEYS);
+
+    free(all);
+    free(order.keys);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    printf("\n");
+}
+
+/* ── reclaim: get latency while a churner retires in bulk ── */
+
+#define RECL_KEYS   (1 << 16)
+#define RECL_GETS   200000
+
+struct recl_args {
+    hashmap_t   *map;
+    _Atomic int *stop;
+    uint64_t    *lat;
+    uint32_t     seed;
+};
+
+static void *recl_reader(void *arg)
+{
+    struct recl_args *a = arg;
+    int slot = hashmap_thread_register(a->map);
+    uint32_t x = a->seed;
+
+    for (size_t i = 0; i < RECL_GETS; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        uint64_t t0 = now_ns();
+        hashmap_get(a->map, 1 + x % RECL_KEYS);
+        a->lat[i] = now_ns() - t0;
+    }
+
+    hashmap_thread_unregister(a->map, slot);
+    return NULL;
+}
+
+/* Removes and reinserts every key, so each sweep retires RECL_KEYS nodes */
+static void *recl_churner(void *arg)
+{
+    struct recl_args *a = arg;
+    int slot = hashmap_thread_register(a->map);
+
+    while (!atomic_load(a->stop)) {
+        for (uint64_t k = 1; k <= RECL_KEYS; k++)
+            hashmap_remove(a->map, k);
+        for (uint64_t k = 1; k <= RECL_KEYS; k++)
+            hashmap_put(a->map, k, (void *)k);
+    }
+
+    hashmap_thread_unregister(a->map, slot);
+    return NULL;
+}
+
+static void recl_run(int nreaders, const char *label, const hashmap_config_t *cfg)
+{
+    hashmap_t *map = hashmap_create_with(cfg);
+    assert(map);
+    int slot = hashmap_thread_register(map);
+    for (uint64_t k = 1; k <= RECL_KEYS; k++)
+        hashmap_put(map, k, (void *)k);
+
+    _Atomic int stop = 0;
+    pthread_t churner, readers[EPOCH_MAX_THREADS];
+    struct recl_args cargs = { .map = map, .stop = &stop };
+    struct recl_args rargs[EPOCH_MAX_THREADS];
+
+    pthread_create(&churner, NULL, recl_churner, &cargs);
+    for (int i = 0; i < nreaders; i++) {
+        rargs[i] = (struct recl_args){
+            .map = map, .lat = malloc(RECL_GETS * sizeof(uint64_t)),
+            .seed = 2463534242u + (uint32_t)i,
+        };
+        pthread_create(&readers[i], NULL, recl_reader, &rargs[i]);
+    }
+    for (int i = 0; i < nreaders; i++)
+        pthread_join(readers[i], NULL);
+    atomic_store(&stop, 1);
+    pthread_join(churner, NULL);
+
+    size_t total = (size_t)nreaders * RECL_GETS;
+    uint64_t *all = malloc(total * sizeof(uint64_t));
+    for (int i = 0; i < nreaders; i++) {
+        memcpy(all + (size_t)i * RECL_GETS, rargs[i].lat, RECL_GETS * sizeof(uint64_t));
+        free(rargs[i].lat);
+    }
+    print_latency(label, all, total);
+    print_stats(map);
+
+    free(all);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+}
+
+static void bench_reclaim(int nthreads)
+{
+    int nreaders = nthreads > 1 ? nthreads - 1 : 1;
+    printf("=== reclaim: %d readers vs one bulk remover ===\n", nreaders);
+    recl_run(nreaders, "get", &(hashmap_config_t){ 0 });
+    recl_run(nreaders, "get (bg)", &(hashmap_config_t){ .background_reclaim = true });
+    recl_run(nreaders, "get (K=64)",
+             &(hashmap_config_t){ .reclaim_batch = 64, .node_pool = true });
+    printf("\n");
+}
+
+/* ── preempt: throughput and garbage while a reader is descheduled ── */
+
+#define PRE_KEYS    1024
+#define PRE_ROUNDS  200
+
+struct pre_args {
+    hashmap_t   *map;
+    int          tid;
+    _Atomic int *stop;
+    size_t       peak;
+};
+
+static size_t unreclaimed(hashmap_t *map)
+{
+    return map->hazard_mode ? hazard_unreclaimed(&map->hazard)
+                            : epoch_unreclaimed(&map->epoch);
+}
+
+/* Sleeps inside every visit: the scan stays mid-operation for its whole run */
+static void pre_visit(uint64_t key, void *value, void *arg)
+{
+    (void)key; (void)value;
+    _Atomic int *stop = arg;
+    if (!atomic_load(stop))
+        nanosleep(&(struct timespec){ .tv_nsec = 1000000 }, NULL);
+}
+
+static void *pre_reader(void *arg)
+{
+    struct pre_args *a = arg;
+    int slot = hashmap_thread_register(a->map);
+    while (!atomic_load(a->stop))
+        hashmap_parallel_for_each(a->map, 1, pre_visit, a->stop);
+    hashmap_thread_unregister(a->map, slot);
+    return NULL;
+}
+
+static void *pre_writer(void *arg)
+{
+    struct pre_args *a = arg;
+    int slot = hashmap_thread_register(a->map);
+    uint64_t base = (uint64_t)(a->tid + 1) << 32;
+
+    for (int r = 0; r < PRE_ROUNDS; r++) {
+        for (uint64_t k = 1; k <= PRE_KEYS; k++)
+            hashmap_put(a->map, base + k, (void *)k);
+        for (uint64_t k = 1; k <= PRE_KEYS; k++)
+            hashmap_remove(a->map, base + k);
+        size_t n = unreclaimed(a->map);
+        if (n > a->peak) a->peak = n;
+    }
+
+    hashmap_thread_unregister(a->map, slot);
+    return NULL;
+}
+
+static void pre_run(int nwriters, const char *label, enum hashmap_reclaim reclaim)
+{
+    hashmap_config_t cfg = { .reclaim = reclaim };
+    hashmap_t *map = hashmap_create_with(&cfg);
+    assert(map);
+    int slot = hashmap_thread_register(map);
+    for (uint64_t k = 1; k <= 64; k++)
+        hashmap_put(map, k, (void *)k);
+
+    _Atomic int stop = 0;
+    pthread_t reader, writers[EPOCH_MAX_THREADS];
+    struct pre_args rargs = { .map = map, .stop = &stop };
+    struct pre_args wargs[EPOCH_MAX_THREADS];
+    pthread_create(&reader, NULL, pre_reader, &rargs);
+
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < nwriters; i++) {
+        wargs[i] = (struct pre_args){ .map = map, .tid = i, .stop = &stop };
+        pthread_create(&writers[i], NULL, pre_writer, &wargs[i]);
+    }
+    size_t peak = 0;
+    for (int i = 0; i < nwriters; i++) {
+        pthread_join(writers[i], NULL);
+        if (wargs[i].peak > peak) peak = wargs[i].peak;
+    }
+    uint64_t elapsed = now_ns() - t0;
+    atomic_store(&stop, 1);
+    pthread_join(reader, NULL);
+
+    double ops = 2.0 * nwriters * PRE_ROUNDS * PRE_KEYS;
+    printf("  %-8s %7.2f Mops/s  peak unreclaimed %9zu nodes\n",
+           label, ops / (elapsed / 1e3), peak);
+
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+}
+
+static void bench_preempt(int nthreads)
+{
+    printf("=== preempt: %d writers, one reader sleeping mid-scan ===\n", nthreads);
+    pre_run(nthreads, "epoch", HASHMAP_RECLAIM_EPOCH);
+    pre_run(nthreads, "hazard", HASHMAP_RECLAIM_HAZARD);
+    printf("\n");
+}
+
+/* ── readmostly: 99% gets, full fence vs membarrier vs QSBR ── */
+
+#define RM_KEYS  (1 << 14)
+#define RM_OPS   1000000
+
+struct rm_args {
+    hashmap_t *map;
+    uint32_t   seed;
+};
+
+static void *rm_worker(void *arg)
+{
+    struct rm_args *a = arg;
+    int slot = hashmap_thread_register(a->map);
+    uint32_t x = a->seed;
+
+    for (int i = 0; i < RM_OPS; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        uint64_t k = 1 + x % RM_KEYS;
+        if (x % 100 == 0) {
+            hashmap_remove(a->map, k);
+            hashmap_put(a->map, k, (void *)k);
+        } else {
+            hashmap_get(a->map, k);
+        }
+        if (i % 64 == 0)
+            hashmap_quiescent(a->map, slot);  /* no-op outside QSBR */
+    }
+
+    hashmap_thread_unregister(a->map, slot);
+    return NULL;
+}
+
+static void rm_run(int nthreads, const char *label, hashmap_config_t cfg)
+{
+    hashmap_t *map = hashmap_create_with(&cfg);
+    assert(map);
+    if (cfg.asymmetric_fences && !map->epoch.asymmetric) {
+        printf("  %-10s membarrier unavailable\n", label);
+        hashmap_destroy(map);
+        return;
+    }
+    int slot = hashmap_thread_register(map);
+    for (uint64_t k = 1; k <= RM_KEYS; k++)
+        hashmap_put(map, k, (void *)k);
+    hashmap_thread_offline(map, slot);  /* don't pin QSBR grace periods */
+
+    pthread_t threads[EPOCH_MAX_THREADS];
+    struct rm_args args[EPOCH_MAX_THREADS];
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < nthreads; i++) {
+        args[i] = (struct rm_args){ .map = map, .seed = 2463534242u + (uint32_t)i };
+        pthread_create(&threads[i], NULL, rm_worker, &args[i]);
+    }
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    uint64_t elapsed = now_ns() - t0;
+
+    double ops = (double)nthreads * RM_OPS;
+    printf("  %-10s %7.2f Mops/s  (%.1f ns/op/thread)\n", label,
+           ops / (elapsed / 1e3), elapsed * (double)nthreads / ops);
+
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+}
+
+static void bench_readmostly(int nthreads)
+{
+    printf("=== readmostly: %d threads, 99%% gets ===\n", nthreads);
+    rm_run(nthreads, "fence", (hashmap_config_t){ 0 });
+    rm_run(nthreads, "membarrier", (hashmap_config_t){ .asymmetric_fences = true });
+    rm_run(nthreads, "qsbr", (hashmap_config_t){ .qsbr = true });
+    printf("\n");
+}
+
+/* ── profile: list shape and get cost per load factor ── */
+
+#define PROF_KEYS (1 << 17)
+#define PROF_GETS 1000000
+
+static void bench_profile(int nthreads)
+{
+    (void)nthreads;  /* single-threaded */
+    printf("=== profile: %d random keys per load factor ===\n", PROF_KEYS);
+
+    static const uint32_t factors[] = { 50, 75, 150, 300, 600 };
+    for (size_t f = 0; f < sizeof(factors) / sizeof(factors[0]); f++) {
+        hashmap_config_t cfg = { .load_factor = factors[f] };
+        hashmap_t *map = hashmap_create_with(&cfg);
+        int slot = hashmap_thread_register(map);
+
+        uint32_t x = 2463534242u;
+        for (int i = 0; i < PROF_KEYS; i++) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            hashmap_put(map, (uint64_t)x + 1, (void *)1);
+        }
+
+        uint64_t t0 = now_ns();
+        x = 2463534242u;
+        for (int i = 0; i < PROF_GETS; i++) {
+            if (i % PROF_KEYS == 0) x = 2463534242u;
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            hashmap_get(map, (uint64_t)x + 1);
+        }
+        uint64_t elapsed = now_ns() - t0;
+
+        hashmap_profile_t p;
+        hashmap_profile(map, &p);
+        printf("  load %3u%%: %5.1f ns/get  ", factors[f], (double)elapsed / PROF_GETS);
+        hashmap_profile_json(&p, stdout);
+
+        hashmap_thread_unregister(map, slot);
+        hashmap_destroy(map);
+    }
+    printf("\n");
+}
+
+/* ── latency: sampled per-op quantiles, 80% get / 10% put / 10% remove ── */
+
+#define SAMP_KEYS (1 << 14)
+#define SAMP_OPS  1000000
+
+static void *samp_worker(void *arg)
+{
+    struct rm_args *a = arg;
+    int slot = hashmap_thread_register(a->map);
+    uint32_t x = a->seed;
+
+    for (int i = 0; i < SAMP_OPS; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        uint64_t k = 1 + x % SAMP_KEYS;
+        switch (x >> 28) {
+        case 0: case 1: hashmap_put(a->map, k, (void *)k); break;
+        case 2: case 3: hashmap_remove(a->map, k);         break;
+        default:        hashmap_get(a->map, k);            break;
+        }
+    }
+
+    hashmap_thread_unregister(a->map, slot);
+    return NULL;
+}
+
+/* Returns elapsed ns */
+static uint64_t samp_run(hashmap_t *map, int nthreads)
+{
+    pthread_t threads[EPOCH_MAX_THREADS];
+    struct rm_args args[EPOCH_MAX_THREADS];
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < nthreads; i++) {
+        args[i] = (struct rm_args){ .map = map, .seed = 88675123u + (uint32_t)i };
+        pthread_create(&threads[i], NULL, samp_worker, &args[i]);
+    }
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    return now_ns() - t0;
+}
+
+static void bench_latency(int nthreads)
+{
+    printf("=== latency: %d threads, 1-in-64 sampling ===\n", nthreads);
+
+    hashmap_t *plain = hashmap_create();
+    uint64_t base = samp_run(plain, nthreads);
+    hashmap_destroy(plain);
+
+    hashmap_config_t cfg = { .sample_every = 64 };
+    hashmap_t *map = hashmap_create_with(&cfg);
+    uint64_t sampled = samp_run(map, nthreads);
+
+    double ops = (double)nthreads * SAMP_OPS;
+    printf("  unsampled %.1f ns/op, sampled %.1f ns/op\n",
+           base * (double)nthreads / ops, sampled * (double)nthreads / ops);
+
+    static const char *names[HASHMAP_LAT_OPS] = { "get", "put", "remove" };
+    for (int op = 0; op < HASHMAP_LAT_OPS; op++) {
+        for (int ph = 0; ph < HASHMAP_LAT_PHASES; ph++) {
+            lat_summary_t s;
+            hashmap_latency(map, op, ph, &s);
+            printf("  %-6s %-5s n=%-6lu p50 %5lu  p99 %6lu  p99.9 %7lu  max %9lu ns\n",
+                   names[op], ph == HASHMAP_LAT_TOTAL ? "total" : "enter",
+                   (unsigned long)s.count, (unsigned long)s.p50, (unsigned long)s.p99,
+                   (unsigned long)s.p999, (unsigned long)s.max);
+        }
+    }
+    hashmap_destroy(map);
+    printf("\n");
+}
+
+/* ── dump: rebuild by replaying puts vs. hashmap_dump + hashmap_load ── */
+
+#define DUMP_KEYS (1 << 20)
+
+static void bench_dump(int nthreads)
+{
+    (void)nthreads;  /* single-threaded */
+    printf("=== dump: %d random keys ===\n", DUMP_KEYS);
+
+    uint64_t t0 = now_ns();
+    hashmap_t *map = hashmap_create();
+    int slot = hashmap_thread_register(map);
+    uint32_t x = 2463534242u;
+    for (int i = 0; i < DUMP_KEYS; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        hashmap_put(map, (uint64_t)x + 1, (void *)(uintptr_t)i + 1);
+    }
+    uint64_t replay = now_ns() - t0;
+
+    FILE *f = tmpfile();
+    int fd = fileno(f);
+    t0 = now_ns();
+    hashmap_dump(map, fd);
+    uint64_t dump = now_ns() - t0;
+    off_t size = lseek(fd, 0, SEEK_CUR);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    lseek(fd, 0, SEEK_SET);
+    t0 = now_ns();
+    hashmap_t *copy = hashmap_load(fd);
+    uint64_t load = now_ns() - t0;
+    fclose(f);
+
+    printf("  replay puts %.0f ms, dump %.0f ms (%.1f bytes/entry), load %.0f ms (%zu entries)\n\n",
+           replay / 1e6, dump / 1e6, (double)size / DUMP_KEYS, load / 1e6,
+           copy ? hashmap_count(copy) : 0);
+    hashmap_destroy(copy);
+}
+
+/* ── frozen: live map vs. a mapped frozen image, startup and gets ── */
+
+#define FROZEN_GETS (4 << 20)
+
+static void bench_frozen(int nthreads)
+{
+    (void)nthreads;  /* single-threaded */
+    printf("=== frozen: %d random keys, %d gets ===\n", DUMP_KEYS, FROZEN_GETS);
+
+    hashmap_t *map = hashmap_create();
+    int slot = hashmap_thread_register(map);
+    uint64_t *keys = malloc(DUMP_KEYS * sizeof(*keys));
+    uint32_t x = 2463534242u;
+    for (int i = 0; i < DUMP_KEYS; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        keys[i] = (uint64_t)x + 1;
+        hashmap_put(map, keys[i], (void *)(uintptr_t)i + 1);
+    }
+
+    FILE *f = tmpfile();
+    int fd = fileno(f);
+    uint64_t t0 = now_ns();
+    hashmap_freeze(map, fd);
+    uint64_t freeze = now_ns() - t0;
+    off_t size = lseek(fd, 0, SEEK_CUR);
+
+    t0 = now_ns();
+    hashmap_frozen_t *fm = hashmap_frozen_open(fd);
+    uint64_t open = now_ns() - t0;
+    fclose(f);
+    if (!fm) {
+        printf("  open failed\n\n");
+        free(keys);
+        hashmap_thread_unregister(map, slot);
+        hashmap_destroy(map);
+        return;
+    }
+
+    uintptr_t sink = 0;
+    x = 88172645u;
+    t0 = now_ns();
+    for (int i = 0; i < FROZEN_GETS; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        sink += (uintptr_t)hashmap_get(map, keys[x % DUMP_KEYS]);
+    }
+    uint64_t live = now_ns() - t0;
+
+    x = 88172645u;
+    t0 = now_ns();
+    for (int i = 0; i < FROZEN_GETS; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        sink -= (uintptr_t)hashmap_frozen_get(fm, keys[x % DUMP_KEYS]);
+    }
+    uint64_t frozen = now_ns() - t0;
+
+    t0 = now_ns();
+    int ok = hashmap_frozen_verify(fm) == 0;
+    uint64_t verify = now_ns() - t0;
+
+    printf("  freeze %.0f ms (%.1f bytes/entry), open %.1f us, verify %.0f ms%s\n",
+           freeze / 1e6, (double)size / DUMP_KEYS, open / 1e3, verify / 1e6,
+           ok ? "" : " (FAILED)");
+    printf("  get: live %.1f ns/op, frozen %.1f ns/op%s\n\n",
+           (double)live / FROZEN_GETS, (double)frozen / FROZEN_GETS,
+           sink ? " (MISMATCH)" : "");
+    hashmap_frozen_close(fm);
+    free(keys);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+}
+
+/* ── wal: updates with no log, a mutex-serialized log, and the WAL ── */
+
+#define WAL_OPS  200000     /* Per thread; a tenth when syncing every op */
+#define WAL_KEYS (1 << 16)
+
+enum wal_mode { WAL_OFF, WAL_MUTEX, WAL_MUTEX_SYNC, WAL_ON };
+
+struct wal_args {
+    hashmap_t       *map;
+    enum wal_mode    mode;
+    int              ops;
+    int              fd;             /* WAL_MUTEX*: the shared log */
+    pthread_mutex_t *lock;
+    uint32_t         seed;
+};
+
+static void *wal_worker(void *arg)
+{
+    struct wal_args *a = arg;
+    int slot = hashmap_thread_register(a->map);
+    uint32_t x = a->seed;
+
+    for (int i = 0; i < a->ops; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        uint64_t k = 1 + x % WAL_KEYS, rec[2] = { k, x | 1 };
+        hashmap_put(a->map, k, (void *)(uintptr_t)rec[1]);
+        if (a->mode == WAL_MUTEX || a->mode == WAL_MUTEX_SYNC) {
+            pthread_mutex_lock(a->lock);
+            ssize_t n = write(a->fd, rec, sizeof(rec));
+            if (a->mode == WAL_MUTEX_SYNC)
+                fdatasync(a->fd);
+            pthread_mutex_unlock(a->lock);
+            (void)n;
+        }
+    }
+
+    hashmap_thread_unregister(a->map, slot);
+    return NULL;
+}
+
+static void wal_run(int nthreads, const char *label, const hashmap_config_t *map_cfg,
+                    enum wal_mode mode, enum hashmap_wal_sync sync, int ops)
+{
+    hashmap_t *map = hashmap_create_with(map_cfg);
+    int slot = hashmap_thread_register(map);
+    FILE *f = tmpfile();
+    int fd = fileno(f);
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    if (mode == WAL_ON) {
+        hashmap_wal_config_t cfg = { .sync = sync };
+        if (hashmap_wal_open(map, fd, &cfg) != 0) {
+            printf("  %-14s open failed\n", label);
+            hashmap_thread_unregister(map, slot);
+            hashmap_destroy(map);
+            fclose(f);
+            return;
+        }
+    }
+
+    pthread_t threads[EPOCH_MAX_THREADS];
+    struct wal_args args[EPOCH_MAX_THREADS];
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < nthreads; i++) {
+        args[i] = (struct wal_args){ .map = map, .mode = mode, .ops = ops, .fd = fd,
+                                     .lock = &lock, .seed = 2463534242u + (uint32_t)i };
+        pthread_create(&threads[i], NULL, wal_worker, &args[i]);
+    }
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    if (mode == WAL_ON)
+        hashmap_wal_sync(map);
+    uint64_t elapsed = now_ns() - t0;
+
+    double total = (double)nthreads * ops;
+    printf("  %-14s %7.2f Mops/s  (%6.0f ns/op/thread, log %.1f MB)\n", label,
+           total / (elapsed / 1e3), elapsed * (double)nthreads / total,
+           lseek(fd, 0, SEEK_END) / 1e6);
+
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    fclose(f);
+}
+
+static void bench_wal(int nthreads)
+{
+    const hashmap_config_t plain = { 0 }, snap = { .snapshots = true };
+    printf("=== wal: %d threads, random puts ===\n", nthreads);
+    wal_run(nthreads, "no log", &plain, WAL_OFF, 0, WAL_OPS);
+    wal_run(nthreads, "mutex log", &plain, WAL_MUTEX, 0, WAL_OPS);
+    wal_run(nthreads, "wal none", &plain, WAL_ON, HASHMAP_WAL_SYNC_NONE, WAL_OPS);
+    wal_run(nthreads, "wal interval", &plain, WAL_ON, HASHMAP_WAL_SYNC_INTERVAL, WAL_OPS);
+    wal_run(nthreads, "mutex + fsync", &plain, WAL_MUTEX_SYNC, 0, WAL_OPS / 10);
+    wal_run(nthreads, "wal always", &plain, WAL_ON, HASHMAP_WAL_SYNC_ALWAYS, WAL_OPS / 10);
+    /* Snapshot maps number records in their version records */
+    wal_run(nthreads, "snap no log", &snap, WAL_OFF, 0, WAL_OPS);
+    wal_run(nthreads, "snap wal none", &snap, WAL_ON, HASHMAP_WAL_SYNC_NONE, WAL_OPS);
+    printf("\n");
+}
+
+/* ── checkpoint: delta size vs. updates, and puts under a writer ── */
+
+#define CKPT_RANGES (1 << 16)
+#define CKPT_OPS    500000   /* Per thread */
+
+struct ckpt_args {
+    hashmap_t   *map;
+    uint32_t     seed;
+    atomic_int  *running;
+};
+
+static void *ckpt_worker(void *arg)
+{
+    struct ckpt_args *a = arg;
+    int slot = hashmap_thread_register(a->map);
+    uint32_t x = a->seed;
+    for (int i = 0; i < CKPT_OPS; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        hashmap_put(a->map, 1 + x % DUMP_KEYS, (void *)(uintptr_t)(x | 1));
+    }
+    hashmap_thread_unregister(a->map, slot);
+    atomic_fetch_sub(a->running, 1);
+    return NULL;
+}
+
+/* Puts by nthreads writers; with `writer`, checkpoints back to back */
+static void ckpt_run(int nthreads, const char *label, bool tracked, bool writer)
+{
+    hashmap_config_t cfg = { .checkpoint_ranges = tracked ? CKPT_RANGES : 0 };
+    hashmap_t *map = hashmap_create_with(&cfg);
+    int slot = hashmap_thread_register(map);
+    for (uint64_t k = 1; k <= DUMP_KEYS; k++)
+        hashmap_put(map, k, (void *)(uintptr_t)k);
+
+    pthread_t threads[EPOCH_MAX_THREADS];
+    struct ckpt_args args[EPOCH_MAX_THREADS];
+    atomic_int running = nthreads;
+    int checkpoints = 0;
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < nthreads; i++) {
+        args[i] = (struct ckpt_args){ map, 2463534242u + (uint32_t)i, &running };
+        pthread_create(&threads[i], NULL, ckpt_worker, &args[i]);
+    }
+    while (writer && atomic_load(&running) > 0) {
+        FILE *f = tmpfile();
+        hashmap_checkpoint_start(map, fileno(f), NULL, false);
+        hashmap_checkpoint_wait(map);
+        fclose(f);
+        checkpoints++;
+    }
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    uint64_t elapsed = now_ns() - t0;
+
+    double total = (double)nthreads * CKPT_OPS;
+    printf("  %-22s %6.2f Mops/s", label, total / (elapsed / 1e3));
+    if (writer)
+        printf("  (%d deltas written meanwhile)", checkpoints);
+    printf("\n");
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+}
+
+static void bench_checkpoint(int nthreads)
+{
+    printf("=== checkpoint: %d keys, %d ranges ===\n", DUMP_KEYS, CKPT_RANGES);
+
+    hashmap_config_t cfg = { .checkpoint_ranges = CKPT_RANGES };
+    hashmap_t *map = hashmap_create_with(&cfg);
+    int slot = hashmap_thread_register(map);
+    for (uint64_t k = 1; k <= DUMP_KEYS; k++)
+        hashmap_put(map, k, (void *)(uintptr_t)k);
+
+    FILE *f = tmpfile();
+    uint64_t t0 = now_ns();
+    hashmap_checkpoint(map, fileno(f), NULL, true);
+    uint64_t full = now_ns() - t0;
+    printf("  full          %6.0f ms  %7.2f MB\n", full / 1e6,
+           lseek(fileno(f), 0, SEEK_END) / 1e6);
+    fclose(f);
+
+    uint32_t x = 2463534242u;
+    for (int updates = 10; updates <= 100000; updates *= 10) {
+        for (int i = 0; i < updates; i++) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            hashmap_put(map, 1 + x % DUMP_KEYS, (void *)(uintptr_t)(x | 1));
+        }
+        f = tmpfile();
+        t0 = now_ns();
+        hashmap_checkpoint(map, fileno(f), NULL, false);
+        uint64_t delta = now_ns() - t0;
+        printf("  delta %6d   %6.1f ms  %7.2f MB\n", updates, delta / 1e6,
+               lseek(fileno(f), 0, SEEK_END) / 1e6);
+        fclose(f);
+    }
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    printf("  %d threads of random puts:\n", nthreads);
+    ckpt_run(nthreads, "untracked", false, false);
+    ckpt_run(nthreads, "tracked", true, false);
+    ckpt_run(nthreads, "tracked + async deltas", true, true);
+    printf("\n");
+}
+
+/* ── numa: placement policies, each thread serving its home keys ── */
+
+#define NUMA_KEYS  (1 << 20)
+#define NUMA_GETS  2000000   /* Per thread */
+
+struct numa_args {
+    hashmap_t      *map;
+    int             node, cpu;
+    const uint64_t *keys;    /* This thread's keys */
+    size_t          nkeys;
+    bool            insert;
+    uint64_t        sink;
+};
+
+static void numa_pin(int cpu)
+{
+    if (cpu < 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *numa_worker(void *arg)
+{
+    struct numa_args *a = arg;
+    numa_pin(a->cpu);
+    int slot = hashmap_thread_register(a->map);
+    if (a->insert) {
+        for (size_t i = 0; i < a->nkeys; i++)
+            hashmap_put(a->map, a->keys[i], (void *)(uintptr_t)(i + 1));
+    } else {
+        uint32_t x = 2463534242u + (uint32_t)a->node;
+        for (int i = 0; i < NUMA_GETS; i++) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            a->sink += (uintptr_t)hashmap_get(a->map, a->keys[x % a->nkeys]);
+        }
+    }
+    hashmap_thread_unregister(a->map, slot);
+    return NULL;
+}
+
+/* Share of list nodes (sentinels included) off their key's home node */
+static double numa_remote(hashmap_t *map, const hashmap_t *router)
+{
+    size_t n = 0, remote = 0;
+    void *addrs[512];
+    int nodes[512], want[512];
+    uintptr_t tagged = atomic_load(&map->head.next);
+    while (tagged) {
+        struct hm_node *node = (struct hm_node *)(tagged & ~(uintptr_t)1);
+        tagged = atomic_load(&node->next);
+        /* Home of the range: the same for a sentinel and its keys */
+        uint64_t so = node->so_key;
+        addrs[n % 512] = node;
+        want[n % 512] = (int)(((so >> 32) * (uint64_t)router->numa_nodes) >> 32);
+        if (++n % 512 == 0 || !tagged) {
+            size_t batch = (n - 1) % 512 + 1;
+            if (numa_page_nodes(addrs, batch, nodes) != 0)
+                return -1;
+            for (size_t i = 0; i < batch; i++)
+                remote += nodes[i] != want[i];
+        }
+    }
+    return n ? (double)remote / n : 0;
+}
+
+static void numa_run(int nthreads, const char *label, enum hashmap_numa policy,
+                     uint64_t *const *keys, const size_t *nkeys, const hashmap_t *router)
+{
+    int nodes = hashmap_numa_nodes();
+    hashmap_config_t cfg = { .numa = policy };
+    hashmap_t *map = hashmap_create_with(&cfg);
+
+    pthread_t threads[EPOCH_MAX_THREADS];
+    struct numa_args args[EPOCH_MAX_THREADS];
+    uint64_t elapsed[2];
+    for (int phase = 0; phase < 2; phase++) {
+        uint64_t t0 = now_ns();
+        for (int i = 0; i < nthreads; i++) {
+            int node = i % nodes, cpus[256];
+            int ncpus = numa_node_cpus(node, cpus, 256);
+            args[i] = (struct numa_args){
+                .map = map, .node = node,
+                .cpu = ncpus ? cpus[(i / nodes) % ncpus] : -1,
+                .keys = keys[node], .nkeys = nkeys[node], .insert = phase == 0,
+            };
+            /* Node's keys split among its threads for the insert */
+            if (phase == 0) {
+                int per = (nthreads - node + nodes - 1) / nodes, k = i / nodes;
+                args[i].keys += nkeys[node] * k / per;
+                args[i].nkeys = nkeys[node] * (k + 1) / per - nkeys[node] * k / per;
+            }
+            pthread_create(&threads[i], NULL, numa_worker, &args[i]);
+        }
+        for (int i = 0; i < nthreads; i++)
+            pthread_join(threads[i], NULL);
+        elapsed[phase] = now_ns() - t0;
+    }
+
+    double remote = numa_remote(map, router);
+    printf("  %-11s insert %6.0f ms, get %6.1f ns/op/thread", label, elapsed[0] / 1e6,
+           (double)elapsed[1] / NUMA_GETS);
+    if (remote >= 0)
+        printf(", %5.1f%% of nodes remote to their readers", remote * 100);
+    printf("\n");
+    hashmap_destroy(map);
+}
+
+static void bench_numa(int nthreads)
+{
+    int nodes = hashmap_numa_nodes();
+    printf("=== numa: %d threads on %d node(s), %d keys, each thread reading "
+           "keys homed on its node ===\n", nthreads, nodes, NUMA_KEYS);
+
+    /* Route keys by their BUCKET home, for every policy alike */
+    hashmap_config_t bucket = { .numa = HASHMAP_NUMA_BUCKET };
+    hashmap_t *router = hashmap_create_with(&bucket);
+    uint64_t *keys[NUMA_MAX_NODES];
+    size_t nkeys[NUMA_MAX_NODES] = { 0 };
+    for (int n = 0; n < nodes; n++)
+        keys[n] = malloc(NUMA_KEYS * sizeof(uint64_t));
+    uint32_t x = 2463534242u;
+    for (int i = 0; i < NUMA_KEYS; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        uint64_t k = (uint64_t)x + 1;
+        int home = hashmap_numa_home(router, k);
+        keys[home][nkeys[home]++] = k;
+    }
+
+    numa_run(nthreads, "off", HASHMAP_NUMA_OFF, keys, nkeys, router);
+    numa_run(nthreads, "local", HASHMAP_NUMA_LOCAL, keys, nkeys, router);
+    numa_run(nthreads, "interleave", HASHMAP_NUMA_INTERLEAVE, keys, nkeys, router);
+    numa_run(nthreads, "bucket", HASHMAP_NUMA_BUCKET, keys, nkeys, router);
+    printf("\n");
+
+    for (int n = 0; n < nodes; n++)
+        free(keys[n]);
+    hashmap_destroy(router);
+}
+
+/* ── hugepages: random gets in a large map, by page size ── */
+
+#define HUGE_KEYS  (1 << 22)
+#define HUGE_GETS  4000000   /* Per thread */
+
+struct huge_args {
+    hashmap_t *map;
+    uint64_t   nkeys, seed, sink;
+    bool       insert;
+};
+
+static void *huge_worker(void *arg)
+{
+    struct huge_args *a = arg;
+    int slot = hashmap_thread_register(a->map);
+    if (a->insert) {
+        for (uint64_t k = 1; k <= a->nkeys; k++)
+            hashmap_put(a->map, k, (void *)(uintptr_t)k);
+    } else {
+        uint64_t x = a->seed;
+        for (int i = 0; i < HUGE_GETS; i++) {
+            x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+            a->sink += (uintptr_t)hashmap_get(a->map, x % a->nkeys + 1);
+        }
+    }
+    hashmap_thread_unregister(a->map, slot);
+    return NULL;
+}
+
+/* dTLB load misses of this process and threads it starts (-1: no perf) */
+static int tlb_open(void)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* AnonHugePages of the process in kB (-1 if the kernel does not say) */
+static long huge_kb(void)
+{
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f) return -1;
+    char line[128];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1)
+            break;
+    fclose(f);
+    return kb;
+}
+
+static void huge_run(int nthreads, uint64_t nkeys, const char *label,
+                     enum hashmap_hugepages pages)
+{
+    hashmap_config_t cfg = { .hugepages = pages };
+    hashmap_t *map = hashmap_create_with(&cfg);
+    int tlb = tlb_open();
+
+    pthread_t threads[EPOCH_MAX_THREADS];
+    struct huge_args args[EPOCH_MAX_THREADS];
+    uint64_t t0 = now_ns();
+    args[0] = (struct huge_args){ .map = map, .nkeys = nkeys, .insert = true };
+    huge_worker(&args[0]);
+    uint64_t insert = now_ns() - t0;
+    long kb = huge_kb();
+
+    if (tlb >= 0) {
+        ioctl(tlb, PERF_EVENT_IOC_RESET, 0);
+        ioctl(tlb, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    t0 = now_ns();
+    for (int i = 0; i < nthreads; i++) {
+        args[i] = (struct huge_args){ .map = map, .nkeys = nkeys,
+                                      .seed = 88172645463325252ull + (uint64_t)i };
+        pthread_create(&threads[i], NULL, huge_worker, &args[i]);
+    }
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    uint64_t get = now_ns() - t0;
+    uint64_t misses = 0;
+    if (tlb >= 0) {
+        ioctl(tlb, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(tlb, &misses, sizeof(misses)) != sizeof(misses))
+            misses = 0;
+        close(tlb);
+    }
+
+    printf("  %-12s insert %7.0f ms, get %6.1f ns/op/thread, dTLB misses/get ",
+           label, insert / 1e6, (double)get / HUGE_GETS);
+    if (tlb >= 0)
+        printf("%5.2f", (double)misses / ((double)HUGE_GETS * nthreads));
+    else
+        printf("  n/a");
+    printf(", AnonHugePages %ld MB\n", kb < 0 ? -1 : kb / 1024);
+    hashmap_destroy(map);
+}
+
+static void bench_hugepages(int nthreads)
+{
+    const char *env = getenv("HUGE_KEYS");
+    uint64_t nkeys = env ? strtoull(env, NULL, 10) : HUGE_KEYS;
+    if (nkeys == 0) nkeys = HUGE_KEYS;
+    printf("=== hugepages: %llu keys, %d thread(s) of random gets ===\n",
+           (unsigned long long)nkeys, nthreads);
+
+    huge_run(nthreads, nkeys, "off", HASHMAP_HUGEPAGES_OFF);
+    huge_run(nthreads, nkeys, "transparent", HASHMAP_HUGEPAGES_TRANSPARENT);
+    huge_run(nthreads, nkeys, "explicit", HASHMAP_HUGEPAGES_EXPLICIT);
+    printf("\n");
+}
+
+/* ── Driver ── */
+
+struct bench {
+    const char *name;
+    void      (*fn)(int nthreads);
+    int         default_threads;
+};
+
+static const struct bench benches[] = {
+    { "contention", bench_contention, 8 },
+    { "reclaim",    bench_reclaim,    4 },
+    { "preempt",    bench_preempt,    4 },
+    { "readmostly", bench_readmostly, 4 },
+    { "profile",    bench_profile,    1 },
+    { "latency",    bench_latency,    4 },
+    { "dump",       bench_dump,       1 },
+    { "frozen",     bench_frozen,     1 },
+    { "wal",        bench_wal,        4 },
+    { "checkpoint", bench_checkpoint, 2 },
+    { "numa",       bench_numa,       4 },
+    { "hugepages",  bench_hugepages,  1 },
+};
+
+int main(int argc, char **argv)
+{
+    const char *only = argc > 1 ? argv[1] : NULL;
+    int nthreads = argc > 2 ? atoi(argv[2]) : 0;
+    if (nthreads < 0 || nthreads > EPOCH_MAX_THREADS - 1) {
+        fprintf(stderr, "threads must be 1..%d\n", EPOCH_MAX_THREADS - 1);
+        return 1;
+    }
+
+    int ran = 0;
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        if (only && strcmp(only, benches[i].name) != 0)
+            continue;
+        benches[i].fn(nthreads ? nthreads : benches[i].default_threads);
+        ran++;
+    }
+    if (!ran) {
+        fprintf(stderr, "unknown benchmark: %s\n", only);
+        return 1;
+    }
+    return 0;
+}
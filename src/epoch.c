@@ -2,8 +2,11 @@
  * epoch.c — Epoch-based memory reclamation (per-thread retire lists)
  *
  * 3-epoch EBR with per-thread retire lists. No mutex on the retire
- * path — each thread retires to its own list. Reclamation scans all
- * threads' lists for the safe epoch.
+ * path — each thread retires to its own list and frees it once safe.
+ * Lists of idle or exiting threads go to a lock-free orphan stack that
+ * the thread advancing the epoch reclaims. With the background
+ * reclaimer running, expired lists are queued to it instead of freed.
+ * QSBR mode replaces per-section announcements with quiescent reports.
  *
  * Author: G.H. Murray
  * Date:   2026-02-17
@@ -11,12 +14,19 @@
 
 #define _GNU_SOURCE
 #include "epoch.h"
+#include "probes.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
 
 /* TLS slot for epoch_retire (without explicit slot) */
 static __thread int tls_epoch_slot = -1;
+static __thread epoch_t *tls_reclaiming;   /* Domain running a destructor */
 
 void epoch_init(epoch_t *e, epoch_free_fn free_fn)
 {
@@ -25,33 +35,356 @@ void epoch_init(epoch_t *e, epoch_free_fn free_fn)
     for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
         atomic_store(&e->threads[i].epoch, 0);
         atomic_store(&e->threads[i].active, false);
-        e->threads[i].in_critical = false;
+        e->threads[i].nesting = 0;
         for (int j = 0; j < EPOCH_COUNT; j++) {
             e->threads[i].retire[j] = NULL;
             e->threads[i].retire_count[j] = 0;
+            e->threads[i].retire_tail[j] = NULL;
+            e->threads[i].retire_epoch[j] = 0;
         }
+        e->threads[i].pending = e->threads[i].pending_tail = NULL;
+        e->threads[i].pending_count = 0;
     }
     e->free_fn = free_fn;
+    atomic_store(&e->orphans, NULL);
 }
 
-static void free_list(epoch_free_fn fn, struct epoch_node *head)
+/* Run a destructor with epoch_reclaiming() reporting `e` */
+static void run_fn(epoch_t *e, epoch_free_fn fn, void *ptr)
 {
+    if (!fn) return;
+    epoch_t *outer = tls_reclaiming;
+    tls_reclaiming = e;
+    fn(ptr);
+    tls_reclaiming = outer;
+}
+
+epoch_t *epoch_reclaiming(void)
+{
+    return tls_reclaiming;
+}
+
+static void free_node(epoch_t *e, struct epoch_node *node)
+{
+    run_fn(e, node->fn, node->ptr);
+    free(node);
+}
+
+static void free_list(epoch_t *e, struct epoch_node *head)
+{
+    int64_t n = 0;
     while (head) {
         struct epoch_node *next = head->next;
-        if (fn) fn(head->ptr);
-        free(head);
+        free_node(e, head);
         head = next;
+        n++;
+    }
+    if (n) {
+        atomic_fetch_sub_explicit(&e->unreclaimed, n, memory_order_relaxed);
+        PROBE2(epoch, reclaim, e, n);
+    }
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Background reclaimer
+ *
+ * Producers claim a cell by CAS on enq_pos and publish it by storing
+ * seq = pos + 1; the single consumer frees the list and recycles the
+ * cell with seq = pos + EPOCH_RECLAIM_QUEUE.
+ * ────────────────────────────────────────────────────────────────── */
+
+#define RECLAIM_MASK (EPOCH_RECLAIM_QUEUE - 1)
+
+static bool reclaim_enqueue(struct epoch_reclaimer *r, struct epoch_node *head)
+{
+    size_t pos = atomic_load_explicit(&r->enq_pos, memory_order_relaxed);
+    struct epoch_reclaim_cell *c;
+
+    for (;;) {
+        c = &r->cells[pos & RECLAIM_MASK];
+        size_t seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&r->enq_pos, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return false;  /* full */
+        } else {
+            pos = atomic_load_explicit(&r->enq_pos, memory_order_relaxed);
+        }
+    }
+
+    c->head = head;
+    atomic_store_explicit(&c->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+static void *reclaimer_main(void *arg)
+{
+    epoch_t *e = arg;
+    struct epoch_reclaimer *r = &e->reclaimer;
+
+    for (;;) {
+        while (sem_wait(&r->ready) != 0 && errno == EINTR)
+            ;
+
+        /* One post per list, plus one from epoch_reclaimer_stop */
+        if (r->deq_pos == atomic_load_explicit(&r->enq_pos, memory_order_acquire) &&
+            atomic_load_explicit(&r->stop, memory_order_acquire))
+            break;
+
+        struct epoch_reclaim_cell *c = &r->cells[r->deq_pos & RECLAIM_MASK];
+        /* Claimed but not yet published: the producer is mid-store */
+        while (atomic_load_explicit(&c->seq, memory_order_acquire) != r->deq_pos + 1)
+            sched_yield();
+
+        struct epoch_node *head = c->head;
+        atomic_store_explicit(&c->seq, r->deq_pos + EPOCH_RECLAIM_QUEUE,
+                              memory_order_release);
+        r->deq_pos++;
+
+        free_list(e, head);
+    }
+    return NULL;
+}
+
+int epoch_reclaimer_start(epoch_t *e, int cpu)
+{
+    struct epoch_reclaimer *r = &e->reclaimer;
+    if (atomic_load(&r->running)) return 0;
+
+    for (size_t i = 0; i < EPOCH_RECLAIM_QUEUE; i++)
+        atomic_store(&r->cells[i].seq, i);
+    atomic_store(&r->enq_pos, 0);
+    r->deq_pos = 0;
+    atomic_store(&r->stop, false);
+    if (sem_init(&r->ready, 0, 0) != 0)
+        return -1;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+    int rc = pthread_create(&r->thread, &attr, reclaimer_main, e);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        sem_destroy(&r->ready);
+        return -1;
+    }
+
+    atomic_store_explicit(&r->running, true, memory_order_release);
+    return 0;
+}
+
+void epoch_reclaimer_stop(epoch_t *e)
+{
+    struct epoch_reclaimer *r = &e->reclaimer;
+    if (!atomic_load(&r->running)) return;
+
+    atomic_store(&r->running, false);
+    atomic_store_explicit(&r->stop, true, memory_order_release);
+    sem_post(&r->ready);
+    pthread_join(r->thread, NULL);
+    sem_destroy(&r->ready);
+}
+
+/* Free an expired list, on the reclaimer if one is running */
+static void dispose_list(epoch_t *e, struct epoch_node *head)
+{
+    if (!head) return;
+
+    struct epoch_reclaimer *r = &e->reclaimer;
+    if (atomic_load_explicit(&r->running, memory_order_acquire)) {
+        if (reclaim_enqueue(r, head)) {
+            atomic_fetch_add_explicit(&r->handed_off, 1, memory_order_relaxed);
+            sem_post(&r->ready);
+            return;
+        }
+        atomic_fetch_add_explicit(&r->inline_fallbacks, 1, memory_order_relaxed);
+    }
+    free_list(e, head);
+}
+
+/* Dispose of one of a thread's lists and mark it empty */
+static void drain_list(epoch_t *e, epoch_thread_t *t, int idx)
+{
+    dispose_list(e, t->retire[idx]);
+    t->retire[idx] = NULL;
+    t->retire_tail[idx] = NULL;
+    t->retire_count[idx] = 0;
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Batched reclamation
+ *
+ * With reclaim_batch set, expired lists are spliced onto the thread's
+ * pending list in O(1) and epoch_enter frees at most reclaim_batch of
+ * them, so one enter never pays for a whole epoch's garbage.
+ * ────────────────────────────────────────────────────────────────── */
+
+void epoch_set_reclaim_batch(epoch_t *e, uint32_t max)
+{
+    e->reclaim_batch = max;
+}
+
+static bool batching(epoch_t *e)
+{
+    return e->reclaim_batch &&
+           !atomic_load_explicit(&e->reclaimer.running, memory_order_relaxed);
+}
+
+static void pend_list(epoch_thread_t *t, struct epoch_node *head,
+                      struct epoch_node *tail, uint32_t count)
+{
+    if (!head) return;
+    tail->next = t->pending;
+    if (!t->pending)
+        t->pending_tail = tail;
+    t->pending = head;
+    t->pending_count += count;
+}
+
+/* One of the thread's own lists has expired: free it or queue it */
+static void expire_list(epoch_t *e, epoch_thread_t *t, int idx)
+{
+    if (!batching(e)) {
+        drain_list(e, t, idx);
+        return;
+    }
+    pend_list(t, t->retire[idx], t->retire_tail[idx], t->retire_count[idx]);
+    t->retire[idx] = NULL;
+    t->retire_tail[idx] = NULL;
+    t->retire_count[idx] = 0;
+}
+
+/* Free up to `max` pending objects (0 = all) */
+static void free_pending(epoch_t *e, epoch_thread_t *t, uint32_t max)
+{
+    uint32_t n = 0;
+    while (t->pending && (max == 0 || n < max)) {
+        struct epoch_node *node = t->pending;
+        t->pending = node->next;
+        free_node(e, node);
+        n++;
+    }
+    t->pending_count -= n;
+    if (n) {
+        atomic_fetch_sub_explicit(&e->unreclaimed, n, memory_order_relaxed);
+        PROBE2(epoch, reclaim, e, n);
+    }
+    if (!t->pending)
+        t->pending_tail = NULL;
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Orphan stack
+ *
+ * Push is a Treiber-stack CAS. Consumers take the whole stack with one
+ * exchange, so there is no pop-side ABA; batches that are not yet safe
+ * are pushed back as a chain.
+ * ────────────────────────────────────────────────────────────────── */
+
+static void orphan_push_chain(epoch_t *e, struct epoch_orphan *first,
+                              struct epoch_orphan *last)
+{
+    struct epoch_orphan *top = atomic_load_explicit(&e->orphans, memory_order_relaxed);
+    do {
+        last->next = top;
+    } while (!atomic_compare_exchange_weak_explicit(
+                 &e->orphans, &top, first,
+                 memory_order_release, memory_order_relaxed));
+}
+
+/*
+ * Free every orphaned list whose grace period has expired at `ge`, or
+ * queue it on `t` (the advancing thread, if any) when batching.
+ */
+static void reclaim_orphans(epoch_t *e, uint64_t ge, epoch_thread_t *t)
+{
+    if (!atomic_load_explicit(&e->orphans, memory_order_relaxed))
+        return;
+
+    struct epoch_orphan *o = atomic_exchange_explicit(&e->orphans, NULL,
+                                                      memory_order_acquire);
+    struct epoch_orphan *keep = NULL, *keep_last = NULL;
+
+    while (o) {
+        struct epoch_orphan *next = o->next;
+        if (o->epoch + 2 <= ge) {
+            if (t && batching(e))
+                pend_list(t, o->head, o->tail, o->count);
+            else
+                dispose_list(e, o->head);
+            free(o);
+        } else {
+            o->next = keep;
+            keep = o;
+            if (!keep_last) keep_last = o;
+        }
+        o = next;
+    }
+
+    if (keep)
+        orphan_push_chain(e, keep, keep_last);
+}
+
+void epoch_flush(epoch_t *e, int slot)
+{
+    if (slot < 0 || slot >= EPOCH_MAX_THREADS) return;
+    epoch_thread_t *t = &e->threads[slot];
+
+    for (int j = 0; j < EPOCH_COUNT; j++) {
+        if (!t->retire[j])
+            continue;
+        struct epoch_orphan *o = malloc(sizeof(*o));
+        if (!o)
+            return;  /* keep the list; it stays with the slot */
+        o->head = t->retire[j];
+        o->tail = t->retire_tail[j];
+        o->epoch = t->retire_epoch[j];
+        o->count = t->retire_count[j];
+        orphan_push_chain(e, o, o);
+        t->retire[j] = NULL;
+        t->retire_tail[j] = NULL;
+        t->retire_count[j] = 0;
+    }
+
+    /* Already expired: stamp with epoch 0 so the next advance frees it */
+    if (t->pending) {
+        struct epoch_orphan *o = malloc(sizeof(*o));
+        if (!o)
+            return;
+        o->head = t->pending;
+        o->tail = t->pending_tail;
+        o->epoch = 0;
+        o->count = t->pending_count;
+        orphan_push_chain(e, o, o);
+        t->pending = t->pending_tail = NULL;
+        t->pending_count = 0;
     }
 }
 
 void epoch_destroy(epoch_t *e)
 {
+    epoch_reclaimer_stop(e);
+
     for (int t = 0; t < EPOCH_MAX_THREADS; t++) {
-        for (int j = 0; j < EPOCH_COUNT; j++) {
-            free_list(e->free_fn, e->threads[t].retire[j]);
-            e->threads[t].retire[j] = NULL;
-            e->threads[t].retire_count[j] = 0;
-        }
+        for (int j = 0; j < EPOCH_COUNT; j++)
+            drain_list(e, &e->threads[t], j);
+        free_pending(e, &e->threads[t], 0);
+    }
+
+    struct epoch_orphan *o = atomic_exchange(&e->orphans, NULL);
+    while (o) {
+        struct epoch_orphan *next = o->next;
+        free_list(e, o->head);
+        free(o);
+        o = next;
     }
 }
 
@@ -62,6 +395,7 @@ int epoch_register(epoch_t *e)
         if (atomic_compare_exchange_strong(&e->threads[i].active, &expected, true)) {
             atomic_store(&e->threads[i].epoch,
                          atomic_load(&e->global_epoch));
+            e->threads[i].nesting = 0;
             tls_epoch_slot = i;
             return i;
         }
@@ -73,12 +407,13 @@ void epoch_unregister(epoch_t *e, int slot)
 {
     if (slot < 0 || slot >= EPOCH_MAX_THREADS) return;
 
-    /* Drain all retire lists for this thread */
-    for (int j = 0; j < EPOCH_COUNT; j++) {
-        free_list(e->free_fn, e->threads[slot].retire[j]);
-        e->threads[slot].retire[j] = NULL;
-        e->threads[slot].retire_count[j] = 0;
-    }
+    /*
+     * Hand off, don't free: nodes retired in the last two epochs may
+     * still be referenced by other threads. If the hand-off cannot
+     * allocate, the lists stay with the slot (they carry their epochs)
+     * and are reclaimed by its next owner or epoch_destroy.
+     */
+    epoch_flush(e, slot);
 
     atomic_store(&e->threads[slot].active, false);
     if (tls_epoch_slot == slot)
@@ -86,105 +421,311 @@ void epoch_unregister(epoch_t *e, int slot)
 }
 
 /*
- * Try to reclaim the retire list for a safe epoch across ALL threads.
- * Safe epoch = global_epoch - 2 (with 3-epoch scheme).
+ * Reclaim after advancing to new_epoch: epoch (new_epoch - 2) and older
+ * is safe (3-epoch scheme). The advancing thread frees orphaned lists;
+ * each thread frees its own lists in epoch_enter.
  */
-static void try_reclaim(epoch_t *e, uint64_t new_epoch)
+static void try_reclaim(epoch_t *e, uint64_t new_epoch, epoch_thread_t *t)
 {
-    /* After advancing to new_epoch, epoch (new_epoch - 2) is safe to free */
     if (new_epoch < 2) return;
-    int safe_idx = (int)((new_epoch - 2) % EPOCH_COUNT);
+    reclaim_orphans(e, new_epoch, t);
+}
 
-    for (int t = 0; t < EPOCH_MAX_THREADS; t++) {
-        if (!atomic_load_explicit(&e->threads[t].active, memory_order_acquire))
-            continue;
-        /* Only reclaim from our own thread (or inactive threads) to avoid races */
-    }
+/* ──────────────────────────────────────────────────────────────────
+ * Asymmetric fences
+ *
+ * A reader's epoch store must be visible before its first node load,
+ * or an advancer could miss it and free what it is about to read. In
+ * asymmetric mode the reader only stops the compiler reordering; the
+ * advancer's membarrier runs a full barrier on every CPU executing one
+ * of our threads (a context switch is one already), so by the time it
+ * scans the epochs every in-flight announcement is visible.
+ * ────────────────────────────────────────────────────────────────── */
 
-    /* Actually, since retire lists are per-thread and only the owning thread
-     * writes to them, we can safely free from the calling thread's list only.
-     * Other threads will free their own lists on their next epoch_enter. */
-    int slot = tls_epoch_slot;
-    if (slot < 0 || slot >= EPOCH_MAX_THREADS) return;
+static int membarrier(int cmd)
+{
+    return (int)syscall(__NR_membarrier, cmd, 0, 0);
+}
 
-    free_list(e->free_fn, e->threads[slot].retire[safe_idx]);
-    e->threads[slot].retire[safe_idx] = NULL;
-    e->threads[slot].retire_count[safe_idx] = 0;
+int epoch_use_membarrier(epoch_t *e)
+{
+    int cmds = membarrier(MEMBARRIER_CMD_QUERY);
+    if (cmds < 0 || !(cmds & MEMBARRIER_CMD_PRIVATE_EXPEDITED))
+        return -1;
+    if (membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED) != 0)
+        return -1;
+    e->asymmetric = true;
+    return 0;
 }
 
-void epoch_try_advance(epoch_t *e)
+/* Asymmetric mode: advance from enter only with garbage, and not every time */
+static bool advance_due(epoch_t *e, epoch_thread_t *t)
 {
-    uint64_t ge = atomic_load_explicit(&e->global_epoch, memory_order_acquire);
+    bool garbage = t->pending ||
+                   atomic_load_explicit(&e->orphans, memory_order_relaxed);
+    for (int j = 0; j < EPOCH_COUNT && !garbage; j++)
+        garbage = t->retire[j] != NULL;
+    if (!garbage || ++t->advance_skip < EPOCH_ASYM_INTERVAL)
+        return false;
+    t->advance_skip = 0;
+    return true;
+}
 
+/* First registered slot still inside an epoch older than `ge`, or -1 */
+static int find_laggard(epoch_t *e, uint64_t ge)
+{
     for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
         if (!atomic_load_explicit(&e->threads[i].active, memory_order_acquire))
             continue;
         uint64_t te = atomic_load_explicit(&e->threads[i].epoch, memory_order_acquire);
         if (te != UINT64_MAX && te < ge)
-            return;  /* thread i hasn't caught up */
+            return i;
     }
+    return -1;
+}
+
+/* `t` is the calling thread's state, or NULL if it has none */
+static void try_advance(epoch_t *e, epoch_thread_t *t)
+{
+    if (e->asymmetric)
+        membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED);
+
+    uint64_t ge = atomic_load_explicit(&e->global_epoch, memory_order_acquire);
+
+    if (find_laggard(e, ge) >= 0)
+        return;  /* a thread hasn't caught up */
 
     /* All threads at current epoch — try to advance */
     uint64_t new_epoch = ge + 1;
     if (atomic_compare_exchange_strong_explicit(&e->global_epoch, &ge, new_epoch,
             memory_order_acq_rel, memory_order_acquire)) {
-        try_reclaim(e, new_epoch);
+        PROBE2(epoch, advance, e, new_epoch);
+        try_reclaim(e, new_epoch, t);
     }
 }
 
+void epoch_try_advance(epoch_t *e)
+{
+    try_advance(e, NULL);
+}
+
+int epoch_stalled_slot(epoch_t *e)
+{
+    return find_laggard(e, atomic_load_explicit(&e->global_epoch,
+                                                memory_order_acquire));
+}
+
+/* Expire the thread's own lists that are safe at `ge`; free up to `max` */
+static void reclaim_own(epoch_t *e, epoch_thread_t *t, uint64_t ge, uint32_t max)
+{
+    for (int j = 0; j < EPOCH_COUNT; j++) {
+        if (t->retire[j] && t->retire_epoch[j] + 2 <= ge)
+            expire_list(e, t, j);
+    }
+    if (t->pending)
+        free_pending(e, t, max);
+}
+
+/* Publish `ge` as the slot's epoch, ordered before its next node loads */
+static void announce(epoch_t *e, epoch_thread_t *t, uint64_t ge)
+{
+    atomic_store_explicit(&t->epoch, ge, memory_order_release);
+
+    /* Announcement before node loads (StoreLoad): see Asymmetric fences */
+    if (e->asymmetric)
+        atomic_signal_fence(memory_order_seq_cst);
+    else
+        atomic_thread_fence(memory_order_seq_cst);
+}
+
 uint64_t epoch_enter(epoch_t *e, int slot)
 {
-    uint64_t ge = atomic_load_explicit(&e->global_epoch, memory_order_acquire);
-    atomic_store_explicit(&e->threads[slot].epoch, ge, memory_order_release);
-    e->threads[slot].in_critical = true;
+    epoch_thread_t *t = &e->threads[slot];
+
+    /* Nested: already protected by the outer section's epoch */
+    if (t->nesting++ > 0)
+        return atomic_load_explicit(&t->epoch, memory_order_relaxed);
+
+    uint64_t ge;
+    if (e->qsbr) {
+        /* Online threads are protected until their next report */
+        ge = atomic_load_explicit(&t->epoch, memory_order_relaxed);
+        if (ge != UINT64_MAX)
+            return ge;
+        ge = atomic_load_explicit(&e->global_epoch, memory_order_acquire);
+        announce(e, t, ge);
+        return ge;
+    }
+
+    ge = atomic_load_explicit(&e->global_epoch, memory_order_acquire);
+    announce(e, t, ge);
 
     /* Try to advance + reclaim on entry */
-    epoch_try_advance(e);
+    if (!e->asymmetric || advance_due(e, t))
+        try_advance(e, t);
 
     /* Also reclaim our own safe lists */
-    if (ge >= 2) {
-        int safe_idx = (int)((ge - 2) % EPOCH_COUNT);
-        if (e->threads[slot].retire[safe_idx]) {
-            free_list(e->free_fn, e->threads[slot].retire[safe_idx]);
-            e->threads[slot].retire[safe_idx] = NULL;
-            e->threads[slot].retire_count[safe_idx] = 0;
-        }
-    }
+    reclaim_own(e, t, ge, e->reclaim_batch);
 
     return ge;
 }
 
 void epoch_exit(epoch_t *e, int slot)
 {
-    e->threads[slot].in_critical = false;
+    if (--e->threads[slot].nesting > 0 || e->qsbr)
+        return;
     atomic_store_explicit(&e->threads[slot].epoch, UINT64_MAX, memory_order_release);
 }
 
+/* ──────────────────────────────────────────────────────────────────
+ * Quiescent-state-based reclamation
+ *
+ * The announced epoch of an online thread is the epoch of its last
+ * quiescent report, so the usual laggard test holds: a node retired in
+ * epoch r is freed once every online thread has reported in r + 1 or
+ * later, i.e. after it was unlinked. Offline threads announce
+ * UINT64_MAX, as threads outside a section do in the default mode.
+ * ────────────────────────────────────────────────────────────────── */
+
+void epoch_use_qsbr(epoch_t *e)
+{
+    e->qsbr = true;
+}
+
+void epoch_quiescent(epoch_t *e, int slot)
+{
+    if (slot < 0 || slot >= EPOCH_MAX_THREADS) return;
+    epoch_thread_t *t = &e->threads[slot];
+    if (!e->qsbr || t->nesting > 0)
+        return;
+
+    uint64_t ge = atomic_load_explicit(&e->global_epoch, memory_order_acquire);
+    announce(e, t, ge);
+    try_advance(e, t);
+
+    /* Our report may have been the last one missing */
+    ge = atomic_load_explicit(&e->global_epoch, memory_order_acquire);
+    reclaim_own(e, t, ge, e->reclaim_batch);
+}
+
+void epoch_offline(epoch_t *e, int slot)
+{
+    if (slot < 0 || slot >= EPOCH_MAX_THREADS) return;
+    if (!e->qsbr || e->threads[slot].nesting > 0)
+        return;
+    atomic_store_explicit(&e->threads[slot].epoch, UINT64_MAX, memory_order_release);
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Retire pressure
+ * ────────────────────────────────────────────────────────────────── */
+
+void epoch_set_pressure(epoch_t *e, uint32_t thread_limit, size_t ceiling,
+                        epoch_stall_fn stall_fn, void *stall_arg)
+{
+    e->thread_limit = thread_limit;
+    e->ceiling = ceiling;
+    e->stall_fn = stall_fn;
+    e->stall_arg = stall_arg;
+}
+
+size_t epoch_unreclaimed(epoch_t *e)
+{
+    int64_t n = atomic_load_explicit(&e->unreclaimed, memory_order_relaxed);
+    return n > 0 ? (size_t)n : 0;
+}
+
+static size_t thread_backlog(const epoch_thread_t *t)
+{
+    size_t n = t->pending_count;
+    for (int j = 0; j < EPOCH_COUNT; j++)
+        n += t->retire_count[j];
+    return n;
+}
+
+size_t epoch_backlog(epoch_t *e, int slot)
+{
+    if (slot < 0 || slot >= EPOCH_MAX_THREADS) return 0;
+    return thread_backlog(&e->threads[slot]);
+}
+
+/*
+ * Publish a chunk of retires and enforce the limits: past either one,
+ * advance and reclaim now rather than at the next epoch_enter. Over the
+ * global ceiling, reclaim_batch is ignored. Inside a critical section
+ * this gets at most one advance (our own epoch then lags), which still
+ * frees older lists and orphans.
+ */
+static void retire_pressure(epoch_t *e, epoch_thread_t *t)
+{
+    int64_t global = atomic_fetch_add_explicit(&e->unreclaimed, t->unpublished,
+                                               memory_order_relaxed) + t->unpublished;
+    t->unpublished = 0;
+
+    bool over_thread = e->thread_limit && thread_backlog(t) >= e->thread_limit;
+    bool over_global = e->ceiling && global >= (int64_t)e->ceiling;
+    if (!over_thread && !over_global)
+        return;
+    PROBE3(epoch, pressure, e, (int)(t - e->threads), global);
+
+    try_advance(e, t);
+    uint64_t ge = atomic_load_explicit(&e->global_epoch, memory_order_acquire);
+    reclaim_own(e, t, ge, over_global ? 0 : e->reclaim_batch);
+
+    if (!over_global || !e->stall_fn ||
+        (int64_t)epoch_unreclaimed(e) < (int64_t)e->ceiling)
+        return;
+
+    /* Report once per stuck epoch */
+    uint64_t seen = atomic_load_explicit(&e->stall_reported, memory_order_relaxed);
+    if (seen == ge + 1 ||
+        !atomic_compare_exchange_strong(&e->stall_reported, &seen, ge + 1))
+        return;
+    e->stall_fn(e->stall_arg, find_laggard(e, ge), epoch_unreclaimed(e));
+}
+
 void epoch_retire(epoch_t *e, void *ptr)
 {
     epoch_retire_slot(e, tls_epoch_slot, ptr);
 }
 
 void epoch_retire_slot(epoch_t *e, int slot, void *ptr)
+{
+    epoch_retire_fn(e, slot, ptr, e->free_fn);
+}
+
+void epoch_retire_fn(epoch_t *e, int slot, void *ptr, epoch_free_fn fn)
 {
     if (slot < 0 || slot >= EPOCH_MAX_THREADS) {
         /* No slot — free immediately (unsafe but prevents leak) */
-        if (e->free_fn) e->free_fn(ptr);
+        run_fn(e, fn, ptr);
         return;
     }
 
     struct epoch_node *node = malloc(sizeof(struct epoch_node));
     if (!node) {
-        if (e->free_fn) e->free_fn(ptr);
+        run_fn(e, fn, ptr);
         return;
     }
     node->ptr = ptr;
+    node->fn = fn;
 
     uint64_t ge = atomic_load_explicit(&e->global_epoch, memory_order_acquire);
     int idx = (int)(ge % EPOCH_COUNT);
+    epoch_thread_t *t = &e->threads[slot];
+
+    /* A list left from epoch ge-3 or earlier is already safe */
+    if (t->retire[idx] && t->retire_epoch[idx] != ge)
+        expire_list(e, t, idx);
+    t->retire_epoch[idx] = ge;
 
     /* Thread-local list — no lock needed */
-    node->next = e->threads[slot].retire[idx];
-    e->threads[slot].retire[idx] = node;
-    e->threads[slot].retire_count[idx]++;
+    node->next = t->retire[idx];
+    if (!t->retire[idx])
+        t->retire_tail[idx] = node;
+    t->retire[idx] = node;
+    t->retire_count[idx]++;
+
+    if (++t->unpublished >= EPOCH_PRESSURE_CHUNK)
+        retire_pressure(e, t);
 }
@@ -7,7 +7,16 @@
  * still hold a reference.
  *
  * Design: 3-epoch system (Fraser, 2004) with per-thread retire lists
- * to eliminate mutex contention on the retire path.
+ * to eliminate mutex contention on the retire path. Threads that go
+ * idle or exit hand their lists to a global lock-free orphan stack,
+ * which whoever advances the epoch reclaims. Optionally, expired lists
+ * are passed to a background reclaimer thread so application threads
+ * never pay for the frees themselves.
+ *
+ * In QSBR mode (epoch_use_qsbr) threads stay inside an implicit critical
+ * section from registration on and instead report quiescent states,
+ * points where they hold no references; grace periods are detected from
+ * those reports and read paths need no announcement at all.
  *
  * Author: G.H. Murray
  * Date:   2026-02-17
@@ -20,16 +29,62 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
 
 #define EPOCH_COUNT       3
 #define EPOCH_MAX_THREADS 64
+#define EPOCH_RECLAIM_QUEUE 256   /* Reclaimer hand-off slots (power of 2) */
+#define EPOCH_PRESSURE_CHUNK 64   /* Retires between pressure checks       */
+#define EPOCH_ASYM_INTERVAL  16   /* Enters between advances (membarrier)  */
 
-/* Callback for freeing a retired node */
+/* Callback for freeing a retired node (the default, or per object) */
 typedef void (*epoch_free_fn)(void *ptr);
 
+/*
+ * Called when unreclaimed objects exceed the global ceiling and the
+ * epoch cannot advance. `slot` is the thread holding it back (-1 if
+ * none was found), `pending` the approximate unreclaimed count.
+ */
+typedef void (*epoch_stall_fn)(void *arg, int slot, size_t pending);
+
 struct epoch_node {
     struct epoch_node *next;
     void              *ptr;
+    epoch_free_fn      fn;          /* Destructor (NULL = none) */
+};
+
+/*
+ * A retire list handed off by an idle or exiting thread.
+ */
+struct epoch_orphan {
+    struct epoch_orphan *next;
+    struct epoch_node   *head;
+    struct epoch_node   *tail;
+    uint64_t             epoch;     /* Epoch its nodes were retired in */
+    uint32_t             count;
+};
+
+/*
+ * Background reclaimer: a bounded MPSC ring of expired retire lists
+ * (Vyukov-style per-cell sequence numbers) plus a semaphore to wake the
+ * consumer. When the ring is full the producer frees inline instead.
+ */
+struct epoch_reclaim_cell {
+    _Atomic size_t     seq;
+    struct epoch_node *head;
+};
+
+struct epoch_reclaimer {
+    _Atomic bool              running;
+    _Atomic bool              stop;
+    pthread_t                 thread;
+    sem_t                     ready;     /* One post per enqueued list */
+    _Atomic size_t            enq_pos;
+    size_t                    deq_pos;   /* Consumer-only              */
+    _Atomic uint64_t          handed_off;
+    _Atomic uint64_t          inline_fallbacks;
+    struct epoch_reclaim_cell cells[EPOCH_RECLAIM_QUEUE];
 };
 
 /*
@@ -38,11 +93,21 @@ struct epoch_node {
 typedef struct epoch_thread {
     _Atomic uint64_t   epoch;       /* Last observed global epoch      */
     _Atomic bool       active;      /* Registered?                     */
-    bool               in_critical; /* Currently in epoch_enter/exit?  */
+    uint32_t           nesting;     /* epoch_enter depth (0 = outside) */
 
     /* Per-epoch retire lists — thread-local, no contention */
     struct epoch_node *retire[EPOCH_COUNT];
     uint32_t           retire_count[EPOCH_COUNT];
+    struct epoch_node *retire_tail[EPOCH_COUNT];
+    uint64_t           retire_epoch[EPOCH_COUNT]; /* Epoch of each list */
+
+    /* Expired but not yet freed (reclaim_batch mode) */
+    struct epoch_node *pending;
+    struct epoch_node *pending_tail;
+    uint32_t           pending_count;
+
+    uint32_t           unpublished;  /* Retires not yet in e->unreclaimed */
+    uint32_t           advance_skip; /* Enters since last advance (asym)  */
 } epoch_thread_t;
 
 /*
@@ -52,6 +117,19 @@ typedef struct epoch {
     _Atomic uint64_t    global_epoch;
     epoch_thread_t      threads[EPOCH_MAX_THREADS];
     epoch_free_fn       free_fn;
+    uint32_t            reclaim_batch;  /* Max frees per enter (0 = all) */
+    bool                asymmetric;     /* membarrier replaces enter fence */
+    bool                qsbr;           /* Quiescent reports, no sections  */
+
+    /* Retire pressure (0 = no limit) */
+    _Atomic int64_t     unreclaimed;    /* Retired, not yet freed (approx) */
+    uint32_t            thread_limit;   /* Per-thread: force an advance   */
+    size_t              ceiling;        /* Global: force + report stall   */
+    epoch_stall_fn      stall_fn;
+    void               *stall_arg;
+    _Atomic uint64_t    stall_reported; /* Epoch + 1 of the last report   */
+    _Atomic(struct epoch_orphan *) orphans;  /* Handed-off retire lists */
+    struct epoch_reclaimer reclaimer;
 } epoch_t;
 
 /*
@@ -70,12 +148,25 @@ void epoch_destroy(epoch_t *e);
 int epoch_register(epoch_t *e);
 
 /*
- * epoch_unregister — Unregister a thread slot (drains its retire lists)
+ * epoch_unregister — Unregister a thread slot
+ *
+ * Its pending retire lists are handed off (see epoch_flush), not freed:
+ * other threads may still hold references to them.
  */
 void epoch_unregister(epoch_t *e, int slot);
 
 /*
  * epoch_enter — Enter a critical section (read-side)
+ *
+ * Critical sections nest: only the outermost enter announces an epoch,
+ * and only the matching outermost exit leaves it. The announcement is
+ * ordered before the section's loads by a full fence, or in asymmetric
+ * mode by a compiler barrier paired with membarrier in the advancer.
+ *
+ * In QSBR mode it announces nothing unless the thread is offline (which
+ * brings it back online); an open section keeps epoch_quiescent and
+ * epoch_offline from moving the thread's announcement, so a reader may
+ * hold references across quiescent points until the matching exit.
  */
 uint64_t epoch_enter(epoch_t *e, int slot);
 
@@ -96,9 +187,134 @@ void epoch_retire(epoch_t *e, void *ptr);
  */
 void epoch_retire_slot(epoch_t *e, int slot, void *ptr);
 
+/*
+ * epoch_retire_fn — Retire with a destructor of its own
+ *
+ * `fn` (NULL = none) runs instead of the epoch's free_fn once the grace
+ * period expires, on whichever thread reclaims the object; objects of
+ * different kinds (nodes, arrays, user values) can so be returned to
+ * their own allocators. Otherwise as epoch_retire_slot.
+ */
+void epoch_retire_fn(epoch_t *e, int slot, void *ptr, epoch_free_fn fn);
+
 /*
  * epoch_try_advance — Try to advance the global epoch and reclaim
+ *
+ * The thread that advances also frees every orphaned list whose grace
+ * period has expired.
  */
 void epoch_try_advance(epoch_t *e);
 
+/*
+ * epoch_flush — Hand the slot's pending retire lists to the orphan stack
+ *
+ * For threads about to go idle: their garbage is then reclaimed by
+ * whichever thread next advances the epoch instead of waiting for this
+ * one to return. Only the slot's owner may call it.
+ */
+void epoch_flush(epoch_t *e, int slot);
+
+/*
+ * epoch_set_reclaim_batch — Bound the frees done by one epoch_enter
+ *
+ * Expired lists are queued on the entering thread and at most `max`
+ * objects are freed per enter; the rest carry over to the next one. 0
+ * (the default) frees whole lists. Set before threads start.
+ */
+void epoch_set_reclaim_batch(epoch_t *e, uint32_t max);
+
+/*
+ * epoch_set_pressure — Bound unreclaimed memory
+ *
+ * Every EPOCH_PRESSURE_CHUNK retires a thread checks its own backlog
+ * against thread_limit and the global backlog against ceiling; past
+ * either, it tries to advance the epoch and reclaim at once. If the
+ * global ceiling is still exceeded, stall_fn (optional) is called once
+ * per stuck epoch with the slot holding it back. 0 disables a limit.
+ * Set before threads start.
+ */
+void epoch_set_pressure(epoch_t *e, uint32_t thread_limit, size_t ceiling,
+                        epoch_stall_fn stall_fn, void *stall_arg);
+
+/*
+ * epoch_stalled_slot — A registered slot still inside an older epoch,
+ * i.e. one preventing the next advance, or -1 if none.
+ */
+int epoch_stalled_slot(epoch_t *e);
+
+/*
+ * epoch_backlog — Objects the slot has retired and not yet freed (its
+ * lists plus pending). Only the slot's owner may call it.
+ */
+size_t epoch_backlog(epoch_t *e, int slot);
+
+/*
+ * epoch_reclaiming — The domain whose destructor is running on the
+ * calling thread, or NULL outside one. Lets a destructor shared by
+ * several domains find the one it is freeing for.
+ */
+epoch_t *epoch_reclaiming(void);
+
+/*
+ * epoch_unreclaimed — Approximate count of retired, not yet freed objects
+ * (retires are published in chunks of EPOCH_PRESSURE_CHUNK per thread).
+ */
+size_t epoch_unreclaimed(epoch_t *e);
+
+/*
+ * epoch_use_membarrier — Switch to asymmetric fences
+ *
+ * epoch_enter then costs only a compiler barrier; epoch_try_advance
+ * issues membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED) to fence every
+ * running thread at once, and enters attempt an advance only when the
+ * caller has garbage, every EPOCH_ASYM_INTERVAL enters. Returns 0, or
+ * -1 if the kernel lacks it (full fences stay). Set before threads start.
+ */
+int epoch_use_membarrier(epoch_t *e);
+
+/*
+ * epoch_use_qsbr — Switch to quiescent-state-based reclamation
+ *
+ * A registered thread is then online, i.e. assumed to hold references,
+ * until it calls epoch_quiescent or epoch_offline; epoch_enter/exit no
+ * longer announce anything. A thread that neither reports nor goes
+ * offline holds back every grace period. Set before threads start.
+ */
+void epoch_use_qsbr(epoch_t *e);
+
+/*
+ * epoch_quiescent — Report that the calling thread holds no references
+ *
+ * Re-announces the current epoch (bringing an offline thread back
+ * online), tries to advance it and frees the thread's expired lists, as
+ * epoch_enter does in the default mode. Call once per event-loop
+ * iteration or similar. Ignored inside an epoch_enter section. QSBR only.
+ */
+void epoch_quiescent(epoch_t *e, int slot);
+
+/*
+ * epoch_offline — Stop holding back grace periods until the next
+ * epoch_quiescent, e.g. before blocking in poll(). The thread must not
+ * dereference shared nodes while offline. QSBR only.
+ */
+void epoch_offline(epoch_t *e, int slot);
+
+/*
+ * epoch_reclaimer_start — Free expired lists on a background thread
+ *
+ * Once started, lists whose grace period has expired are queued to the
+ * reclaimer instead of being freed inside epoch_enter. If cpu >= 0 the
+ * thread is pinned to that CPU. Returns 0, or -1 if the thread could not
+ * be created (reclamation then stays inline).
+ */
+int epoch_reclaimer_start(epoch_t *e, int cpu);
+
+/*
+ * epoch_reclaimer_stop — Drain the queue and join the reclaimer
+ *
+ * No thread may be inside the epoch system while it runs. Called by
+ * epoch_destroy.
+ */
+void epoch_reclaimer_stop(epoch_t *e);
+
 #endif /* EPOCH_H */
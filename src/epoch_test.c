@@ -12,6 +12,8 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <pthread.h>
+#include <string.h>
+#include <sched.h>
 
 static _Atomic int free_count = 0;
 
@@ -129,6 +131,555 @@ static void test_multithreaded_epoch(void)
     printf("  PASSED\n\n");
 }
 
+/*
+ * Bursty retirer: one thread retires a burst, flushes, then idles while
+ * still registered. A reader alone must reclaim the burst, so the peak
+ * RSS stays near one burst instead of growing with every burst.
+ */
+#define BURSTS       10
+#define BURST_BLOCKS 256
+#define BURST_BYTES  (16 * 1024)
+
+struct burst_args {
+    epoch_t    *e;
+    _Atomic int burst;      /* bursts requested by the reader */
+    _Atomic int done;       /* bursts retired and flushed     */
+};
+
+static long vm_hwm_kb(void)
+{
+    FILE *f = fopen("/proc/self/status", "r");
+    if (!f) return -1;
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            kb = strtol(line + 6, NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+static void *burst_worker(void *arg)
+{
+    struct burst_args *a = arg;
+    int slot = epoch_register(a->e);
+    assert(slot >= 0);
+
+    for (int b = 0; b < BURSTS; b++) {
+        while (atomic_load(&a->burst) <= b)
+            sched_yield();
+        epoch_enter(a->e, slot);
+        for (int i = 0; i < BURST_BLOCKS; i++) {
+            char *p = malloc(BURST_BYTES);
+            memset(p, b, BURST_BYTES);
+            epoch_retire(a->e, p);
+        }
+        epoch_exit(a->e, slot);
+        epoch_flush(a->e, slot);
+        atomic_store(&a->done, b + 1);
+    }
+
+    epoch_unregister(a->e, slot);
+    return NULL;
+}
+
+static void test_bursty_reclaim(void)
+{
+    printf("=== test_bursty_reclaim ===\n");
+
+    epoch_t e;
+    epoch_init(&e, test_free_fn);
+    atomic_store(&free_count, 0);
+
+    struct burst_args args = { .e = &e };
+    pthread_t t;
+    pthread_create(&t, NULL, burst_worker, &args);
+
+    int slot = epoch_register(&e);
+    long hwm_first = 0;
+
+    for (int b = 0; b < BURSTS; b++) {
+        atomic_store(&args.burst, b + 1);
+        while (atomic_load(&args.done) <= b)
+            sched_yield();
+
+        /* The retirer is idle now: only this thread drives reclamation */
+        int spins = 0;
+        while (atomic_load(&free_count) < (b + 1) * BURST_BLOCKS) {
+            epoch_enter(&e, slot);
+            epoch_exit(&e, slot);
+            assert(++spins < 100);
+        }
+        if (b == 0)
+            hwm_first = vm_hwm_kb();
+    }
+
+    long hwm_last = vm_hwm_kb();
+    long burst_kb = (long)BURST_BLOCKS * BURST_BYTES / 1024;
+    printf("  freed %d/%d, VmHWM %ld kB -> %ld kB (burst %ld kB)\n",
+           atomic_load(&free_count), BURSTS * BURST_BLOCKS,
+           hwm_first, hwm_last, burst_kb);
+    assert(atomic_load(&free_count) == BURSTS * BURST_BLOCKS);
+#ifndef __SANITIZE_ADDRESS__   /* ASan quarantines frees, so no reuse */
+    if (hwm_first > 0)
+        assert(hwm_last - hwm_first < 2 * burst_kb);
+#endif
+
+    pthread_join(t, NULL);
+    epoch_unregister(&e, slot);
+    epoch_destroy(&e);
+    printf("  PASSED\n\n");
+}
+
+/* Background reclaimer: frees happen on its thread, never the caller's */
+#define BG_ROUNDS  200
+#define BG_PER     50
+
+static pthread_t bg_caller;
+static _Atomic int bg_inline_frees = 0;
+
+static void bg_free_fn(void *ptr)
+{
+    if (pthread_equal(pthread_self(), bg_caller))
+        atomic_fetch_add(&bg_inline_frees, 1);
+    test_free_fn(ptr);
+}
+
+static void test_background_reclaim(void)
+{
+    printf("=== test_background_reclaim ===\n");
+
+    epoch_t e;
+    epoch_init(&e, bg_free_fn);
+    atomic_store(&free_count, 0);
+    atomic_store(&bg_inline_frees, 0);
+    bg_caller = pthread_self();
+
+    assert(epoch_reclaimer_start(&e, 0) == 0);
+    int slot = epoch_register(&e);
+
+    for (int r = 0; r < BG_ROUNDS; r++) {
+        epoch_enter(&e, slot);
+        for (int i = 0; i < BG_PER; i++)
+            epoch_retire(&e, malloc(sizeof(int)));
+        epoch_exit(&e, slot);
+    }
+
+    /* Drive the last lists past their grace period */
+    int total = BG_ROUNDS * BG_PER;
+    int spins = 0;
+    while (atomic_load(&free_count) < total - 2 * BG_PER) {
+        epoch_enter(&e, slot);
+        epoch_exit(&e, slot);
+        sched_yield();
+        assert(++spins < 100000);
+    }
+
+    uint64_t queued = atomic_load(&e.reclaimer.handed_off);
+    uint64_t fallbacks = atomic_load(&e.reclaimer.inline_fallbacks);
+    printf("  freed %d/%d, %lu lists queued, %lu inline fallbacks\n",
+           atomic_load(&free_count), total,
+           (unsigned long)queued, (unsigned long)fallbacks);
+    assert(queued > 0);
+    if (fallbacks == 0)
+        assert(atomic_load(&bg_inline_frees) == 0);
+
+    epoch_unregister(&e, slot);
+    epoch_destroy(&e);
+    assert(atomic_load(&free_count) == total);
+    printf("  PASSED\n\n");
+}
+
+/* reclaim_batch: each enter frees at most the batch, carrying the rest */
+#define BATCH_MAX     16
+#define BATCH_RETIRES 1000
+
+static void test_batched_reclaim(void)
+{
+    printf("=== test_batched_reclaim ===\n");
+
+    epoch_t e;
+    epoch_init(&e, test_free_fn);
+    epoch_set_reclaim_batch(&e, BATCH_MAX);
+    atomic_store(&free_count, 0);
+
+    int slot = epoch_register(&e);
+    epoch_enter(&e, slot);
+    for (int i = 0; i < BATCH_RETIRES; i++)
+        epoch_retire(&e, malloc(sizeof(int)));
+    epoch_exit(&e, slot);
+
+    int enters = 0, worst = 0;
+    while (atomic_load(&free_count) < BATCH_RETIRES) {
+        int before = atomic_load(&free_count);
+        epoch_enter(&e, slot);
+        epoch_exit(&e, slot);
+        int freed = atomic_load(&free_count) - before;
+        if (freed > worst) worst = freed;
+        assert(++enters < 2 * BATCH_RETIRES);
+    }
+
+    printf("  freed %d in %d enters, at most %d per enter\n",
+           atomic_load(&free_count), enters, worst);
+    assert(worst <= BATCH_MAX);
+
+    epoch_unregister(&e, slot);
+    epoch_destroy(&e);
+    printf("  PASSED\n\n");
+}
+
+/*
+ * Retire pressure: a reader parked in a critical section stalls the
+ * epoch; the ceiling callback must name its slot. Once it leaves, a
+ * thread that only retires (never enters) stays under its limit.
+ */
+#define PRESSURE_LIMIT   256
+#define PRESSURE_CEILING 1000
+#define PRESSURE_RETIRES 5000
+
+struct stall_report {
+    int    calls;
+    int    slot;
+    size_t pending;
+};
+
+static void stall_cb(void *arg, int slot, size_t pending)
+{
+    struct stall_report *r = arg;
+    r->calls++;
+    r->slot = slot;
+    r->pending = pending;
+}
+
+static void test_retire_pressure(void)
+{
+    printf("=== test_retire_pressure ===\n");
+
+    epoch_t e;
+    epoch_init(&e, test_free_fn);
+    struct stall_report report = { 0 };
+    epoch_set_pressure(&e, PRESSURE_LIMIT, PRESSURE_CEILING, stall_cb, &report);
+    atomic_store(&free_count, 0);
+
+    int reader = epoch_register(&e);
+    int writer = epoch_register(&e);
+    epoch_enter(&e, reader);
+
+    for (int i = 0; i < PRESSURE_RETIRES; i++) {
+        epoch_enter(&e, writer);
+        epoch_retire_slot(&e, writer, malloc(sizeof(int)));
+        epoch_exit(&e, writer);
+    }
+
+    printf("  stalled: %d report(s), slot %d, %zu pending\n",
+           report.calls, report.slot, report.pending);
+    assert(report.calls >= 1 && report.calls <= 2);
+    assert(report.slot == reader);
+    assert(report.pending >= PRESSURE_CEILING);
+    assert(epoch_stalled_slot(&e) == reader);
+
+    epoch_exit(&e, reader);
+
+    /*
+     * No enters from here on: only the limits drive reclamation. Each
+     * check advances once, so the stalled backlog clears within a few
+     * chunks; after that the backlog must stay near the limit.
+     */
+    size_t worst = 0;
+    for (int i = 0; i < PRESSURE_RETIRES; i++) {
+        epoch_retire_slot(&e, writer, malloc(sizeof(int)));
+        if (i >= 4 * EPOCH_PRESSURE_CHUNK && epoch_unreclaimed(&e) > worst)
+            worst = epoch_unreclaimed(&e);
+    }
+    printf("  unstalled: at most %zu unreclaimed, freed %d\n",
+           worst, atomic_load(&free_count));
+    assert(epoch_stalled_slot(&e) == -1);
+    assert(worst < PRESSURE_LIMIT + 4 * EPOCH_PRESSURE_CHUNK);
+    assert(report.calls <= 2);
+
+    epoch_unregister(&e, reader);
+    epoch_unregister(&e, writer);
+    epoch_destroy(&e);
+    assert(atomic_load(&free_count) == 2 * PRESSURE_RETIRES);
+    printf("  PASSED\n\n");
+}
+
+/*
+ * Asymmetric fences: readers dereference a shared block under a bare
+ * epoch_enter while a writer swaps and retires it. The free callback
+ * poisons blocks, so a reader that slipped past the advancer would see
+ * the poison (or trip ASan).
+ */
+#define ASYM_READERS 3
+#define ASYM_SWAPS   20000
+#define ASYM_MAGIC   0x5afe5afe
+#define ASYM_POISON  0xdeaddead
+
+struct asym_block { uint32_t magic; };
+
+static _Atomic(struct asym_block *) asym_shared;
+static _Atomic int asym_done;
+static _Atomic int asym_bad;
+
+static void asym_free_fn(void *ptr)
+{
+    ((struct asym_block *)ptr)->magic = ASYM_POISON;
+    test_free_fn(ptr);
+}
+
+static struct asym_block *asym_alloc(void)
+{
+    struct asym_block *b = malloc(sizeof(*b));
+    b->magic = ASYM_MAGIC;
+    return b;
+}
+
+static void *asym_reader(void *arg)
+{
+    epoch_t *e = arg;
+    int slot = epoch_register(e);
+    while (!atomic_load(&asym_done)) {
+        epoch_enter(e, slot);
+        struct asym_block *b = atomic_load_explicit(&asym_shared, memory_order_acquire);
+        if (b->magic != ASYM_MAGIC)
+            atomic_fetch_add(&asym_bad, 1);
+        epoch_exit(e, slot);
+    }
+    epoch_unregister(e, slot);
+    return NULL;
+}
+
+static void test_asymmetric_fences(void)
+{
+    printf("=== test_asymmetric_fences ===\n");
+
+    epoch_t e;
+    epoch_init(&e, asym_free_fn);
+    if (epoch_use_membarrier(&e) != 0) {
+        printf("  membarrier unavailable — SKIPPED\n\n");
+        return;
+    }
+    atomic_store(&free_count, 0);
+    atomic_store(&asym_done, 0);
+    atomic_store(&asym_bad, 0);
+    atomic_store(&asym_shared, asym_alloc());
+
+    pthread_t readers[ASYM_READERS];
+    for (int i = 0; i < ASYM_READERS; i++)
+        pthread_create(&readers[i], NULL, asym_reader, &e);
+
+    /*
+     * Only threads with garbage advance in this mode, and a reader
+     * preempted mid-section blocks that: yield now and then so readers
+     * re-announce even on a single CPU.
+     */
+    int slot = epoch_register(&e);
+    for (int i = 0; i < ASYM_SWAPS; i++) {
+        if (i % 256 == 0)
+            sched_yield();
+        epoch_enter(&e, slot);
+        struct asym_block *old = atomic_exchange(&asym_shared, asym_alloc());
+        epoch_retire(&e, old);
+        epoch_exit(&e, slot);
+    }
+    atomic_store(&asym_done, 1);
+    for (int i = 0; i < ASYM_READERS; i++)
+        pthread_join(readers[i], NULL);
+
+    printf("  %d swaps, %d freed during run, %d poisoned reads\n",
+           ASYM_SWAPS, atomic_load(&free_count), atomic_load(&asym_bad));
+    assert(atomic_load(&asym_bad) == 0);
+    assert(atomic_load(&free_count) > 0);
+
+    epoch_unregister(&e, slot);
+    epoch_destroy(&e);
+    free(atomic_load(&asym_shared));
+    printf("  PASSED\n\n");
+}
+
+/*
+ * QSBR: readers dereference the shared block with no enter/exit at all
+ * and report a quiescent state every QSBR_READS reads. A third thread
+ * registers and goes offline; it must not hold back reclamation.
+ */
+#define QSBR_READS 64
+
+static _Atomic int qsbr_ready;
+
+static void *qsbr_reader(void *arg)
+{
+    epoch_t *e = arg;
+    int slot = epoch_register(e);
+    for (unsigned n = 0; !atomic_load(&asym_done); n++) {
+        struct asym_block *b = atomic_load_explicit(&asym_shared, memory_order_acquire);
+        if (b->magic != ASYM_MAGIC)
+            atomic_fetch_add(&asym_bad, 1);
+        if (n % QSBR_READS == 0)
+            epoch_quiescent(e, slot);
+    }
+    epoch_unregister(e, slot);
+    return NULL;
+}
+
+static void *qsbr_idler(void *arg)
+{
+    epoch_t *e = arg;
+    int slot = epoch_register(e);
+    epoch_offline(e, slot);
+    atomic_store(&qsbr_ready, 1);
+    while (!atomic_load(&asym_done))
+        sched_yield();
+    epoch_unregister(e, slot);
+    return NULL;
+}
+
+static void test_qsbr(void)
+{
+    printf("=== test_qsbr ===\n");
+
+    epoch_t e;
+    epoch_init(&e, asym_free_fn);
+    epoch_use_qsbr(&e);
+    atomic_store(&free_count, 0);
+    atomic_store(&asym_done, 0);
+    atomic_store(&asym_bad, 0);
+    atomic_store(&qsbr_ready, 0);
+    atomic_store(&asym_shared, asym_alloc());
+
+    pthread_t idler, readers[ASYM_READERS];
+    pthread_create(&idler, NULL, qsbr_idler, &e);
+    while (!atomic_load(&qsbr_ready))
+        sched_yield();
+    for (int i = 0; i < ASYM_READERS; i++)
+        pthread_create(&readers[i], NULL, qsbr_reader, &e);
+
+    int slot = epoch_register(&e);
+    for (int i = 0; i < ASYM_SWAPS; i++) {
+        if (i % 256 == 0)
+            sched_yield();
+        struct asym_block *old = atomic_exchange(&asym_shared, asym_alloc());
+        epoch_retire(&e, old);
+        epoch_quiescent(&e, slot);
+    }
+
+    /* An open section pins the thread across its quiescent reports */
+    epoch_enter(&e, slot);
+    uint64_t pinned = atomic_load(&e.threads[slot].epoch);
+    for (int i = 0; i < 8; i++) {
+        epoch_quiescent(&e, slot);
+        epoch_try_advance(&e);
+    }
+    assert(atomic_load(&e.threads[slot].epoch) == pinned);
+    assert(atomic_load(&e.global_epoch) <= pinned + 1);
+    epoch_exit(&e, slot);
+
+    atomic_store(&asym_done, 1);
+    for (int i = 0; i < ASYM_READERS; i++)
+        pthread_join(readers[i], NULL);
+    pthread_join(idler, NULL);
+
+    printf("  %d swaps, %d freed during run, %d poisoned reads\n",
+           ASYM_SWAPS, atomic_load(&free_count), atomic_load(&asym_bad));
+    assert(atomic_load(&asym_bad) == 0);
+    assert(atomic_load(&free_count) > ASYM_SWAPS / 2);
+
+    epoch_unregister(&e, slot);
+    epoch_destroy(&e);
+    assert(atomic_load(&free_count) == ASYM_SWAPS);
+    free(atomic_load(&asym_shared));
+    printf("  PASSED\n\n");
+}
+
+/*
+ * Per-object destructors: three kinds of object, each counted by its
+ * own destructor, retired interleaved and reclaimed through a thread's
+ * own lists, the batched pending list and the orphan stack.
+ */
+#define FN_OBJECTS 3000
+
+static _Atomic int fn_a_count, fn_b_count;
+
+static void fn_a(void *ptr)
+{
+    assert(*(int *)ptr == 'a');
+    atomic_fetch_add(&fn_a_count, 1);
+    free(ptr);
+}
+
+static void fn_b(void *ptr)
+{
+    assert(*(int *)ptr == 'b');
+    atomic_fetch_add(&fn_b_count, 1);
+    free(ptr);
+}
+
+static void retire_kind(epoch_t *e, int slot, int i)
+{
+    int *obj = malloc(sizeof(*obj));
+    switch (i % 3) {
+    case 0:  *obj = 'a'; epoch_retire_fn(e, slot, obj, fn_a); break;
+    case 1:  *obj = 'b'; epoch_retire_fn(e, slot, obj, fn_b); break;
+    default: *obj = 'd'; epoch_retire_slot(e, slot, obj);     break;
+    }
+}
+
+static void test_retire_fn(void)
+{
+    printf("=== test_retire_fn ===\n");
+
+    epoch_t e;
+    epoch_init(&e, test_free_fn);
+    epoch_set_reclaim_batch(&e, 32);
+    atomic_store(&free_count, 0);
+    atomic_store(&fn_a_count, 0);
+    atomic_store(&fn_b_count, 0);
+
+    /* Own lists + pending: retire, then enter until drained */
+    int slot = epoch_register(&e);
+    for (int i = 0; i < FN_OBJECTS; i++) {
+        epoch_enter(&e, slot);
+        retire_kind(&e, slot, i);
+        epoch_exit(&e, slot);
+    }
+    for (int i = 0; i < FN_OBJECTS; i++) {
+        epoch_enter(&e, slot);
+        epoch_exit(&e, slot);
+    }
+    printf("  own lists: a=%d b=%d default=%d\n", atomic_load(&fn_a_count),
+           atomic_load(&fn_b_count), atomic_load(&free_count));
+    assert(atomic_load(&fn_a_count) == FN_OBJECTS / 3);
+    assert(atomic_load(&fn_b_count) == FN_OBJECTS / 3);
+    assert(atomic_load(&free_count) == FN_OBJECTS / 3);
+
+    /* Orphans: a second slot retires and leaves; the first reclaims */
+    int other = epoch_register(&e);
+    for (int i = 0; i < FN_OBJECTS; i++)
+        retire_kind(&e, other, i);
+    epoch_unregister(&e, other);
+    for (int i = 0; i < FN_OBJECTS; i++) {
+        epoch_enter(&e, slot);
+        epoch_exit(&e, slot);
+    }
+    printf("  + orphans: a=%d b=%d default=%d\n", atomic_load(&fn_a_count),
+           atomic_load(&fn_b_count), atomic_load(&free_count));
+    assert(atomic_load(&fn_a_count) == 2 * FN_OBJECTS / 3);
+    assert(atomic_load(&fn_b_count) == 2 * FN_OBJECTS / 3);
+    assert(atomic_load(&free_count) == 2 * FN_OBJECTS / 3);
+
+    /* Whatever is left runs its own destructor at destroy */
+    for (int i = 0; i < 30; i++)
+        retire_kind(&e, slot, i);
+    epoch_unregister(&e, slot);
+    epoch_destroy(&e);
+    assert(atomic_load(&fn_a_count) == 2 * FN_OBJECTS / 3 + 10);
+    assert(atomic_load(&fn_b_count) == 2 * FN_OBJECTS / 3 + 10);
+    assert(atomic_load(&free_count) == 2 * FN_OBJECTS / 3 + 10);
+    printf("  PASSED\n\n");
+}
+
 int main(void)
 {
     printf("Epoch-Based Reclamation Test Suite\n");
@@ -136,6 +687,13 @@ int main(void)
 
     test_basic();
     test_multithreaded_epoch();
+    test_bursty_reclaim();
+    test_background_reclaim();
+    test_batched_reclaim();
+    test_retire_pressure();
+    test_asymmetric_fences();
+    test_qsbr();
+    test_retire_fn();
 
     printf("All epoch tests passed.\n");
     return 0;
@@ -17,12 +17,20 @@
 
 #define _GNU_SOURCE
 #include "hashmap.h"
+#include "probes.h"
+#include "persist.h"
+#include "wal.h"
+#include "numa.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /* Thread-local epoch slot (set via hashmap_thread_register) */
 static __thread int tls_epoch_slot = -1;
@@ -97,28 +105,543 @@ static inline uint64_t make_so_dummy(size_t bucket)
     return reverse_bits((uint64_t)bucket);
 }
 
+/* ──────────────────────────────────────────────────────────────────
+ * Node pool
+ *
+ * In node_pool mode, a reclaimed node goes to node_recycle, which
+ * pushes it onto the reclaiming thread's pool instead of calling
+ * free(); node_alloc in a node_pool map pops from it first. Threads
+ * with no slot (e.g. the background reclaimer) free as usual. Bucket
+ * arrays and version records are never pooled. Pooled nodes belong to
+ * the thread and are not counted by hashmap_memory_usage.
+ * ────────────────────────────────────────────────────────────────── */
+
+#define NODE_POOL_MAX 1024
+
+static __thread struct hm_node *tls_node_pool;   /* Linked through next */
+static __thread uint32_t        tls_node_pool_len;
+
+static void node_pool_drain(void)
+{
+    while (tls_node_pool) {
+        struct hm_node *n = tls_node_pool;
+        tls_node_pool = (struct hm_node *)atomic_load_explicit(&n->next,
+                                                               memory_order_relaxed);
+        free(n);
+    }
+    tls_node_pool_len = 0;
+}
+
+static void node_recycle(void *ptr)
+{
+    struct hm_node *n = ptr;
+    if (tls_epoch_slot < 0 || tls_node_pool_len >= NODE_POOL_MAX) {
+        free(n);
+        return;
+    }
+    atomic_store_explicit(&n->next, (uintptr_t)tls_node_pool, memory_order_relaxed);
+    tls_node_pool = n;
+    tls_node_pool_len++;
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * NUMA placement and hugepages
+ *
+ * With a policy set, node memory comes from the map's arena (numa.h)
+ * instead of malloc, on the node numa_place picks: the inserting
+ * thread's under LOCAL, the so_key's range under BUCKET (the top of
+ * split-order space divided evenly, so each node holds one contiguous
+ * run of the list and a lookup never changes node), and page-
+ * interleaved under INTERLEAVE. Bucket arrays are shared by every
+ * thread and indexed by hash, so under INTERLEAVE and BUCKET the large
+ * ones are mapped and interleaved; LOCAL leaves them to first touch.
+ * With hugepages, the arena's chunks are 2 MB pages, and arrays from
+ * HUGE_BUCKETS_MIN up are mapped on them too: below that, most of the
+ * page would be waste.
+ * ────────────────────────────────────────────────────────────────── */
+
+#define NUMA_BUCKETS_MIN (64 * 1024)   /* Smaller arrays stay on the heap */
+#define HUGE_BUCKETS_MIN (1 << 20)
+
+static int numa_place(const hashmap_t *map, uint64_t so_key)
+{
+    switch (map->numa) {
+    case HASHMAP_NUMA_LOCAL:
+        return numa_current_node();
+    case HASHMAP_NUMA_BUCKET:
+        return (int)(((so_key >> 32) * (uint64_t)map->numa_nodes) >> 32);
+    default:
+        return 0;
+    }
+}
+
+static struct hm_node *node_mem_alloc(hashmap_t *map, uint64_t so_key)
+{
+    if (map->arena)
+        return numa_alloc(map->arena, tls_epoch_slot, numa_place(map, so_key));
+    return calloc(1, sizeof(struct hm_node));
+}
+
+static void node_mem_free(hashmap_t *map, struct hm_node *n)
+{
+    if (map->arena)
+        numa_free(map->arena, tls_epoch_slot, n);
+    else
+        free(n);
+}
+
+static enum numa_pages map_pages(const hashmap_t *map)
+{
+    switch (map->hugepages) {
+    case HASHMAP_HUGEPAGES_TRANSPARENT: return NUMA_PAGES_THP;
+    case HASHMAP_HUGEPAGES_EXPLICIT:    return NUMA_PAGES_HUGETLB;
+    default:                            return NUMA_PAGES_SMALL;
+    }
+}
+
+static bool buckets_interleaved(const hashmap_t *map)
+{
+    return map->numa == HASHMAP_NUMA_INTERLEAVE || map->numa == HASHMAP_NUMA_BUCKET;
+}
+
+static bool buckets_mapped(const hashmap_t *map, size_t cap)
+{
+    size_t bytes = cap * sizeof(struct hm_node *);
+    if (map->hugepages != HASHMAP_HUGEPAGES_OFF)
+        return bytes >= HUGE_BUCKETS_MIN;
+    return buckets_interleaved(map) && bytes >= NUMA_BUCKETS_MIN;
+}
+
+static struct hm_node **buckets_alloc(hashmap_t *map, size_t cap)
+{
+    if (!buckets_mapped(map, cap))
+        return calloc(cap, sizeof(struct hm_node *));
+    return numa_map(cap * sizeof(struct hm_node *), buckets_interleaved(map),
+                    map_pages(map));
+}
+
+static void buckets_free(hashmap_t *map, struct hm_node **b, size_t cap)
+{
+    if (buckets_mapped(map, cap))
+        numa_unmap(b, cap * sizeof(struct hm_node *), map_pages(map));
+    else
+        free(b);
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Statistics (HASHMAP_STATS builds)
+ *
+ * One cache line of counters per epoch slot, written only by the slot's
+ * owner with relaxed load + store (no RMW), and read by hashmap_stats.
+ * Threads without a slot share the last entry through fetch_add.
+ * Without HASHMAP_STATS, STAT_ADD compiles to nothing.
+ * ────────────────────────────────────────────────────────────────── */
+
+struct hm_thread_stats {
+    _Alignas(64)
+    _Atomic uint64_t finds;
+    _Atomic uint64_t find_steps;
+    _Atomic uint64_t find_restarts;
+    _Atomic uint64_t unlink_cas_fails;
+    _Atomic uint64_t insert_cas_fails;
+    _Atomic uint64_t mark_cas_fails;
+    _Atomic uint64_t value_cas_fails;
+    _Atomic uint64_t bucket_inits;
+    _Atomic uint64_t resizes;
+    _Atomic uint64_t retired;
+    _Atomic uint64_t max_retire_depth;
+};
+
+#define STATS_SLOTS (EPOCH_MAX_THREADS + 1)
+
+#ifdef HASHMAP_STATS
+static inline void stat_add(_Atomic uint64_t *c, uint64_t n, bool owned)
+{
+    if (owned)
+        atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n,
+                              memory_order_relaxed);
+    else
+        atomic_fetch_add_explicit(c, n, memory_order_relaxed);
+}
+
+#define STAT_ADD(map, field, n) do {                                       \
+        int s_ = tls_epoch_slot;                                            \
+        stat_add(&(map)->stats[s_ >= 0 ? s_ : EPOCH_MAX_THREADS].field,     \
+                 (n), s_ >= 0);                                             \
+    } while (0)
+#else
+#define STAT_ADD(map, field, n) ((void)(map), (void)(n))
+#endif
+
+#define STAT_INC(map, field) STAT_ADD(map, field, 1)
+
+/* ──────────────────────────────────────────────────────────────────
+ * Memory accounting
+ *
+ * Byte counts per category, kept like the statistics counters (one
+ * cache line per slot, owner-written, a shared fetch_add entry for
+ * threads without a slot) but always on. Allocations add on the
+ * allocating thread and frees subtract on the freeing one, so a slot's
+ * count may go negative; only the sum means anything. Destructors run
+ * by the reclamation backend get no map argument and find it through
+ * epoch_reclaiming() / hazard_reclaiming().
+ * ────────────────────────────────────────────────────────────────── */
+
+enum hm_mem_kind {
+    MEM_NODES,             /* Regular nodes not yet retired          */
+    MEM_SENTINELS,         /* Bucket sentinels                       */
+    MEM_VERSIONS,          /* MVCC records not yet retired           */
+    MEM_RETIRED,           /* Retired nodes and records, not freed   */
+    MEM_RETIRED_BUCKETS,   /* Replaced bucket arrays, not freed      */
+    MEM_KINDS
+};
+
+struct hm_thread_mem {
+    _Alignas(64)
+    _Atomic int64_t bytes[MEM_KINDS];
+};
+
+#define MEM_SLOTS (EPOCH_MAX_THREADS + 1)
+
+static void mem_add(hashmap_t *map, enum hm_mem_kind kind, int64_t n)
+{
+    int s = tls_epoch_slot;
+    if (s >= 0) {
+        _Atomic int64_t *c = &map->mem[s].bytes[kind];
+        atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n,
+                              memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(&map->mem[EPOCH_MAX_THREADS].bytes[kind], n,
+                                  memory_order_relaxed);
+    }
+}
+
+/* Move `n` bytes from a live category to MEM_RETIRED */
+static inline void mem_retire(hashmap_t *map, enum hm_mem_kind from, int64_t n)
+{
+    mem_add(map, from, -n);
+    mem_add(map, MEM_RETIRED, n);
+}
+
+/* Map whose reclamation backend is running the current destructor */
+static hashmap_t *reclaiming_map(void)
+{
+    epoch_t *e = epoch_reclaiming();
+    if (e)
+        return (hashmap_t *)((char *)e - offsetof(hashmap_t, epoch));
+    hazard_domain_t *d = hazard_reclaiming();
+    return (hashmap_t *)((char *)d - offsetof(hashmap_t, hazard));
+}
+
+/* Destructor of retired nodes: pooled or freed */
+static void node_reclaim(void *ptr)
+{
+    hashmap_t *map = reclaiming_map();
+    mem_add(map, MEM_RETIRED, -(int64_t)sizeof(struct hm_node));
+    if (map->arena)
+        node_mem_free(map, ptr);
+    else if (map->node_pool)
+        node_recycle(ptr);
+    else
+        free(ptr);
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Latency sampling
+ *
+ * With sampling on, every 2^k-th operation of a thread (a thread-local
+ * tick shared by all maps) takes three cycle-counter reads: before and
+ * after map_enter, and at the end. Histograms live per slot, allocated
+ * by the slot's owner on its first sample and written only by it.
+ * Otherwise an operation pays one load and branch on map->lat.
+ * ────────────────────────────────────────────────────────────────── */
+
+struct hm_lat_slot {
+    lat_hist_t hist[HASHMAP_LAT_OPS][HASHMAP_LAT_PHASES];
+};
+
+static __thread uint32_t tls_sample_tick;
+
+struct lat_probe {
+    bool     on;
+    uint64_t start;     /* before map_enter */
+    uint64_t entered;   /* after map_enter  */
+};
+
+static inline void lat_start(hashmap_t *map, int slot, struct lat_probe *p)
+{
+    p->on = map->lat && slot >= 0 &&
+            (++tls_sample_tick & map->sample_mask) == 0;
+    if (p->on)
+        p->start = lat_now();
+}
+
+static inline void lat_entered(struct lat_probe *p)
+{
+    if (p->on)
+        p->entered = lat_now();
+}
+
+static void lat_record_op(hashmap_t *map, int slot, const struct lat_probe *p,
+                          enum hashmap_lat_op op)
+{
+    uint64_t end = lat_now_end();
+    struct hm_lat_slot *ls = atomic_load_explicit(&map->lat[slot], memory_order_acquire);
+    if (!ls) {
+        ls = calloc(1, sizeof(*ls));
+        if (!ls) return;  /* drop the sample */
+        atomic_store_explicit(&map->lat[slot], ls, memory_order_release);
+    }
+    lat_record(&ls->hist[op][HASHMAP_LAT_TOTAL], end - p->start);
+    lat_record(&ls->hist[op][HASHMAP_LAT_ENTER], p->entered - p->start);
+}
+
+static inline void lat_finish(hashmap_t *map, int slot, const struct lat_probe *p,
+                              enum hashmap_lat_op op)
+{
+    if (p->on)
+        lat_record_op(map, slot, p, op);
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Reclamation backend
+ *
+ * EBR: an operation is one epoch critical section, or under QSBR lies
+ * between two of the thread's quiescent reports. Hazard pointers:
+ * list_find publishes each node before dereferencing it, rotating two
+ * hazards hand over hand (HP_CURR0/1) plus one for the node a search
+ * resumes from (HP_START); exiting the operation clears them. Bucket
+ * sentinels are never freed and need no hazard.
+ * ────────────────────────────────────────────────────────────────── */
+
+#define HP_CURR0 0
+#define HP_START 2
+
+static inline void map_enter(hashmap_t *map, int slot)
+{
+    if (slot >= 0 && !map->hazard_mode && !map->qsbr)
+        epoch_enter(&map->epoch, slot);
+}
+
+static inline void map_exit(hashmap_t *map, int slot)
+{
+    if (slot < 0) return;
+    if (map->hazard_mode)
+        hazard_clear(&map->hazard, slot);
+    else if (!map->qsbr)
+        epoch_exit(&map->epoch, slot);
+}
+
+/* Retire an unlinked node through the map's backend */
+static void node_retire(hashmap_t *map, struct hm_node *node)
+{
+    mem_retire(map, MEM_NODES, sizeof(struct hm_node));
+    if (map->hazard_mode)
+        hazard_retire_fn(&map->hazard, tls_epoch_slot, node, node_reclaim);
+    else
+        epoch_retire_fn(&map->epoch, tls_epoch_slot, node, node_reclaim);
+
+#ifdef HASHMAP_STATS
+    STAT_INC(map, retired);
+    int slot = tls_epoch_slot;
+    if (slot >= 0) {
+        uint64_t depth = map->hazard_mode ? map->hazard.threads[slot].retired_count
+                                          : epoch_backlog(&map->epoch, slot);
+        _Atomic uint64_t *max = &map->stats[slot].max_retire_depth;
+        if (depth > atomic_load_explicit(max, memory_order_relaxed))
+            atomic_store_explicit(max, depth, memory_order_relaxed);
+    }
+#endif
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Write-ahead log ordering
+ *
+ * Replay applies each key's record with the highest sequence number, so
+ * a key's numbers must rise in the order its updates took effect. The
+ * CAS that applies an update writes its number too, so no lock is
+ * taken: in snapshot mode the number rides in the version record, and
+ * in the default mode node->seq sits beside node->value and the pair
+ * is swapped as one 16-byte word. The number changes with every swap,
+ * so a value that comes back (A-B-A) cannot satisfy a stale CAS.
+ *
+ * A record replacing another takes that one's number + 1. A node's
+ * first record takes the clock of its key's stripe + 1; whoever marks
+ * a dead node (default mode) or collects it (snapshot mode) raises
+ * that clock to the node's last number first, so the next incarnation
+ * of the key numbers after the last. Clocks start at the log's highest
+ * number and only deletions write them.
+ * ────────────────────────────────────────────────────────────────── */
+
+#define LOG_CLOCKS 1024     /* Stripes of key hashes (power of 2) */
+
+struct log_clock {
+    _Alignas(64) _Atomic(uint64_t) seq;
+};
+
+struct hm_wal {
+    struct log_clock clocks[LOG_CLOCKS];
+    wal_t           *log;
+    hashmap_codec_t  codec;
+    bool             coded;        /* Values logged through codec */
+    uint64_t         base;         /* Highest number in the log at open */
+};
+
+static inline _Atomic(uint64_t) *log_clock(hashmap_t *map, uint64_t key)
+{
+    return &map->wal->clocks[hash_key(key) & (LOG_CLOCKS - 1)].seq;
+}
+
+/* Number of a record replacing one numbered `prev` */
+static inline uint64_t log_seq_after(hashmap_t *map, uint64_t prev)
+{
+    return (prev > map->wal->base ? prev : map->wal->base) + 1;
+}
+
+/* Number of a node's first record; read after the key was found absent */
+static inline uint64_t log_seq_first(hashmap_t *map, uint64_t key)
+{
+    return atomic_load(log_clock(map, key)) + 1;
+}
+
+/* Before a node with last number `seq` is collected */
+static inline void log_clock_raise(hashmap_t *map, uint64_t key, uint64_t seq)
+{
+    _Atomic(uint64_t) *c = log_clock(map, key);
+    uint64_t cur = atomic_load(c);
+    while (cur < seq && !atomic_compare_exchange_weak(c, &cur, seq))
+        ;
+}
+
+#if defined(__SIZEOF_INT128__) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+#define LOG_PAIR_CAS 1
+
+/* node->value and node->seq as one word */
+typedef unsigned __int128 log_word __attribute__((may_alias));
+typedef union {
+    struct { void *value; uint64_t seq; } f;
+    log_word w;
+} log_pair;
+
+/* Swap node->value from `value` to `desired` iff node->seq is `seq` */
+static inline bool log_pair_cas(struct hm_node *node, void *value,
+                                uint64_t seq, void *desired, uint64_t next)
+{
+    log_pair old = { .f = { value, seq } }, new = { .f = { desired, next } };
+    return __sync_bool_compare_and_swap((log_word *)&node->value,
+                                        old.w, new.w);
+}
+#else
+#define LOG_PAIR_CAS 0      /* Logs need snapshot mode */
+#endif
+
+static bool log_record(hashmap_t *map, int slot, uint64_t key, uint64_t seq,
+                       void *value);
+static uint64_t log_number(hashmap_t *map, struct hm_node *node);
+
+/* ──────────────────────────────────────────────────────────────────
+ * Dirty ranges
+ *
+ * For incremental checkpoints, the top dirty_bits of a split-ordered
+ * key name its range, so each range is one contiguous run of the list
+ * starting at a bucket sentinel. An update sets its range's bit after
+ * the CAS that applied it. The checkpoint writer clears the bit before
+ * walking the range; both sides put a full fence between their write
+ * and their read, so either the writer sees the update or the updater
+ * sees the bit cleared and sets it again. The bit is tested first, so
+ * updates of an already-dirty range share its cache line read-only.
+ * ────────────────────────────────────────────────────────────────── */
+
+#define CKPT_RANGE_BITS_MAX  24
+
+static inline size_t dirty_range(uint32_t bits, uint64_t so_key)
+{
+    return bits ? (size_t)(so_key >> (64 - bits)) : 0;
+}
+
+static inline void dirty_mark(hashmap_t *map, uint64_t so_key)
+{
+    size_t r = dirty_range(map->dirty_bits, so_key);
+    _Atomic(uint64_t) *w = &map->dirty[r / 64];
+    uint64_t bit = (uint64_t)1 << (r % 64);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!(atomic_load_explicit(w, memory_order_relaxed) & bit))
+        atomic_fetch_or_explicit(w, bit, memory_order_relaxed);
+}
+
 /* ──────────────────────────────────────────────────────────────────
  * Lock-free list operations (Harris, 2001)
+ *
+ * The list is ordered by (so_key, key). Regular nodes have odd so_keys
+ * and non-zero keys, sentinels even so_keys and key 0, so a search is
+ * exact even when two keys share a split-ordered key.
  * ────────────────────────────────────────────────────────────────── */
 
+static inline bool node_before(const struct hm_node *n,
+                               uint64_t so_key, uint64_t key)
+{
+    return n->so_key < so_key || (n->so_key == so_key && n->key < key);
+}
+
 /*
- * find — Search for the position of `so_key` in the sorted list.
+ * find — Search for the position of (so_key, key) in the sorted list.
  *
- * Returns true if a node with this so_key exists (and sets *out_curr).
- * Sets *out_prev to the predecessor's `next` field (for CAS insertion).
+ * Starts after `start` (NULL = `head`); `head` must be a bucket sentinel,
+ * which is never deleted. Returns true if the node exists. Sets *out_pred
+ * to the last node ordered before it (the CAS point for an insert) and
+ * *out_curr to the first node not ordered before it.
  *
- * Also physically removes any marked (logically deleted) nodes encountered.
+ * Also physically removes (and retires) any marked nodes encountered.
+ * A failed unlink CAS resumes from the current predecessor while it is
+ * still unmarked — the failed CAS hands back its fresh successor — and
+ * only a deleted predecessor sends the search back, to the nearest
+ * sentinel passed so far.
+ *
+ * In hazard mode `start` must be protected by the caller (it is the
+ * pred of an earlier search), and on return *out_pred and *out_curr
+ * are protected until map_exit.
  */
-static bool list_find(epoch_t *epoch, struct hm_node *head, uint64_t so_key,
-                      _Atomic(uintptr_t) **out_prev, struct hm_node **out_curr)
+static bool list_find(hashmap_t *map, struct hm_node *head,
+                      struct hm_node *start, uint64_t so_key, uint64_t key,
+                      struct hm_node **out_pred, struct hm_node **out_curr)
 {
+    int hp = map->hazard_mode ? tls_epoch_slot : -1;
+    if (!start) start = head;
+    struct hm_node *anchor = head;  /* last sentinel passed: never deleted */
+    uint64_t steps = 0;
+    STAT_INC(map, finds);
 retry:
     ;
-    _Atomic(uintptr_t) *prev = &head->next;
-    uintptr_t cur_tagged = atomic_load_explicit(prev, memory_order_acquire);
+    /* A marked start may already be unlinked — fall back to a sentinel */
+    if (start != anchor &&
+        is_marked(atomic_load_explicit(&start->next, memory_order_acquire)))
+        start = anchor;
+
+    struct hm_node *pred = start;
+    int ci = HP_CURR0;  /* hazard holding curr; pred holds the other */
+    if (hp >= 0)
+        hazard_protect(&map->hazard, hp, HP_START, start);
+    uintptr_t cur_tagged = atomic_load_explicit(&pred->next, memory_order_acquire);
     struct hm_node *curr = get_ptr(cur_tagged);
 
     while (curr) {
+        if (hp >= 0) {
+            /* Publish, then check curr is still linked from live pred */
+            hazard_protect(&map->hazard, hp, ci, curr);
+            uintptr_t again = atomic_load(&pred->next);
+            if (again != make_tagged(curr, false)) {
+                if (is_marked(again)) {
+                    STAT_INC(map, find_restarts);
+                    PROBE2(hashmap, find_restart, map, key);
+                    start = anchor;
+                    goto retry;
+                }
+                curr = get_ptr(again);
+                continue;
+            }
+        }
+        steps++;
+
         uintptr_t next_tagged = atomic_load_explicit(&curr->next, memory_order_acquire);
         struct hm_node *next = get_ptr(next_tagged);
 
@@ -126,134 +649,153 @@ retry:
             /* curr is logically deleted — try to physically unlink */
             uintptr_t expected = make_tagged(curr, false);
             if (!atomic_compare_exchange_strong_explicit(
-                    prev, &expected, make_tagged(next, false),
+                    &pred->next, &expected, make_tagged(next, false),
                     memory_order_acq_rel, memory_order_acquire)) {
-                goto retry;  /* lost race, restart traversal */
+                STAT_INC(map, unlink_cas_fails);
+                PROBE2(hashmap, unlink_retry, map, curr->key);
+                if (is_marked(expected)) {
+                    STAT_INC(map, find_restarts);
+                    PROBE2(hashmap, find_restart, map, key);
+                    start = anchor;
+                    goto retry;  /* pred deleted under us */
+                }
+                curr = get_ptr(expected);  /* pred live: resume locally */
+                continue;
             }
-            /* Successfully unlinked — retire via EBR */
-            if (epoch)
-                epoch_retire(epoch, curr);
+            /* Successfully unlinked — retire it */
+            node_retire(map, curr);
             curr = next;
             continue;
         }
 
-        if (curr->so_key >= so_key) {
-            *out_prev = prev;
+        if (!node_before(curr, so_key, key)) {
+            STAT_ADD(map, find_steps, steps);
+            *out_pred = pred;
             *out_curr = curr;
-            return (curr->so_key == so_key);
+            return curr->so_key == so_key && curr->key == key;
         }
 
-        prev = &curr->next;
+        if (curr->is_dummy)
+            anchor = curr;
+        pred = curr;
+        ci ^= 1;  /* pred keeps curr's hazard */
         curr = next;
     }
 
-    *out_prev = prev;
+    STAT_ADD(map, find_steps, steps);
+    *out_pred = pred;
     *out_curr = NULL;
     return false;
 }
 
-static struct hm_node *node_alloc(uint64_t key, uint64_t so_key,
-                                   void *value, bool is_dummy)
+static struct hm_node *node_alloc(hashmap_t *map, uint64_t key, uint64_t so_key,
+                                  void *value, bool is_dummy)
 {
-    struct hm_node *n = calloc(1, sizeof(struct hm_node));
-    if (!n) return NULL;
+    /* Only pooled maps draw on the thread's pool, as only they feed it */
+    struct hm_node *n = map->node_pool && !map->arena ? tls_node_pool : NULL;
+    if (n) {
+        tls_node_pool = (struct hm_node *)atomic_load_explicit(&n->next,
+                                                               memory_order_relaxed);
+        tls_node_pool_len--;
+        memset(n, 0, sizeof(*n));
+    } else {
+        n = node_mem_alloc(map, so_key);
+        if (!n) return NULL;
+    }
     n->key = key;
     n->so_key = so_key;
     atomic_store_explicit(&n->value, value, memory_order_relaxed);
     atomic_store_explicit(&n->next, 0, memory_order_relaxed);
     n->is_dummy = is_dummy;
+    mem_add(map, is_dummy ? MEM_SENTINELS : MEM_NODES, sizeof(*n));
     return n;
 }
 
 /*
- * list_insert — Insert a node into the sorted list.
+ * list_insert — Link new_node at the position list_find returned.
+ *
+ * *pred / *curr come from a list_find that did not find the key. When
+ * the CAS loses a race, the search resumes from *pred (or `head` if pred
+ * has since been deleted) instead of re-walking the bucket.
  *
- * If a node with the same so_key already exists:
- *   - For dummy nodes: return the existing node (idempotent)
- *   - For regular nodes: CAS-update the value
+ * If the key turns up in the meantime:
+ *   - For dummy nodes: free new_node, return the existing node (idempotent)
+ *   - For regular nodes: return the existing node and leave new_node to
+ *     the caller, which applies the update itself
  *
- * Returns the node (either new or existing).
+ * Returns the node (either new or existing), with *pred / *curr updated
+ * to its predecessor and itself. For a regular node, *seq receives the
+ * log sequence number of its first record (0 without a log).
  */
-static struct hm_node *list_insert(struct hm_node *head, struct hm_node *new_node)
+static struct hm_node *list_insert(hashmap_t *map, struct hm_node *head,
+                                   struct hm_node *new_node,
+                                   struct hm_node **pred, struct hm_node **curr,
+                                   uint64_t *seq)
 {
     while (1) {
-        _Atomic(uintptr_t) *prev;
-        struct hm_node *curr;
-
-        if (list_find(NULL, head, new_node->so_key, &prev, &curr)) {
-            /* Node with this so_key already exists */
-            if (new_node->is_dummy) {
-                free(new_node);
-                return curr;  /* reuse existing dummy */
-            }
-            /* Check for exact key match (not just so_key) */
-            if (!curr->is_dummy && curr->key == new_node->key) {
-                /* Same key: update value */
-                atomic_store_explicit(&curr->value,
-                    atomic_load_explicit(&new_node->value, memory_order_relaxed),
-                    memory_order_release);
-                free(new_node);
-                return curr;
-            }
-            /* so_key collision with different original key — need to insert
-             * after curr. Adjust so_key slightly to maintain uniqueness.
-             * Actually, different keys can have same so_key. We insert anyway
-             * and the list will have adjacent nodes with same so_key but
-             * different keys. find() must scan past same-so_key nodes. */
-        }
-
-        /* Insert new_node between prev and curr */
-        atomic_store_explicit(&new_node->next, make_tagged(curr, false),
+        /* Insert new_node between pred and curr */
+        atomic_store_explicit(&new_node->next, make_tagged(*curr, false),
                               memory_order_relaxed);
-        uintptr_t expected = make_tagged(curr, false);
+        uintptr_t expected = make_tagged(*curr, false);
+        /* Once linked, the node's record is anyone's to replace */
+        uint64_t s = seq && map->wal ? log_number(map, new_node) : 0;
         if (atomic_compare_exchange_strong_explicit(
-                prev, &expected, make_tagged(new_node, false),
+                &(*pred)->next, &expected, make_tagged(new_node, false),
                 memory_order_acq_rel, memory_order_acquire)) {
+            if (seq) *seq = s;
+            *curr = new_node;
             return new_node;  /* success */
         }
-        /* CAS failed — retry from the top */
+
+        /* CAS failed — resume the search from the predecessor */
+        STAT_INC(map, insert_cas_fails);
+        PROBE2(hashmap, insert_retry, map, new_node->key);
+        if (list_find(map, head, *pred, new_node->so_key, new_node->key,
+                      pred, curr)) {
+            if (new_node->is_dummy) {
+                mem_add(map, MEM_SENTINELS, -(int64_t)sizeof(*new_node));
+                node_mem_free(map, new_node);
+            }
+            return *curr;  /* same key: existing node wins */
+        }
+    }
+}
+
+/* Set the Harris mark on node->next (idempotent) */
+static void node_mark(hashmap_t *map, struct hm_node *node)
+{
+    /* A dead node's seq is final; number the key's next node after it */
+    if (map->wal && !map->snapshots)
+        log_clock_raise(map, node->key, atomic_load(&node->seq));
+
+    uintptr_t next = atomic_load_explicit(&node->next, memory_order_acquire);
+    while (!is_marked(next)) {
+        if (atomic_compare_exchange_weak_explicit(
+                &node->next, &next, make_tagged(get_ptr(next), true),
+                memory_order_acq_rel, memory_order_acquire))
+            break;
+        STAT_INC(map, mark_cas_fails);
+        PROBE2(hashmap, mark_retry, map, node->key);
     }
 }
 
 /*
- * list_delete — Logically delete a node by marking its next pointer.
- *
- * Returns the value of the deleted node, or NULL if not found.
+ * list_unlink — Physically remove a marked node through the predecessor
+ * list_find returned (best-effort). The node is retired if we unlinked
+ * it; otherwise a later traversal does both.
  */
-static void *list_delete(struct hm_node *head, uint64_t so_key, uint64_t key)
+static void list_unlink(hashmap_t *map, struct hm_node *pred,
+                        struct hm_node *node)
 {
-    while (1) {
-        _Atomic(uintptr_t) *prev;
-        struct hm_node *curr;
-
-        if (!list_find(NULL, head, so_key, &prev, &curr))
-            return NULL;  /* not found */
-
-        /* Verify it's the right key (not a dummy or hash collision) */
-        if (curr->is_dummy || curr->key != key)
-            return NULL;
-
-        void *val = atomic_load_explicit(&curr->value, memory_order_acquire);
-
-        /* Logical delete: mark curr->next */
-        uintptr_t next_tagged = atomic_load_explicit(&curr->next, memory_order_acquire);
-        if (is_marked(next_tagged))
-            return NULL;  /* already deleted */
-
-        if (!atomic_compare_exchange_strong_explicit(
-                &curr->next, &next_tagged,
-                make_tagged(get_ptr(next_tagged), true),
-                memory_order_acq_rel, memory_order_acquire)) {
-            continue;  /* retry */
-        }
-
-        /* Physical removal (best-effort, will be cleaned up by find) */
-        uintptr_t expected = make_tagged(curr, false);
-        atomic_compare_exchange_strong_explicit(
-            prev, &expected, make_tagged(get_ptr(next_tagged), false),
-            memory_order_acq_rel, memory_order_acquire);
-
-        return val;
+    uintptr_t next = atomic_load_explicit(&node->next, memory_order_acquire);
+    uintptr_t expected = make_tagged(node, false);
+    if (atomic_compare_exchange_strong_explicit(
+            &pred->next, &expected, make_tagged(get_ptr(next), false),
+            memory_order_acq_rel, memory_order_acquire))
+        node_retire(map, node);
+    else {
+        STAT_INC(map, unlink_cas_fails);
+        PROBE2(hashmap, unlink_retry, map, node->key);
     }
 }
 
@@ -273,252 +815,2772 @@ static inline size_t get_parent(size_t bucket)
 }
 
 /*
- * Ensure bucket `idx` is initialized (has a dummy sentinel in the list).
- * Recursively initializes parent buckets as needed.
+ * Ensure bucket `idx` is initialized (has a dummy sentinel in the list)
+ * and return its sentinel. Recursively initializes parent buckets as
+ * needed; the new sentinel is searched for from its parent's, which
+ * precedes it in split order.
  */
-static void initialize_bucket(hashmap_t *map, size_t idx)
+static struct hm_node *initialize_bucket(hashmap_t *map,
+                                         struct hm_node **buckets, size_t idx)
 {
-    struct hm_node **buckets = atomic_load_explicit(&map->buckets, memory_order_acquire);
-    size_t cap = atomic_load_explicit(&map->size, memory_order_acquire);
-
-    if (idx >= cap) return;
-    if (buckets[idx] != NULL) return;  /* already initialized */
+    _Atomic(struct hm_node *) *slot = (_Atomic(struct hm_node *) *)&buckets[idx];
+    struct hm_node *sentinel = atomic_load_explicit(slot, memory_order_acquire);
+    if (sentinel)
+        return sentinel;  /* already initialized (bucket 0 always is) */
 
     /* Ensure parent is initialized */
-    size_t parent = get_parent(idx);
-    if (parent != idx)
-        initialize_bucket(map, parent);
+    struct hm_node *parent = initialize_bucket(map, buckets, get_parent(idx));
 
     /* Create and insert dummy sentinel */
-    struct hm_node *dummy = node_alloc(0, make_so_dummy(idx), NULL, true);
-    if (!dummy) return;
-
-    struct hm_node *inserted = list_insert(&map->head, dummy);
+    uint64_t so_key = make_so_dummy(idx);
+    struct hm_node *pred, *curr;
+    if (list_find(map, parent, NULL, so_key, 0, &pred, &curr)) {
+        sentinel = curr;  /* another thread inserted it */
+    } else {
+        struct hm_node *dummy = node_alloc(map, 0, so_key, NULL, true);
+        if (!dummy) return parent;  /* search from the parent instead */
+        sentinel = list_insert(map, parent, dummy, &pred, &curr, NULL);
+        if (sentinel == dummy) {
+            STAT_INC(map, bucket_inits);
+            PROBE2(hashmap, bucket_init, map, idx);
+        }
+    }
 
     /* CAS the bucket pointer (another thread may have beat us) */
     struct hm_node *expected = NULL;
-    if (!atomic_compare_exchange_strong_explicit(
-            (_Atomic(struct hm_node *) *)&buckets[idx],
-            &expected, inserted,
-            memory_order_acq_rel, memory_order_acquire)) {
-        /* Another thread initialized it — that's fine, expected now points to it */
-    }
+    atomic_compare_exchange_strong_explicit(slot, &expected, sentinel,
+                                            memory_order_acq_rel,
+                                            memory_order_acquire);
+    return sentinel;
+}
+
+/*
+ * Bucket sentinel to start a search for `key` from (initializing it).
+ */
+static struct hm_node *bucket_head_for(hashmap_t *map, uint64_t key)
+{
+    /* Read size before buckets: a newer array is always at least as large */
+    size_t cap = atomic_load_explicit(&map->size, memory_order_acquire);
+    struct hm_node **buckets = atomic_load_explicit(&map->buckets, memory_order_acquire);
+    size_t bucket = hash_key(key) & (cap - 1);
+
+    return initialize_bucket(map, buckets, bucket);
 }
 
 /* ──────────────────────────────────────────────────────────────────
  * Resize
  * ────────────────────────────────────────────────────────────────── */
 
+/*
+ * A superseded bucket array, with its size for memory accounting. Under
+ * EBR it is retired. In hazard mode readers index the array without a
+ * hazard, so it stays allocated until hashmap_destroy; each doubling
+ * keeps less than the live array, so the total stays under 2x.
+ */
+struct hm_kept_buckets {
+    struct hm_kept_buckets *next;
+    struct hm_node        **buckets;
+    size_t                  bytes;
+};
+
+/* Destructor of retired arrays */
+static void buckets_reclaim(void *ptr)
+{
+    struct hm_kept_buckets *k = ptr;
+    hashmap_t *map = reclaiming_map();
+    mem_add(map, MEM_RETIRED_BUCKETS, -(int64_t)k->bytes);
+    buckets_free(map, k->buckets, k->bytes / sizeof(struct hm_node *));
+    free(k);
+}
+
+static void retire_buckets(hashmap_t *map, struct hm_node **buckets, size_t cap)
+{
+    struct hm_kept_buckets *k = malloc(sizeof(*k));
+    if (!k) {
+        /* Unaccounted; in hazard mode leak rather than free under readers */
+        if (!map->hazard_mode && !buckets_mapped(map, cap))
+            epoch_retire_fn(&map->epoch, tls_epoch_slot, buckets, free);
+        return;
+    }
+    k->buckets = buckets;
+    k->bytes = cap * sizeof(*buckets);
+    mem_add(map, MEM_RETIRED_BUCKETS, (int64_t)k->bytes);
+
+    if (!map->hazard_mode) {
+        epoch_retire_fn(&map->epoch, tls_epoch_slot, k, buckets_reclaim);
+        return;
+    }
+    k->next = atomic_load_explicit(&map->kept_buckets, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(
+               &map->kept_buckets, &k->next, k,
+               memory_order_release, memory_order_relaxed))
+        ;
+}
+
 static void maybe_resize(hashmap_t *map)
 {
     size_t count = atomic_load_explicit(&map->count, memory_order_relaxed);
     size_t cap   = atomic_load_explicit(&map->size, memory_order_relaxed);
 
-    if (count * 100 < cap * HASHMAP_LOAD_FACTOR)
+    if (count * 100 < cap * map->load_factor)
         return;  /* below threshold */
 
+    PROBE3(hashmap, resize_start, map, cap, count);
     size_t new_cap = cap * 2;
     struct hm_node **old_buckets = atomic_load_explicit(&map->buckets, memory_order_acquire);
-    struct hm_node **new_buckets = calloc(new_cap, sizeof(struct hm_node *));
-    if (!new_buckets) return;  /* resize failed, keep going */
+    struct hm_node **new_buckets = buckets_alloc(map, new_cap);
+    if (!new_buckets) {
+        PROBE3(hashmap, resize_end, map, new_cap, 0);
+        return;  /* resize failed, keep going */
+    }
 
-    /* Copy existing bucket pointers */
-    memcpy(new_buckets, old_buckets, cap * sizeof(struct hm_node *));
+    /* Copy existing bucket pointers (slots may be CAS'd concurrently) */
+    for (size_t i = 0; i < cap; i++)
+        new_buckets[i] = atomic_load_explicit(
+            (_Atomic(struct hm_node *) *)&old_buckets[i], memory_order_acquire);
 
     /* CAS the bucket array */
     if (atomic_compare_exchange_strong_explicit(
             &map->buckets, &old_buckets, new_buckets,
             memory_order_acq_rel, memory_order_acquire)) {
         atomic_store_explicit(&map->size, new_cap, memory_order_release);
-        /* Retire old bucket array via EBR */
-        epoch_retire(&map->epoch, old_buckets);
+        STAT_INC(map, resizes);
+        PROBE3(hashmap, resize_end, map, new_cap, 1);
+        retire_buckets(map, old_buckets, cap);
     } else {
-        free(new_buckets);  /* another thread resized first */
+        buckets_free(map, new_buckets, new_cap);  /* another thread resized first */
+        PROBE3(hashmap, resize_end, map, new_cap, 0);
     }
 }
 
 /* ──────────────────────────────────────────────────────────────────
- * Public API
+ * MVCC versions (snapshot mode)
+ *
+ * Each regular node carries a chain of value records, newest first.
+ * A record is published with stamp 0 ("pending") and then stamped with
+ * the current version_clock; any thread that meets a pending record
+ * helps stamp it. A snapshot takes version s = clock++ and sees the
+ * newest record stamped <= s: a record stamped before the snapshot
+ * started has stamp <= s, one stamped afterwards has stamp > s, and a
+ * stamp never changes once set — so every read in the snapshot agrees.
+ *
+ * The EBR epoch cannot serve as the stamp directly: it only advances
+ * once every thread has caught up, so it does not order individual
+ * updates. EBR still does the retention — records no open snapshot can
+ * reach are cut from the chain and retired.
+ *
+ * Removes push a tombstone (value NULL). Once the tombstone is visible
+ * to every open snapshot, the chain head is swapped to mvcc_dead and
+ * the node is marked for Harris deletion.
  * ────────────────────────────────────────────────────────────────── */
 
-static void node_free_cb(void *ptr)
-{
-    free(ptr);
-}
-
-hashmap_t *hashmap_create(void)
-{
-    hashmap_t *map = calloc(1, sizeof(hashmap_t));
-    if (!map) return NULL;
-
-    struct hm_node **buckets = calloc(HASHMAP_INIT_CAP, sizeof(struct hm_node *));
-    if (!buckets) {
-        free(map);
-        return NULL;
-    }
-
-    atomic_store(&map->buckets, buckets);
-    atomic_store(&map->size, HASHMAP_INIT_CAP);
-    atomic_store(&map->count, 0);
-
-    /* Initialize head sentinel (so_key = 0, smallest possible) */
-    map->head.so_key = 0;
-    map->head.is_dummy = true;
-    atomic_store(&map->head.next, 0);
-    atomic_store(&map->head.value, NULL);
+struct hm_version {
+    void                          *value;  /* NULL = tombstone          */
+    _Atomic(uint64_t)              stamp;  /* 0 = pending               */
+    _Atomic(struct hm_version *)   prev;   /* Next-older record         */
+    uint64_t                       seq;    /* Log sequence number       */
+};
 
-    /* Bucket 0 points to head */
-    buckets[0] = &map->head;
+/* Chain head of a collected node: key absent in every view */
+static struct hm_version mvcc_dead = { .value = NULL, .stamp = 1, .prev = NULL };
 
-    /* Initialize epoch-based reclamation */
-    epoch_init(&map->epoch, node_free_cb);
+#ifdef HASHMAP_FAULTS
+_Atomic int hashmap_fault_versions;
+#endif
 
-    return map;
+static struct hm_version *version_alloc(hashmap_t *map, void *value,
+                                        struct hm_version *prev)
+{
+#ifdef HASHMAP_FAULTS
+    if (atomic_load(&hashmap_fault_versions) > 0 &&
+        atomic_fetch_sub(&hashmap_fault_versions, 1) > 0)
+        return NULL;
+#endif
+    struct hm_version *v = malloc(sizeof(*v));
+    if (!v) return NULL;
+    mem_add(map, MEM_VERSIONS, sizeof(*v));
+    v->value = value;
+    atomic_store_explicit(&v->stamp, 0, memory_order_relaxed);
+    atomic_store_explicit(&v->prev, prev, memory_order_relaxed);
+    v->seq = !prev ? 0 : map->wal ? log_seq_after(map, prev->seq) : prev->seq;
+    return v;
 }
 
-int hashmap_thread_register(hashmap_t *map)
+/* Number a node's first record, before each attempt to link the node */
+static uint64_t log_number(hashmap_t *map, struct hm_node *node)
 {
-    int slot = epoch_register(&map->epoch);
-    tls_epoch_slot = slot;
-    return slot;
+    uint64_t seq = log_seq_first(map, node->key);
+    if (map->snapshots)
+        atomic_load_explicit(&node->versions, memory_order_relaxed)->seq = seq;
+    else
+        atomic_store_explicit(&node->seq, seq, memory_order_relaxed);
+    return seq;
 }
 
-void hashmap_thread_unregister(hashmap_t *map, int slot)
+static void version_free(hashmap_t *map, struct hm_version *v)
 {
-    epoch_unregister(&map->epoch, slot);
-    tls_epoch_slot = -1;
+    mem_add(map, MEM_VERSIONS, -(int64_t)sizeof(*v));
+    free(v);
 }
 
-void hashmap_destroy(hashmap_t *map)
+/* Destructor of retired records */
+static void version_reclaim(void *ptr)
 {
-    if (!map) return;
+    mem_add(reclaiming_map(), MEM_RETIRED, -(int64_t)sizeof(struct hm_version));
+    free(ptr);
+}
 
-    /* Drain any pending retired nodes */
-    epoch_destroy(&map->epoch);
+/*
+ * Resolve a record's stamp, stamping older pending records first so
+ * stamps never decrease towards the head.
+ */
+static uint64_t mvcc_stamp(hashmap_t *map, struct hm_version *v)
+{
+    uint64_t st = atomic_load(&v->stamp);
+    if (st != 0)
+        return st;
+
+    struct hm_version *older = atomic_load(&v->prev);
+    if (older)
+        mvcc_stamp(map, older);
+
+    uint64_t expected = 0;
+    uint64_t now = atomic_load(&map->version_clock);
+    if (atomic_compare_exchange_strong(&v->stamp, &expected, now))
+        return now;
+    return expected;  /* another thread stamped it first */
+}
 
-    /* Walk the list and free all nodes (except head, which is embedded) */
-    uintptr_t tagged = atomic_load(&map->head.next);
+/*
+ * Oldest version any open (or opening) snapshot may read at. Read the
+ * clock before the announcements: a snapshot whose announcement we miss
+ * takes its version after our clock read, so it is >= the result.
+ */
+static uint64_t mvcc_floor(hashmap_t *map)
+{
+    uint64_t floor = atomic_load(&map->version_clock);
+    if (atomic_load(&map->snap_active) == 0)
+        return floor;
+
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+        uint64_t f = atomic_load(&map->snap_floor[i]);
+        if (f != 0 && f < floor)
+            floor = f;
+    }
+    return floor;
+}
+
+/*
+ * Retire a detached tail. Each link is taken with an exchange so that
+ * concurrent pruners cutting at different depths never retire the same
+ * record twice. Owned values go with their record: each is in only one.
+ */
+static void mvcc_retire_chain(hashmap_t *map, struct hm_version *v)
+{
+    while (v) {
+        struct hm_version *older = atomic_exchange(&v->prev, NULL);
+        if (map->value_free && v->value)
+            epoch_retire_fn(&map->epoch, tls_epoch_slot, v->value, map->value_free);
+        mem_retire(map, MEM_VERSIONS, sizeof(*v));
+        epoch_retire_fn(&map->epoch, tls_epoch_slot, v, version_reclaim);
+        v = older;
+    }
+}
+
+/*
+ * Drop records older than the newest one stamped <= floor; no open
+ * snapshot can reach them. `from` must already be stamped.
+ */
+static void mvcc_prune(hashmap_t *map, struct hm_version *from)
+{
+    uint64_t floor = mvcc_floor(map);
+
+    for (struct hm_version *v = from; v; v = atomic_load(&v->prev)) {
+        uint64_t st = atomic_load(&v->stamp);
+        if (st != 0 && st <= floor) {
+            mvcc_retire_chain(map, atomic_exchange(&v->prev, NULL));
+            return;
+        }
+    }
+}
+
+/*
+ * Collect a tombstoned node once every open snapshot sees the tombstone.
+ * Swapping the head to mvcc_dead fences off concurrent puts (they treat
+ * a dead node as absent) before the node is marked for unlinking.
+ */
+static bool mvcc_try_collect(hashmap_t *map, struct hm_node *node)
+{
+    struct hm_version *head = atomic_load(&node->versions);
+    if (head == &mvcc_dead || head->value != NULL)
+        return false;
+    if (mvcc_stamp(map, head) > mvcc_floor(map))
+        return false;  /* some snapshot still sees the older value */
+
+    if (map->wal)
+        log_clock_raise(map, node->key, head->seq);
+    if (!atomic_compare_exchange_strong(&node->versions, &head, &mvcc_dead))
+        return false;
+    mvcc_retire_chain(map, head);
+    node_mark(map, node);
+    return true;
+}
+
+/* Current value of a regular node (NULL if absent) */
+static inline void *node_value(hashmap_t *map, struct hm_node *node)
+{
+    if (!map->snapshots)
+        return atomic_load_explicit(&node->value, memory_order_acquire);
+    return atomic_load(&node->versions)->value;
+}
+
+/* Newest value visible at snapshot version `ver` */
+static void *mvcc_read_at(hashmap_t *map, struct hm_node *node, uint64_t ver)
+{
+    for (struct hm_version *v = atomic_load(&node->versions); v;
+         v = atomic_load(&v->prev)) {
+        if (v == &mvcc_dead)
+            return NULL;
+        if (mvcc_stamp(map, v) <= ver)
+            return v->value;
+    }
+    return NULL;  /* inserted after the snapshot */
+}
+
+/*
+ * Collect leftover tombstones and prune chains once no snapshot is
+ * open. Runs inside the caller's critical section.
+ */
+static void mvcc_sweep(hashmap_t *map)
+{
+    uintptr_t tagged = atomic_load_explicit(&map->head.next, memory_order_acquire);
     while (tagged) {
         struct hm_node *node = get_ptr(tagged);
-        if (!node) break;
-        tagged = atomic_load(&node->next);
-        free(node);
+        tagged = atomic_load_explicit(&node->next, memory_order_acquire);
+        if (node->is_dummy || is_marked(tagged))
+            continue;
+
+        struct hm_version *head = atomic_load(&node->versions);
+        if (head == &mvcc_dead)
+            continue;
+        mvcc_stamp(map, head);
+        mvcc_prune(map, head);
+        mvcc_try_collect(map, node);
     }
+}
 
-    free(atomic_load(&map->buckets));
-    free(map);
+/* Destroy the owned values still reachable from a node (map teardown) */
+static void node_free_values(hashmap_t *map, struct hm_node *node)
+{
+    if (!map->value_free || node->is_dummy)
+        return;
+    if (!map->snapshots) {
+        void *val = atomic_load(&node->value);
+        if (val) map->value_free(val);
+        return;
+    }
+    for (struct hm_version *v = atomic_load(&node->versions);
+         v && v != &mvcc_dead; v = atomic_load(&v->prev))
+        if (v->value) map->value_free(v->value);
 }
 
-void *hashmap_put(hashmap_t *map, uint64_t key, void *value)
+/* Free a node that was never published, or is being destroyed */
+static void node_discard(hashmap_t *map, struct hm_node *node)
 {
-    if (key == 0 || !value) return NULL;
+    struct hm_version *v = map->snapshots ? atomic_load(&node->versions) : NULL;
+    while (v && v != &mvcc_dead) {
+        struct hm_version *older = atomic_load(&v->prev);
+        version_free(map, v);
+        v = older;
+    }
+    mem_add(map, node->is_dummy ? MEM_SENTINELS : MEM_NODES,
+            -(int64_t)sizeof(*node));
+    node_mem_free(map, node);
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Conditional updates
+ *
+ * Every mutation is a CAS on the node's value word: hm_node.value in
+ * the default mode, the version-chain head in snapshot mode. In the
+ * default mode, swapping the value to NULL is the delete's linearization
+ * point; the Harris mark and unlink follow. A NULL-valued node is dying
+ * and is never revived — the update helps mark it and inserts afresh.
+ * In snapshot mode a tombstone head can be revived; only mvcc_dead can't.
+ * ────────────────────────────────────────────────────────────────── */
+
+/* Value word as read by one update attempt */
+struct node_state {
+    void    *value;   /* Current value (NULL = absent)                  */
+    void    *token;   /* Word to CAS against (value or chain head)      */
+    uint64_t seq;     /* node->seq matching value (logged default mode) */
+    bool     dead;    /* Node must be unlinked and the key re-inserted  */
+};
+
+static void node_load(hashmap_t *map, struct hm_node *node,
+                      struct node_state *st)
+{
+    if (!map->snapshots) {
+        /* seq rises with every swap: equal reads bracket one value */
+        uint64_t seq = map->wal ? atomic_load(&node->seq) : 0;
+        for (;;) {
+            st->value = atomic_load_explicit(&node->value, memory_order_acquire);
+            if (!map->wal)
+                break;
+            uint64_t again = atomic_load(&node->seq);
+            if (again == seq)
+                break;
+            seq = again;
+        }
+        st->seq = seq;
+        st->token = st->value;
+        st->dead = (st->value == NULL);
+        return;
+    }
+    struct hm_version *head = atomic_load(&node->versions);
+    st->value = head->value;
+    st->token = head;
+    st->dead = (head == &mvcc_dead);
+}
+
+enum swap_result {
+    SWAP_DONE,
+    SWAP_RACED,            /* the word changed underneath: re-read */
+    SWAP_NOMEM,            /* no version record: give up            */
+};
+
+/*
+ * node_swap — CAS the node's value from st->token to `desired`
+ * (NULL = delete). On success the removed node is marked and unlinked
+ * through its predecessor, and *seq holds the update's log sequence
+ * number (0 without a log).
+ */
+static enum swap_result node_swap(hashmap_t *map, struct hm_node *node,
+                                  const struct node_state *st, void *desired,
+                                  struct hm_node *pred, uint64_t *seq)
+{
+    if (!map->snapshots) {
+        void *expected = st->token;
+        bool swapped;
+        *seq = 0;
+#if LOG_PAIR_CAS
+        if (map->wal) {
+            *seq = log_seq_after(map, st->seq);
+            swapped = log_pair_cas(node, expected, st->seq, desired, *seq);
+        } else
+#endif
+            swapped = atomic_compare_exchange_strong_explicit(
+                &node->value, &expected, desired,
+                memory_order_acq_rel, memory_order_acquire);
+        if (!swapped) {
+            STAT_INC(map, value_cas_fails);
+            PROBE2(hashmap, value_retry, map, node->key);
+            return SWAP_RACED;
+        }
+        if (desired == NULL) {
+            node_mark(map, node);
+            list_unlink(map, pred, node);
+        }
+        return SWAP_DONE;
+    }
 
+    struct hm_version *head = st->token;
+    struct hm_version *v = version_alloc(map, desired, head);
+    if (!v) return SWAP_NOMEM;
+    *seq = v->seq;
+    if (!atomic_compare_exchange_strong(&node->versions, &head, v)) {
+        STAT_INC(map, value_cas_fails);
+        PROBE2(hashmap, value_retry, map, node->key);
+        version_free(map, v);
+        return SWAP_RACED;
+    }
+    mvcc_stamp(map, v);
+    mvcc_prune(map, v);
+    if (desired == NULL && mvcc_try_collect(map, node))
+        list_unlink(map, pred, node);
+    return SWAP_DONE;
+}
+
+enum update_op {
+    UPDATE_PUT,            /* set unconditionally             */
+    UPDATE_PUT_IF_ABSENT,  /* set only if absent              */
+    UPDATE_REPLACE_IF,     /* set only if current == expected */
+    UPDATE_REMOVE,         /* delete if present               */
+    UPDATE_REMOVE_IF,      /* delete only if current == expected */
+    UPDATE_COMPUTE,        /* value = fn(key, current)        */
+};
+
+struct update_req {
+    enum update_op      op;
+    void               *value;     /* PUT*, REPLACE_IF: new value   */
+    void               *expected;  /* *_IF: required current value  */
+    hashmap_compute_fn  fn;        /* COMPUTE                       */
+    void               *arg;
+    void               *result;    /* out: value after the update   */
+};
+
+/*
+ * Decide the new value given the current one. Returns false if the
+ * request leaves the entry unchanged.
+ */
+static bool update_decide(const struct update_req *req, uint64_t key,
+                          void *cur, void **desired)
+{
+    switch (req->op) {
+    case UPDATE_PUT:
+        *desired = req->value;
+        return true;
+    case UPDATE_PUT_IF_ABSENT:
+        *desired = req->value;
+        return cur == NULL;
+    case UPDATE_REPLACE_IF:
+        *desired = req->value;
+        return cur != NULL && cur == req->expected;
+    case UPDATE_REMOVE:
+        *desired = NULL;
+        return cur != NULL;
+    case UPDATE_REMOVE_IF:
+        *desired = NULL;
+        return cur != NULL && cur == req->expected;
+    case UPDATE_COMPUTE:
+        *desired = req->fn(key, cur, req->arg);
+        return *desired != cur;
+    }
+    return false;
+}
+
+/*
+ * map_update — Apply `req` to `key` with one list_find.
+ *
+ * The search position is reused for the insert or for the CAS on the
+ * found node's value; a lost value race only re-reads that node. When
+ * the node turns out to be dying, or an insert CAS fails, the search
+ * resumes from the predecessor rather than the bucket sentinel.
+ *
+ * Returns the value before the update (NULL if absent); *applied tells
+ * whether the map changed, and req->result holds the value after it.
+ */
+static void *map_update(hashmap_t *map, uint64_t key,
+                        struct update_req *req, bool *applied)
+{
     int slot = tls_epoch_slot;
-    if (slot >= 0) epoch_enter(&map->epoch, slot);
+    struct lat_probe probe;
+    lat_start(map, slot, &probe);
+    map_enter(map, slot);
+    lat_entered(&probe);
 
     uint64_t so_key = make_so_regular(key);
-    size_t cap = atomic_load_explicit(&map->size, memory_order_acquire);
-    size_t bucket = hash_key(key) & (cap - 1);
+    struct hm_node *bucket_head = bucket_head_for(map, key);
+
+    struct hm_node *node = NULL;        /* allocated on first insert   */
+    bool linked = false;                /* node made it into the list  */
+    struct hm_node *target = NULL;      /* existing node for key       */
+    struct hm_node *pred = NULL;        /* last node ordered before key */
+    struct hm_node *curr = NULL;        /* first node not before key   */
+    struct node_state st = { 0 };
+    void *desired = NULL;
+    uint64_t seq = 0;                   /* log order of the applying CAS */
+
+    *applied = false;
+
+    for (;;) {
+        if (!target &&
+            list_find(map, bucket_head, pred, so_key, key, &pred, &curr))
+            target = curr;
+
+        if (target) {
+            node_load(map, target, &st);
+            if (st.dead) {
+                node_mark(map, target);  /* help the remover, then re-insert */
+                target = NULL;
+                continue;
+            }
+        } else {
+            st.value = NULL;
+        }
 
-    initialize_bucket(map, bucket);
+        if (!update_decide(req, key, st.value, &desired))
+            break;
 
-    struct hm_node **buckets = atomic_load_explicit(&map->buckets, memory_order_acquire);
-    struct hm_node *bucket_head = buckets[bucket];
-    if (!bucket_head) bucket_head = &map->head;  /* fallback */
+        if (target) {
+            enum swap_result r = node_swap(map, target, &st, desired, pred, &seq);
+            if (r == SWAP_DONE)
+                *applied = true;
+            if (r != SWAP_RACED)
+                break;
+            continue;  /* value changed — re-read the same node */
+        }
+
+        if (desired == NULL)
+            break;  /* absent and staying absent */
+
+        /* Insert at the position found — list_insert handles races */
+        if (!node) {
+            node = node_alloc(map, key, so_key, NULL, false);
+            if (!node) break;
+            if (map->snapshots) {
+                struct hm_version *v = version_alloc(map, NULL, NULL);
+                if (!v) break;
+                atomic_store_explicit(&node->versions, v, memory_order_relaxed);
+            }
+        }
+        if (map->snapshots)
+            atomic_load(&node->versions)->value = desired;
+        else
+            atomic_store_explicit(&node->value, desired, memory_order_relaxed);
+
+        struct hm_node *result = list_insert(map, bucket_head, node,
+                                             &pred, &curr, &seq);
+        if (result == node) {
+            linked = *applied = true;
+            if (map->snapshots)
+                mvcc_stamp(map, atomic_load(&node->versions));
+            break;
+        }
+        target = result;  /* lost to a concurrent insert of the same key */
+    }
+
+    if (*applied) {
+        /* Snapshot mode retires values with their version records */
+        if (map->value_free && st.value && !map->snapshots)
+            epoch_retire_fn(&map->epoch, slot, st.value, map->value_free);
+
+        if (st.value == NULL && desired != NULL) {
+            atomic_fetch_add_explicit(&map->count, 1, memory_order_relaxed);
+            maybe_resize(map);  /* reads the bucket array: stay protected */
+        } else if (st.value != NULL && desired == NULL) {
+            atomic_fetch_sub_explicit(&map->count, 1, memory_order_relaxed);
+        }
+        if (map->dirty)
+            dirty_mark(map, so_key);
+    }
+
+    /* Encode while the value is still protected; append outside */
+    bool logged = *applied && map->wal && log_record(map, slot, key, seq, desired);
+
+    map_exit(map, slot);
+
+    if (node && !linked)
+        node_discard(map, node);
+    if (logged)
+        wal_append(map->wal->log, slot);
+
+    bool removes = req->op == UPDATE_REMOVE || req->op == UPDATE_REMOVE_IF;
+    lat_finish(map, slot, &probe, removes ? HASHMAP_LAT_REMOVE : HASHMAP_LAT_PUT);
+
+    req->result = *applied ? desired : st.value;
+    return st.value;
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Public API
+ * ────────────────────────────────────────────────────────────────── */
+
+hashmap_t *hashmap_create(void)
+{
+    return hashmap_create_with(NULL);
+}
+
+hashmap_t *hashmap_create_with(const hashmap_config_t *cfg)
+{
+    bool hazard = cfg && cfg->reclaim == HASHMAP_RECLAIM_HAZARD;
+    if (hazard && (cfg->snapshots || cfg->value_free))
+        return NULL;  /* version chains and values are only safe under EBR */
+
+    hashmap_t *map = calloc(1, sizeof(hashmap_t));
+    if (!map) return NULL;
+
+    struct hm_node **buckets = calloc(HASHMAP_INIT_CAP, sizeof(struct hm_node *));
+    map->mem = aligned_alloc(_Alignof(struct hm_thread_mem),
+                             MEM_SLOTS * sizeof(struct hm_thread_mem));
+    if (!buckets || !map->mem) {
+        free(map->mem);
+        free(buckets);
+        free(map);
+        return NULL;
+    }
+    memset(map->mem, 0, MEM_SLOTS * sizeof(struct hm_thread_mem));
+
+    if (cfg && cfg->sample_every) {
+        map->lat = calloc(EPOCH_MAX_THREADS, sizeof(*map->lat));
+        if (!map->lat) {
+            free(map->mem);
+            free(buckets);
+            free(map);
+            return NULL;
+        }
+        uint32_t every = 1;
+        while (every < cfg->sample_every && every < (1u << 31))
+            every <<= 1;
+        map->sample_mask = every - 1;
+    }
 
-    /* Try to find existing node first */
-    _Atomic(uintptr_t) *prev;
-    struct hm_node *curr;
+    if (cfg && cfg->checkpoint_ranges) {
+        uint32_t bits = 0;
+        while ((1u << bits) < cfg->checkpoint_ranges && bits < CKPT_RANGE_BITS_MAX)
+            bits++;
+        size_t words = (((size_t)1 << bits) + 63) / 64;
+        map->dirty = malloc(words * sizeof(*map->dirty));
+        if (!map->dirty) {
+            free(map->lat);
+            free(map->mem);
+            free(buckets);
+            free(map);
+            return NULL;
+        }
+        /* All dirty: the first checkpoint covers whatever the map holds */
+        for (size_t i = 0; i < words; i++)
+            atomic_init(&map->dirty[i], ~(uint64_t)0);
+        map->dirty_bits = bits;
+    }
 
-    if (list_find(&map->epoch, bucket_head, so_key, &prev, &curr)) {
-        if (curr && !curr->is_dummy && curr->key == key) {
-            void *old = atomic_exchange_explicit(&curr->value, value,
-                                                  memory_order_acq_rel);
-            if (slot >= 0) epoch_exit(&map->epoch, slot);
-            return old;  /* updated existing */
+    if (cfg && (cfg->numa != HASHMAP_NUMA_OFF ||
+                cfg->hugepages != HASHMAP_HUGEPAGES_OFF)) {
+        static const enum numa_placement place[] = {
+            [HASHMAP_NUMA_OFF]        = NUMA_PLACE_ANY,
+            [HASHMAP_NUMA_LOCAL]      = NUMA_PLACE_NODES,
+            [HASHMAP_NUMA_INTERLEAVE] = NUMA_PLACE_INTERLEAVE,
+            [HASHMAP_NUMA_BUCKET]     = NUMA_PLACE_NODES,
+        };
+        map->numa = cfg->numa;
+        map->hugepages = cfg->hugepages;
+        map->arena = numa_arena_create(sizeof(struct hm_node), place[cfg->numa],
+                                       map_pages(map));
+        if (!map->arena) {
+            free(map->dirty);
+            free(map->lat);
+            free(map->mem);
+            free(buckets);
+            free(map);
+            return NULL;
         }
+        map->numa_nodes = numa_node_count();
     }
 
-    /* Insert new node — list_insert handles concurrent races */
-    struct hm_node *node = node_alloc(key, so_key, value, false);
-    if (!node) {
-        if (slot >= 0) epoch_exit(&map->epoch, slot);
+#ifdef HASHMAP_STATS
+    map->stats = aligned_alloc(_Alignof(struct hm_thread_stats),
+                               STATS_SLOTS * sizeof(struct hm_thread_stats));
+    if (!map->stats) {
+        numa_arena_destroy(map->arena);
+        free(map->dirty);
+        free(map->lat);
+        free(map->mem);
+        free(buckets);
+        free(map);
         return NULL;
     }
+    memset(map->stats, 0, STATS_SLOTS * sizeof(struct hm_thread_stats));
+#endif
+
+    atomic_store(&map->buckets, buckets);
+    atomic_store(&map->size, HASHMAP_INIT_CAP);
+    atomic_store(&map->count, 0);
 
-    struct hm_node *result = list_insert(bucket_head, node);
+    /* Initialize head sentinel (so_key = 0, smallest possible) */
+    map->head.so_key = 0;
+    map->head.is_dummy = true;
+    atomic_store(&map->head.next, 0);
+    atomic_store(&map->head.value, NULL);
 
-    if (slot >= 0) epoch_exit(&map->epoch, slot);
+    /* Bucket 0 points to head */
+    buckets[0] = &map->head;
 
-    if (result != node) {
+    /* Initialize memory reclamation (the epoch is unused in hazard mode) */
+    epoch_init(&map->epoch, free);
+    hazard_init(&map->hazard, free);
+    map->hazard_mode = hazard;
+    atomic_store(&map->kept_buckets, NULL);
+    map->load_factor = HASHMAP_LOAD_FACTOR;
+    if (cfg) {
+        map->node_pool = cfg->node_pool;
+        map->value_free = cfg->value_free;
+        if (cfg->load_factor)
+            map->load_factor = cfg->load_factor;
+    }
+    if (cfg && !hazard) {
+        epoch_set_reclaim_batch(&map->epoch, cfg->reclaim_batch);
+        epoch_set_pressure(&map->epoch, cfg->retire_limit, cfg->retire_ceiling,
+                           cfg->on_stall, cfg->stall_arg);
+        if (cfg->asymmetric_fences)
+            epoch_use_membarrier(&map->epoch);  /* else keep full fences */
+        if (cfg->qsbr) {
+            epoch_use_qsbr(&map->epoch);
+            map->qsbr = true;
+        }
+    }
+    if (cfg && !hazard && cfg->background_reclaim &&
+        epoch_reclaimer_start(&map->epoch,
+                              cfg->pin_reclaimer ? cfg->reclaim_cpu : -1) != 0) {
+        free(map->stats);
+        numa_arena_destroy(map->arena);
+        free(map->dirty);
+        free(map->lat);
+        free(map->mem);
+        free(buckets);
+        free(map);
         return NULL;
     }
 
-    atomic_fetch_add_explicit(&map->count, 1, memory_order_relaxed);
-    maybe_resize(map);
+    map->snapshots = cfg && cfg->snapshots;
+    atomic_store(&map->version_clock, 1);  /* 0 marks a pending stamp */
+    atomic_store(&map->snap_active, 0);
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++)
+        atomic_store(&map->snap_floor[i], 0);
 
-    return NULL;  /* new insertion */
+    return map;
 }
 
-void *hashmap_get(hashmap_t *map, uint64_t key)
+int hashmap_thread_register(hashmap_t *map)
 {
-    if (key == 0) return NULL;
+    int slot = map->hazard_mode ? hazard_register(&map->hazard)
+                                : epoch_register(&map->epoch);
+    tls_epoch_slot = slot;
+    return slot;
+}
 
-    int slot = tls_epoch_slot;
-    if (slot >= 0) epoch_enter(&map->epoch, slot);
+void hashmap_thread_unregister(hashmap_t *map, int slot)
+{
+    if (map->hazard_mode)
+        hazard_unregister(&map->hazard, slot);
+    else
+        epoch_unregister(&map->epoch, slot);
+    tls_epoch_slot = -1;
+    node_pool_drain();
+}
 
-    uint64_t so_key = make_so_regular(key);
-    size_t cap = atomic_load_explicit(&map->size, memory_order_acquire);
-    size_t bucket = hash_key(key) & (cap - 1);
+void hashmap_thread_flush(hashmap_t *map, int slot)
+{
+    if (map->hazard_mode) {
+        if (slot >= 0) hazard_scan(&map->hazard, slot);
+    } else {
+        epoch_flush(&map->epoch, slot);
+    }
+}
 
-    initialize_bucket(map, bucket);
+void hashmap_quiescent(hashmap_t *map, int slot)
+{
+    if (map->qsbr)
+        epoch_quiescent(&map->epoch, slot);
+}
 
-    struct hm_node **buckets = atomic_load_explicit(&map->buckets, memory_order_acquire);
-    struct hm_node *bucket_head = buckets[bucket];
-    if (!bucket_head) bucket_head = &map->head;
+void hashmap_thread_offline(hashmap_t *map, int slot)
+{
+    if (map->qsbr)
+        epoch_offline(&map->epoch, slot);
+}
+
+int hashmap_numa_nodes(void)
+{
+    return numa_node_count();
+}
 
-    _Atomic(uintptr_t) *prev;
-    struct hm_node *curr;
+int hashmap_numa_home(const hashmap_t *map, uint64_t key)
+{
+    return map->numa == HASHMAP_NUMA_BUCKET ? numa_place(map, make_so_regular(key)) : -1;
+}
 
-    void *result = NULL;
-    if (list_find(&map->epoch, bucket_head, so_key, &prev, &curr)) {
-        if (curr && !curr->is_dummy && curr->key == key) {
-            result = atomic_load_explicit(&curr->value, memory_order_acquire);
-        }
+void hashmap_enter(hashmap_t *map)
+{
+    map_enter(map, tls_epoch_slot);
+}
+
+void hashmap_exit(hashmap_t *map)
+{
+    if (!map->hazard_mode)
+        map_exit(map, tls_epoch_slot);
+}
+
+int hashmap_stats(hashmap_t *map, hashmap_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->unreclaimed = map->hazard_mode ? hazard_unreclaimed(&map->hazard)
+                                        : epoch_unreclaimed(&map->epoch);
+    if (!map->stats)
+        return -1;
+
+    for (int i = 0; i < STATS_SLOTS; i++) {
+        struct hm_thread_stats *t = &map->stats[i];
+        out->finds            += atomic_load_explicit(&t->finds, memory_order_relaxed);
+        out->find_steps       += atomic_load_explicit(&t->find_steps, memory_order_relaxed);
+        out->find_restarts    += atomic_load_explicit(&t->find_restarts, memory_order_relaxed);
+        out->unlink_cas_fails += atomic_load_explicit(&t->unlink_cas_fails, memory_order_relaxed);
+        out->insert_cas_fails += atomic_load_explicit(&t->insert_cas_fails, memory_order_relaxed);
+        out->mark_cas_fails   += atomic_load_explicit(&t->mark_cas_fails, memory_order_relaxed);
+        out->value_cas_fails  += atomic_load_explicit(&t->value_cas_fails, memory_order_relaxed);
+        out->bucket_inits     += atomic_load_explicit(&t->bucket_inits, memory_order_relaxed);
+        out->resizes          += atomic_load_explicit(&t->resizes, memory_order_relaxed);
+        out->retired          += atomic_load_explicit(&t->retired, memory_order_relaxed);
+        uint64_t depth = atomic_load_explicit(&t->max_retire_depth, memory_order_relaxed);
+        if (depth > out->max_retire_depth)
+            out->max_retire_depth = depth;
     }
+    return 0;
+}
 
-    if (slot >= 0) epoch_exit(&map->epoch, slot);
-    return result;
+int hashmap_memory_usage(hashmap_t *map, hashmap_memory_t *out)
+{
+    int64_t bytes[MEM_KINDS] = { 0 };
+    for (int i = 0; i < MEM_SLOTS; i++)
+        for (int k = 0; k < MEM_KINDS; k++)
+            bytes[k] += atomic_load_explicit(&map->mem[i].bytes[k], memory_order_relaxed);
+    /* Slots are read at different times: clamp a transiently negative sum */
+    for (int k = 0; k < MEM_KINDS; k++)
+        if (bytes[k] < 0) bytes[k] = 0;
+
+    memset(out, 0, sizeof(*out));
+    out->nodes           = (size_t)bytes[MEM_NODES];
+    out->sentinels       = (size_t)bytes[MEM_SENTINELS];
+    out->versions        = (size_t)bytes[MEM_VERSIONS];
+    out->buckets         = atomic_load_explicit(&map->size, memory_order_relaxed) *
+                           sizeof(struct hm_node *);
+    out->retired_buckets = (size_t)bytes[MEM_RETIRED_BUCKETS];
+    out->retired         = (size_t)bytes[MEM_RETIRED];
+    out->retire_records  = epoch_unreclaimed(&map->epoch) * sizeof(struct epoch_node) +
+                           hazard_unreclaimed(&map->hazard) * sizeof(struct hazard_node);
+    out->reclaim_state   = sizeof(epoch_t) + sizeof(hazard_domain_t);
+
+    out->fixed = sizeof(hashmap_t) - out->reclaim_state +
+                 MEM_SLOTS * sizeof(struct hm_thread_mem);
+    if (map->stats)
+        out->fixed += STATS_SLOTS * sizeof(struct hm_thread_stats);
+    if (map->lat) {
+        out->fixed += EPOCH_MAX_THREADS * sizeof(*map->lat);
+        for (int i = 0; i < EPOCH_MAX_THREADS; i++)
+            if (atomic_load_explicit(&map->lat[i], memory_order_relaxed))
+                out->fixed += sizeof(struct hm_lat_slot);
+    }
+
+    out->total = out->nodes + out->sentinels + out->versions + out->buckets +
+                 out->retired_buckets + out->retired + out->retire_records +
+                 out->reclaim_state + out->fixed;
+    return 0;
 }
 
-void *hashmap_remove(hashmap_t *map, uint64_t key)
+int hashmap_latency(hashmap_t *map, enum hashmap_lat_op op,
+                    enum hashmap_lat_phase phase, lat_summary_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!map->lat || op >= HASHMAP_LAT_OPS || phase >= HASHMAP_LAT_PHASES)
+        return -1;
+
+    lat_accum_t *acc = calloc(1, sizeof(*acc));
+    if (!acc) return -1;
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+        struct hm_lat_slot *ls = atomic_load_explicit(&map->lat[i], memory_order_acquire);
+        if (ls)
+            lat_merge(acc, &ls->hist[op][phase]);
+    }
+    lat_summarize(acc, out);
+    free(acc);
+    return 0;
+}
+
+void hashmap_destroy(hashmap_t *map)
+{
+    if (!map) return;
+
+    hashmap_checkpoint_wait(map);
+    hashmap_wal_close(map);
+
+    /* Drain any pending retired nodes */
+    epoch_destroy(&map->epoch);
+    hazard_destroy(&map->hazard);
+
+    struct hm_kept_buckets *k = atomic_load(&map->kept_buckets);
+    while (k) {
+        struct hm_kept_buckets *next = k->next;
+        buckets_free(map, k->buckets, k->bytes / sizeof(struct hm_node *));
+        free(k);
+        k = next;
+    }
+
+    /* Walk the list and free all nodes (except head, which is embedded) */
+    uintptr_t tagged = atomic_load(&map->head.next);
+    while (tagged) {
+        struct hm_node *node = get_ptr(tagged);
+        if (!node) break;
+        tagged = atomic_load(&node->next);
+        node_free_values(map, node);
+        node_discard(map, node);
+    }
+
+    buckets_free(map, atomic_load(&map->buckets), atomic_load(&map->size));
+    numa_arena_destroy(map->arena);
+    free(map->stats);
+    free(map->mem);
+    free(map->dirty);
+    if (map->lat) {
+        for (int i = 0; i < EPOCH_MAX_THREADS; i++)
+            free(atomic_load(&map->lat[i]));
+        free(map->lat);
+    }
+    free(map);
+
+    /* The destroys above may have pooled nodes on this thread */
+    node_pool_drain();
+}
+
+void *hashmap_put(hashmap_t *map, uint64_t key, void *value)
+{
+    if (key == 0 || !value) return NULL;
+
+    struct update_req req = { .op = UPDATE_PUT, .value = value };
+    bool applied;
+    return map_update(map, key, &req, &applied);
+}
+
+void *hashmap_put_if_absent(hashmap_t *map, uint64_t key, void *value)
+{
+    if (key == 0 || !value) return NULL;
+
+    struct update_req req = { .op = UPDATE_PUT_IF_ABSENT, .value = value };
+    bool applied;
+    return map_update(map, key, &req, &applied);
+}
+
+bool hashmap_replace_if(hashmap_t *map, uint64_t key,
+                        void *expected, void *value)
+{
+    if (key == 0 || !expected || !value) return false;
+
+    struct update_req req = {
+        .op = UPDATE_REPLACE_IF, .value = value, .expected = expected,
+    };
+    bool applied;
+    map_update(map, key, &req, &applied);
+    return applied;
+}
+
+void *hashmap_get(hashmap_t *map, uint64_t key)
 {
     if (key == 0) return NULL;
 
     int slot = tls_epoch_slot;
-    if (slot >= 0) epoch_enter(&map->epoch, slot);
+    struct lat_probe probe;
+    lat_start(map, slot, &probe);
+    map_enter(map, slot);
+    lat_entered(&probe);
 
     uint64_t so_key = make_so_regular(key);
-    size_t cap = atomic_load_explicit(&map->size, memory_order_acquire);
-    size_t bucket = hash_key(key) & (cap - 1);
-    initialize_bucket(map, bucket);
+    struct hm_node *bucket_head = bucket_head_for(map, key);
 
-    struct hm_node **buckets = atomic_load_explicit(&map->buckets, memory_order_acquire);
-    struct hm_node *bucket_head = buckets[bucket];
-    if (!bucket_head) bucket_head = &map->head;
+    struct hm_node *pred, *curr;
 
-    void *val = list_delete(bucket_head, so_key, key);
+    void *result = NULL;
+    if (list_find(map, bucket_head, NULL, so_key, key, &pred, &curr))
+        result = node_value(map, curr);
 
-    if (slot >= 0) epoch_exit(&map->epoch, slot);
+    map_exit(map, slot);
+    lat_finish(map, slot, &probe, HASHMAP_LAT_GET);
+    return result;
+}
 
-    if (val) {
-        atomic_fetch_sub_explicit(&map->count, 1, memory_order_relaxed);
-    }
+void *hashmap_remove(hashmap_t *map, uint64_t key)
+{
+    if (key == 0) return NULL;
 
-    return val;
+    struct update_req req = { .op = UPDATE_REMOVE };
+    bool applied;
+    void *old = map_update(map, key, &req, &applied);
+    return applied ? old : NULL;
 }
 
-size_t hashmap_count(hashmap_t *map)
+bool hashmap_remove_if(hashmap_t *map, uint64_t key, void *expected)
 {
-    return atomic_load_explicit(&map->count, memory_order_relaxed);
+    if (key == 0 || !expected) return false;
+
+    struct update_req req = { .op = UPDATE_REMOVE_IF, .expected = expected };
+    bool applied;
+    map_update(map, key, &req, &applied);
+    return applied;
+}
+
+void *hashmap_compute(hashmap_t *map, uint64_t key,
+                      hashmap_compute_fn fn, void *arg)
+{
+    if (key == 0 || !fn) return NULL;
+
+    struct update_req req = { .op = UPDATE_COMPUTE, .fn = fn, .arg = arg };
+    bool applied;
+    map_update(map, key, &req, &applied);
+    return req.result;
+}
+
+size_t hashmap_count(hashmap_t *map)
+{
+    return atomic_load_explicit(&map->count, memory_order_relaxed);
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Parallel scan
+ *
+ * Initialized bucket sentinels are never unlinked, so they are stable
+ * split points: the segment between two consecutive sentinels (in
+ * so_key order) is disjoint from every other segment. Workers pull
+ * segments from a shared cursor, so a helper that fails to start or
+ * register only reduces parallelism.
+ * ────────────────────────────────────────────────────────────────── */
+
+/* Segments handed out per worker, for load balance across skewed buckets */
+#define SCAN_SEGMENTS_PER_THREAD 8
+
+struct scan_segment {
+    struct hm_node *start;      /* Sentinel the segment begins at     */
+    uint64_t        end_so_key; /* Exclusive bound (next sentinel)    */
+    bool            open_end;   /* Last segment: run to end of list   */
+};
+
+struct scan_ctx {
+    hashmap_t           *map;
+    hashmap_visit_fn     fn;
+    void                *arg;
+    struct scan_segment *segs;
+    size_t               nsegs;
+    _Atomic(size_t)      next_seg;
+};
+
+static void scan_segment(hashmap_t *map, const struct scan_segment *seg,
+                         hashmap_visit_fn fn, void *arg)
+{
+    struct hm_node *curr = seg->start;
+
+    while (curr) {
+        if (curr != seg->start && !seg->open_end &&
+            curr->so_key >= seg->end_so_key)
+            break;
+
+        uintptr_t next_tagged = atomic_load_explicit(&curr->next, memory_order_acquire);
+        if (!curr->is_dummy && !is_marked(next_tagged)) {
+            void *val = node_value(map, curr);
+            if (val)
+                fn(curr->key, val, arg);
+        }
+        curr = get_ptr(next_tagged);
+    }
+}
+
+/*
+ * Hazard mode: a marked node's successor may already be freed, so the
+ * walk cannot follow raw next pointers. Each step is a list_find for the
+ * position just after the last node visited, resumed from that node,
+ * which keeps pred/curr protected and usually advances by one link.
+ */
+static void scan_segment_hp(hashmap_t *map, const struct scan_segment *seg,
+                            hashmap_visit_fn fn, void *arg)
+{
+    struct hm_node *pred = seg->start, *curr;
+    uint64_t so_key = seg->start->so_key, key = 1;
+
+    for (;;) {
+        list_find(map, seg->start, pred, so_key, key, &pred, &curr);
+        if (!curr)
+            break;
+        if (!seg->open_end && curr->so_key >= seg->end_so_key)
+            break;
+
+        if (!curr->is_dummy) {
+            void *val = node_value(map, curr);
+            if (val)
+                fn(curr->key, val, arg);
+        }
+
+        /* Next position: (so_key, key + 1), carrying into so_key */
+        so_key = curr->so_key;
+        key = curr->key + 1;
+        if (key == 0)
+            so_key++;
+        pred = curr;
+    }
+}
+
+static void scan_drain(struct scan_ctx *ctx, int slot)
+{
+    for (;;) {
+        size_t i = atomic_fetch_add_explicit(&ctx->next_seg, 1, memory_order_relaxed);
+        if (i >= ctx->nsegs)
+            return;
+
+        map_enter(ctx->map, slot);
+        if (ctx->map->hazard_mode)
+            scan_segment_hp(ctx->map, &ctx->segs[i], ctx->fn, ctx->arg);
+        else
+            scan_segment(ctx->map, &ctx->segs[i], ctx->fn, ctx->arg);
+        map_exit(ctx->map, slot);
+    }
+}
+
+static void *scan_worker(void *arg)
+{
+    struct scan_ctx *ctx = arg;
+
+    int slot = hashmap_thread_register(ctx->map);
+    if (slot < 0)
+        return NULL;  /* out of epoch slots — others pick up our share */
+
+    scan_drain(ctx, slot);
+    hashmap_thread_unregister(ctx->map, slot);
+    return NULL;
+}
+
+/*
+ * Collect initialized sentinels in list order. Visiting bucket indices
+ * as bit-reversed counters yields ascending so_keys without sorting.
+ */
+static size_t collect_sentinels(hashmap_t *map, struct hm_node ***out)
+{
+    /* Read size before buckets: a newer array is always at least as large */
+    size_t cap = atomic_load_explicit(&map->size, memory_order_acquire);
+    struct hm_node **buckets = atomic_load_explicit(&map->buckets, memory_order_acquire);
+    int shift = 64 - __builtin_ctzl(cap);
+
+    struct hm_node **sent = malloc(cap * sizeof(*sent));
+    if (!sent) return 0;
+
+    size_t n = 0;
+    for (size_t i = 0; i < cap; i++) {
+        size_t b = (shift == 64) ? 0 : (size_t)(reverse_bits(i) >> shift);
+        struct hm_node *s = atomic_load_explicit(
+            (_Atomic(struct hm_node *) *)&buckets[b], memory_order_acquire);
+        if (s)
+            sent[n++] = s;
+    }
+
+    *out = sent;
+    return n;
+}
+
+int hashmap_parallel_for_each(hashmap_t *map, int nthreads,
+                              hashmap_visit_fn fn, void *arg)
+{
+    if (!map || !fn) return -1;
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > EPOCH_MAX_THREADS) nthreads = EPOCH_MAX_THREADS;
+
+    int slot = tls_epoch_slot;
+
+    struct hm_node **sent = NULL;
+    map_enter(map, slot);
+    size_t nsent = collect_sentinels(map, &sent);
+    map_exit(map, slot);
+
+    struct scan_segment single = { .start = &map->head, .open_end = true };
+    struct scan_ctx ctx = {
+        .map = map, .fn = fn, .arg = arg, .segs = &single, .nsegs = 1,
+    };
+    atomic_store(&ctx.next_seg, 0);
+
+    /* Group consecutive sentinels into at most nthreads * K segments */
+    size_t target = (size_t)nthreads * SCAN_SEGMENTS_PER_THREAD;
+    if (nthreads > 1 && nsent > 1) {
+        if (target > nsent) target = nsent;
+        struct scan_segment *segs = malloc(target * sizeof(*segs));
+        if (segs) {
+            for (size_t k = 0; k < target; k++) {
+                size_t lo = k * nsent / target;
+                size_t hi = (k + 1) * nsent / target;
+                segs[k].start = sent[lo];
+                segs[k].open_end = (hi >= nsent);
+                segs[k].end_so_key = segs[k].open_end ? 0 : sent[hi]->so_key;
+            }
+            ctx.segs = segs;
+            ctx.nsegs = target;
+        }
+    }
+    free(sent);
+
+    pthread_t tids[EPOCH_MAX_THREADS];
+    int started = 0;
+    if (ctx.nsegs > 1) {
+        for (int i = 1; i < nthreads && (size_t)i < ctx.nsegs; i++) {
+            if (pthread_create(&tids[started], NULL, scan_worker, &ctx) == 0)
+                started++;
+        }
+    }
+
+    /* The caller always participates, guaranteeing progress */
+    scan_drain(&ctx, slot);
+
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+    if (ctx.segs != &single)
+        free(ctx.segs);
+    return 0;
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Profiling
+ * ────────────────────────────────────────────────────────────────── */
+
+static void profile_bin(size_t *hist, size_t n)
+{
+    hist[n < HASHMAP_PROFILE_BINS - 1 ? n : HASHMAP_PROFILE_BINS - 1]++;
+}
+
+/* Close the run that just ended with `len` regular nodes */
+static void profile_run(hashmap_profile_t *p, size_t len, double *steps)
+{
+    profile_bin(p->runs, len);
+    if (len > p->longest_run)
+        p->longest_run = len;
+    *steps += (double)len * (double)(len + 1) / 2.0;
+}
+
+int hashmap_profile(hashmap_t *map, hashmap_profile_t *out)
+{
+    if (map->hazard_mode)
+        return -1;
+    memset(out, 0, sizeof(*out));
+
+    /* Only the array size matters: occupancy is per bucket index */
+    size_t cap = atomic_load_explicit(&map->size, memory_order_acquire);
+    uint32_t *occ = calloc(cap, sizeof(*occ));
+    if (!occ) return -1;
+
+    int slot = tls_epoch_slot;
+    map_enter(map, slot);
+
+    double steps = 0.0;
+    size_t run = 0, nruns = 0;
+    for (struct hm_node *node = &map->head; node; ) {
+        uintptr_t next = atomic_load_explicit(&node->next, memory_order_acquire);
+        if (node->is_dummy) {
+            if (nruns++)
+                profile_run(out, run, &steps);
+            run = 0;
+            /* A concurrent resize may add sentinels beyond `cap` */
+            if (reverse_bits(node->so_key) < cap)
+                out->sentinels++;
+        } else {
+            run++;
+            if (is_marked(next)) {
+                out->marked++;
+            } else if (!node_value(map, node)) {
+                out->dead++;
+            } else {
+                out->live++;
+                occ[hash_key(node->key) & (cap - 1)]++;
+            }
+        }
+        node = get_ptr(next);
+    }
+    profile_run(out, run, &steps);
+
+    map_exit(map, slot);
+
+    out->capacity = cap;
+    for (size_t i = 0; i < cap; i++)
+        profile_bin(out->occupancy, occ[i]);
+    free(occ);
+
+    size_t regular = out->live + out->marked + out->dead;
+    out->mean_run = (double)regular / (double)nruns;
+    out->expected_steps = regular ? steps / (double)regular : 0.0;
+    return 0;
+}
+
+static void json_hist(FILE *f, const char *name, const size_t *hist)
+{
+    fprintf(f, "\"%s\":[", name);
+    for (int i = 0; i < HASHMAP_PROFILE_BINS; i++)
+        fprintf(f, "%s%zu", i ? "," : "", hist[i]);
+    fputc(']', f);
+}
+
+int hashmap_profile_json(const hashmap_profile_t *p, FILE *f)
+{
+    double cap = (double)p->capacity;
+    fprintf(f, "{\"capacity\":%zu,\"live\":%zu,\"marked\":%zu,\"dead\":%zu,"
+               "\"load_factor\":%.4f,\"sentinels\":%zu,"
+               "\"uninitialized_fraction\":%.4f,\"longest_run\":%zu,"
+               "\"mean_run\":%.4f,\"expected_steps\":%.4f,",
+            p->capacity, p->live, p->marked, p->dead,
+            cap ? (double)p->live / cap : 0.0, p->sentinels,
+            cap ? 1.0 - (double)p->sentinels / cap : 0.0, p->longest_run,
+            p->mean_run, p->expected_steps);
+    json_hist(f, "occupancy", p->occupancy);
+    fputc(',', f);
+    json_hist(f, "runs", p->runs);
+    fputs("}\n", f);
+    return ferror(f) ? -1 : 0;
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Snapshots
+ * ────────────────────────────────────────────────────────────────── */
+
+int hashmap_snapshot_begin(hashmap_t *map, hashmap_snapshot_t *snap)
+{
+    int slot = tls_epoch_slot;
+    if (!map->snapshots || slot < 0 ||
+        atomic_load(&map->snap_floor[slot]) != 0)
+        return -1;
+
+    /* The epoch stays open until snapshot_end: retained records live */
+    epoch_enter(&map->epoch, slot);
+
+    /* Announce a lower bound before taking the version (see mvcc_floor) */
+    atomic_store(&map->snap_floor[slot], atomic_load(&map->version_clock));
+    atomic_fetch_add(&map->snap_active, 1);
+
+    snap->map = map;
+    snap->slot = slot;
+    snap->version = atomic_fetch_add(&map->version_clock, 1);
+    return 0;
+}
+
+void *hashmap_snapshot_get(const hashmap_snapshot_t *snap, uint64_t key)
+{
+    if (key == 0) return NULL;
+
+    hashmap_t *map = snap->map;
+    uint64_t so_key = make_so_regular(key);
+    struct hm_node *bucket_head = bucket_head_for(map, key);
+
+    struct hm_node *pred, *curr;
+
+    if (list_find(map, bucket_head, NULL, so_key, key, &pred, &curr))
+        return mvcc_read_at(map, curr, snap->version);
+    return NULL;
+}
+
+void hashmap_snapshot_for_each(const hashmap_snapshot_t *snap,
+                               hashmap_visit_fn fn, void *arg)
+{
+    hashmap_t *map = snap->map;
+
+    uintptr_t tagged = atomic_load_explicit(&map->head.next, memory_order_acquire);
+    while (tagged) {
+        struct hm_node *node = get_ptr(tagged);
+        tagged = atomic_load_explicit(&node->next, memory_order_acquire);
+        if (node->is_dummy || is_marked(tagged))
+            continue;  /* marked nodes are dead in every snapshot */
+
+        void *val = mvcc_read_at(map, node, snap->version);
+        if (val)
+            fn(node->key, val, arg);
+    }
+}
+
+void hashmap_snapshot_end(hashmap_snapshot_t *snap)
+{
+    hashmap_t *map = snap->map;
+
+    atomic_store(&map->snap_floor[snap->slot], 0);
+    if (atomic_fetch_sub(&map->snap_active, 1) == 1)
+        mvcc_sweep(map);
+
+    epoch_exit(&map->epoch, snap->slot);
+    snap->map = NULL;
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Dump and load
+ *
+ * Image layout (integers little-endian):
+ *
+ *   header  "LFHMDUMP", u32 version, u32 flags, u64 entry count when
+ *           the dump started (a sizing hint), u32 reserved, u32 CRC32C
+ *           of the preceding 28 bytes
+ *   block   u32 entries, u32 payload bytes, u32 CRC32C of the header's
+ *           first 8 bytes and the payload, then the payload: per entry
+ *           a varint key and either a varint value word or a varint
+ *           length and that many codec bytes
+ *   end     a block of 0 entries whose payload is the u64 total
+ *
+ * Entries are written in list order, so load can append each node
+ * behind the last with plain stores. Since split order groups a
+ * bucket's keys behind its sentinel, the sentinel of each occupied
+ * bucket is linked when its first key arrives; empty buckets are left
+ * to lazy initialization.
+ * ────────────────────────────────────────────────────────────────── */
+
+#define DUMP_MAGIC      "LFHMDUMP"
+#define DUMP_VERSION    1
+#define DUMP_HEADER     32
+#define DUMP_BLOCK_HDR  12
+#define DUMP_BLOCK      (64 * 1024)     /* Payload that ends a block  */
+#define DUMP_BLOCK_MAX  (256u << 20)    /* Larger is taken as corrupt */
+#define DUMP_SNAPSHOT   0x1             /* flags: one snapshot        */
+#define DUMP_CODEC      0x2             /* flags: codec-encoded values */
+
+struct dump_writer {
+    int                    fd;
+    const hashmap_codec_t *codec;
+    pbuf_t                 buf;         /* Block header + payload */
+    uint32_t               entries;     /* In the current block   */
+    uint64_t               total;
+};
+
+static bool dump_full(const struct dump_writer *w)
+{
+    return w->buf.len - DUMP_BLOCK_HDR >= DUMP_BLOCK;
+}
+
+/* Write the current block (possibly empty) and start the next */
+static int dump_flush(struct dump_writer *w)
+{
+    uint8_t *h = w->buf.data;
+    size_t len = w->buf.len - DUMP_BLOCK_HDR;
+    put_le32(h, w->entries);
+    put_le32(h + 4, (uint32_t)len);
+    put_le32(h + 8, crc32c(crc32c(0, h, 8), h + DUMP_BLOCK_HDR, len));
+    int rc = write_full(w->fd, h, w->buf.len);
+    w->buf.len = DUMP_BLOCK_HDR;
+    w->entries = 0;
+    return rc;
+}
+
+/*
+ * Append a value: a varint word, or with a codec a varint length and
+ * that many encoded bytes. Shared by dumps and the write-ahead log.
+ */
+static int value_put(pbuf_t *b, const hashmap_codec_t *codec, void *value)
+{
+    if (pbuf_reserve(b, VARINT_MAX) != 0)
+        return -1;
+    if (!codec) {
+        b->len += varint_put(b->data + b->len, (uint64_t)(uintptr_t)value);
+        return 0;
+    }
+
+    /* Encode past room for the length, then close the gap */
+    size_t at = b->len + VARINT_MAX;
+    size_t n = codec->encode(value, b->data + at, b->cap - at, codec->arg);
+    if (n != SIZE_MAX && n > b->cap - at) {
+        if (pbuf_reserve(b, VARINT_MAX + n) != 0)
+            return -1;
+        n = codec->encode(value, b->data + at, n, codec->arg);
+    }
+    if (n == SIZE_MAX)
+        return -1;
+    uint8_t lenbuf[VARINT_MAX];
+    size_t ll = varint_put(lenbuf, n);
+    memcpy(b->data + b->len, lenbuf, ll);
+    memmove(b->data + b->len + ll, b->data + at, n);
+    b->len += ll + n;
+    return 0;
+}
+
+static int dump_entry(struct dump_writer *w, uint64_t key, void *value)
+{
+    if (pbuf_reserve(&w->buf, VARINT_MAX) != 0)
+        return -1;
+    w->buf.len += varint_put(w->buf.data + w->buf.len, key);
+    if (value_put(&w->buf, w->codec, value) != 0)
+        return -1;
+    w->entries++;
+    w->total++;
+    return 0;
+}
+
+/*
+ * Receives a walk's entries in split order. `full` asks to end the
+ * critical section; `flush` then runs outside it in a live walk, and
+ * inside the snapshot's in a snapshot walk.
+ */
+struct walk_sink {
+    int  (*entry)(void *ctx, const struct hm_node *node, void *value);
+    bool (*full)(void *ctx);
+    int  (*flush)(void *ctx);
+    void  *ctx;
+};
+
+/* First node after (so_key, key), searched for from its bucket */
+static struct hm_node *walk_resume(hashmap_t *map, uint64_t so_key, uint64_t key)
+{
+    struct hm_node *pred, *curr;
+    struct hm_node *head = bucket_head_for(map, key);
+    if (list_find(map, head, NULL, so_key, key, &pred, &curr))
+        return get_ptr(atomic_load_explicit(&curr->next, memory_order_acquire));
+    return curr;
+}
+
+/* First node at or after split-ordered position `so_key` (a sentinel's) */
+static struct hm_node *walk_seek(hashmap_t *map, uint64_t so_key)
+{
+    /* The bucket of that sentinel at the current size precedes it or is it */
+    size_t cap = atomic_load_explicit(&map->size, memory_order_acquire);
+    struct hm_node **buckets = atomic_load_explicit(&map->buckets, memory_order_acquire);
+    struct hm_node *head = initialize_bucket(map, buckets, reverse_bits(so_key) & (cap - 1));
+
+    struct hm_node *pred, *curr;
+    list_find(map, head, NULL, so_key, 0, &pred, &curr);
+    return curr;
+}
+
+/*
+ * Weakly consistent: one critical section per batch, resumed by key.
+ * Covers split-ordered keys in [lo, hi); hi == 0 runs to the end.
+ */
+static int walk_live(hashmap_t *map, int slot, uint64_t lo, uint64_t hi,
+                     const struct walk_sink *sink)
+{
+    uint64_t last_so = 0, last_key = 0;   /* so_key 0: nothing emitted yet */
+    for (;;) {
+        map_enter(map, slot);
+        struct hm_node *node = last_so ? walk_resume(map, last_so, last_key)
+                             : lo      ? walk_seek(map, lo)
+                             : get_ptr(atomic_load_explicit(&map->head.next,
+                                                            memory_order_acquire));
+        int rc = 0;
+        while (node && !sink->full(sink->ctx)) {
+            if (hi && node->so_key >= hi) {
+                node = NULL;
+                break;
+            }
+            uintptr_t next = atomic_load_explicit(&node->next, memory_order_acquire);
+            if (!node->is_dummy && !is_marked(next)) {
+                void *val = node_value(map, node);
+                if (val) {
+                    if ((rc = sink->entry(sink->ctx, node, val)) != 0)
+                        break;
+                    last_so = node->so_key;
+                    last_key = node->key;
+                }
+            }
+            node = get_ptr(next);
+        }
+        map_exit(map, slot);
+
+        if (rc != 0 || !node)
+            return rc;
+        if (sink->flush(sink->ctx) != 0)
+            return -1;
+    }
+}
+
+/* One snapshot; its epoch stays open throughout */
+static int walk_snapshot(hashmap_t *map, const struct walk_sink *sink)
+{
+    hashmap_snapshot_t snap;
+    if (hashmap_snapshot_begin(map, &snap) != 0)
+        return -1;
+
+    int rc = 0;
+    uintptr_t tagged = atomic_load_explicit(&map->head.next, memory_order_acquire);
+    while (tagged && rc == 0) {
+        struct hm_node *node = get_ptr(tagged);
+        tagged = atomic_load_explicit(&node->next, memory_order_acquire);
+        if (node->is_dummy || is_marked(tagged))
+            continue;
+        void *val = mvcc_read_at(map, node, snap.version);
+        if (val && (rc = sink->entry(sink->ctx, node, val)) != 0)
+            break;
+        if (sink->full(sink->ctx))
+            rc = sink->flush(sink->ctx);
+    }
+    hashmap_snapshot_end(&snap);
+    return rc;
+}
+
+/* Snapshot mode: one snapshot; otherwise live. Not for hazard maps. */
+static int walk_map(hashmap_t *map, const struct walk_sink *sink)
+{
+    int slot = tls_epoch_slot;
+    if (map->hazard_mode || slot < 0)
+        return -1;
+    return map->snapshots ? walk_snapshot(map, sink) : walk_live(map, slot, 0, 0, sink);
+}
+
+static int dump_sink_entry(void *ctx, const struct hm_node *node, void *value)
+{
+    return dump_entry(ctx, node->key, value);
+}
+
+static bool dump_sink_full(void *ctx)
+{
+    return dump_full(ctx);
+}
+
+static int dump_sink_flush(void *ctx)
+{
+    return dump_flush(ctx);
+}
+
+int hashmap_dump(hashmap_t *map, int fd)
+{
+    return hashmap_dump_with(map, fd, NULL);
+}
+
+int hashmap_dump_with(hashmap_t *map, int fd, const hashmap_codec_t *codec)
+{
+    if (map->hazard_mode || tls_epoch_slot < 0)
+        return -1;
+
+    uint8_t h[DUMP_HEADER] = { 0 };
+    uint32_t flags = (map->snapshots ? DUMP_SNAPSHOT : 0) | (codec ? DUMP_CODEC : 0);
+    memcpy(h, DUMP_MAGIC, 8);
+    put_le32(h + 8, DUMP_VERSION);
+    put_le32(h + 12, flags);
+    put_le64(h + 16, hashmap_count(map));
+    put_le32(h + 28, crc32c(0, h, 28));
+    if (write_full(fd, h, DUMP_HEADER) != 0)
+        return -1;
+
+    struct dump_writer w = { .fd = fd, .codec = codec };
+    if (pbuf_reserve(&w.buf, DUMP_BLOCK_HDR + DUMP_BLOCK + 2 * VARINT_MAX) != 0)
+        return -1;
+    w.buf.len = DUMP_BLOCK_HDR;
+
+    struct walk_sink sink = { dump_sink_entry, dump_sink_full, dump_sink_flush, &w };
+    int rc = walk_map(map, &sink);
+    if (rc == 0 && w.entries)
+        rc = dump_flush(&w);
+    if (rc == 0) {
+        put_le64(w.buf.data + DUMP_BLOCK_HDR, w.total);
+        w.buf.len = DUMP_BLOCK_HDR + 8;
+        rc = dump_flush(&w);
+    }
+    free(w.buf.data);
+    return rc;
+}
+
+struct load_state {
+    hashmap_t       *map;
+    struct hm_node **buckets;
+    size_t           cap;
+    size_t           bucket;     /* Bucket of the last entry        */
+    struct hm_node  *tail;       /* Last node linked                */
+    uint64_t         last_so, last_key;
+    size_t           nodes, sentinels;
+};
+
+static struct hm_node *load_link(struct load_state *st, uint64_t key,
+                                 uint64_t so_key, void *value, bool is_dummy)
+{
+    struct hm_node *n = node_mem_alloc(st->map, so_key);
+    if (!n) return NULL;
+    n->key = key;
+    n->so_key = so_key;
+    n->is_dummy = is_dummy;
+
+    if (is_dummy) {
+        st->sentinels++;
+    } else if (st->map->snapshots) {
+        struct hm_version *v = malloc(sizeof(*v));
+        if (!v) {
+            node_mem_free(st->map, n);
+            return NULL;
+        }
+        v->value = value;
+        atomic_store_explicit(&v->stamp, 1, memory_order_relaxed);  /* oldest */
+        atomic_store_explicit(&v->prev, NULL, memory_order_relaxed);
+        atomic_store_explicit(&n->versions, v, memory_order_relaxed);
+        st->nodes++;
+    } else {
+        atomic_store_explicit(&n->value, value, memory_order_relaxed);
+        st->nodes++;
+    }
+
+    atomic_store_explicit(&st->tail->next, (uintptr_t)n, memory_order_relaxed);
+    st->tail = n;
+    return n;
+}
+
+static int load_append(struct load_state *st, uint64_t key, void *value)
+{
+    uint64_t so_key = make_so_regular(key);
+    if (key == 0 || !value ||
+        !(so_key > st->last_so || (so_key == st->last_so && key > st->last_key)))
+        return -1;  /* reserved, or out of split order */
+    st->last_so = so_key;
+    st->last_key = key;
+
+    size_t b = hash_key(key) & (st->cap - 1);
+    if (b != st->bucket) {
+        struct hm_node *s = load_link(st, 0, make_so_dummy(b), NULL, true);
+        if (!s) return -1;
+        st->buckets[b] = s;
+        st->bucket = b;
+    }
+    return load_link(st, key, so_key, value, false) ? 0 : -1;
+}
+
+/* Smallest power-of-two capacity that holds `n` keys without a resize */
+static size_t load_capacity(const hashmap_t *map, uint64_t n)
+{
+    size_t cap = HASHMAP_INIT_CAP;
+    while (n * 100 >= (uint64_t)cap * map->load_factor && cap < ((size_t)1 << 40))
+        cap *= 2;
+    return cap;
+}
+
+/* Parse one block's entries into the map */
+static int load_block(struct load_state *st, const uint8_t *p, const uint8_t *end,
+                      uint32_t entries, const hashmap_codec_t *codec)
+{
+    hashmap_t *map = st->map;
+    for (uint32_t i = 0; i < entries; i++) {
+        uint64_t key, word;
+        if (varint_get(&p, end, &key) != 0 || varint_get(&p, end, &word) != 0)
+            return -1;
+        void *val = (void *)(uintptr_t)word;
+        if (codec) {
+            if (word > (uint64_t)(end - p))
+                return -1;
+            val = codec->decode(p, (size_t)word, codec->arg);
+            p += word;
+            if (!val) return -1;
+        }
+        if (load_append(st, key, val) != 0) {
+            if (codec && map->value_free)
+                map->value_free(val);
+            return -1;
+        }
+    }
+    return p == end ? 0 : -1;
+}
+
+hashmap_t *hashmap_load(int fd)
+{
+    return hashmap_load_with(fd, NULL, NULL);
+}
+
+hashmap_t *hashmap_load_with(int fd, const hashmap_config_t *cfg,
+                             const hashmap_codec_t *codec)
+{
+    uint8_t h[DUMP_HEADER];
+    if (read_full(fd, h, DUMP_HEADER) != 0 || memcmp(h, DUMP_MAGIC, 8) != 0 ||
+        get_le32(h + 28) != crc32c(0, h, 28) || get_le32(h + 8) != DUMP_VERSION)
+        return NULL;
+    bool coded = get_le32(h + 12) & DUMP_CODEC;
+    if (coded != (codec != NULL) || (cfg && cfg->value_free && !codec))
+        return NULL;
+
+    hashmap_t *map = hashmap_create_with(cfg);
+    if (!map) return NULL;
+
+    struct load_state st = { .map = map, .tail = &map->head };
+    st.cap = load_capacity(map, get_le64(h + 16));
+    st.buckets = buckets_alloc(map, st.cap);
+    if (!st.buckets) {
+        hashmap_destroy(map);
+        return NULL;
+    }
+    st.buckets[0] = &map->head;
+    buckets_free(map, atomic_load_explicit(&map->buckets, memory_order_relaxed),
+                 atomic_load_explicit(&map->size, memory_order_relaxed));
+    atomic_store_explicit(&map->buckets, st.buckets, memory_order_relaxed);
+    atomic_store_explicit(&map->size, st.cap, memory_order_relaxed);
+
+    pbuf_t buf = { 0 };
+    int rc = 0;
+    for (;;) {
+        uint8_t bh[DUMP_BLOCK_HDR];
+        if (read_full(fd, bh, DUMP_BLOCK_HDR) != 0) {
+            rc = -1;
+            break;
+        }
+        uint32_t entries = get_le32(bh), len = get_le32(bh + 4);
+        buf.len = 0;
+        if (len > DUMP_BLOCK_MAX || pbuf_reserve(&buf, len) != 0 ||
+            read_full(fd, buf.data, len) != 0 ||
+            crc32c(crc32c(0, bh, 8), buf.data, len) != get_le32(bh + 8)) {
+            rc = -1;
+            break;
+        }
+        if (entries == 0) {
+            if (len != 8 || get_le64(buf.data) != st.nodes)
+                rc = -1;
+            break;
+        }
+        if ((rc = load_block(&st, buf.data, buf.data + len, entries, codec)) != 0)
+            break;
+    }
+    free(buf.data);
+
+    atomic_store_explicit(&map->count, st.nodes, memory_order_relaxed);
+    mem_add(map, MEM_NODES, (int64_t)(st.nodes * sizeof(struct hm_node)));
+    mem_add(map, MEM_SENTINELS, (int64_t)(st.sentinels * sizeof(struct hm_node)));
+    if (map->snapshots)
+        mem_add(map, MEM_VERSIONS, (int64_t)(st.nodes * sizeof(struct hm_version)));
+
+    if (rc != 0) {
+        hashmap_destroy(map);
+        return NULL;
+    }
+
+    /* More entries than the hint (a weak dump): resize before returning */
+    size_t want = load_capacity(map, st.nodes);
+    if (want > st.cap) {
+        struct hm_node **grown = buckets_alloc(map, want);
+        if (!grown) {
+            hashmap_destroy(map);
+            return NULL;
+        }
+        memcpy(grown, st.buckets, st.cap * sizeof(struct hm_node *));
+        buckets_free(map, st.buckets, st.cap);
+        atomic_store_explicit(&map->buckets, grown, memory_order_relaxed);
+        atomic_store_explicit(&map->size, want, memory_order_relaxed);
+    }
+    return map;
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Frozen images
+ *
+ * Layout, in host byte order with every section 8-byte aligned:
+ *
+ *   header   64 bytes: "LFHMFRZN", u32 version, u32 flags, u64 count,
+ *            u32 bucket_bits, u32 byte-order mark, u32 body CRC32C,
+ *            u32 reserved, u64 blob bytes, u64 file size, u32
+ *            reserved, u32 CRC32C of the preceding 60 bytes
+ *   offsets  u64[2^bucket_bits + 1]: first entry of each bucket
+ *   so_keys  u64[count], ascending with keys as tie-break
+ *   keys     u64[count]
+ *   values   u64[count] words, or u64[count + 1] blob offsets
+ *   blob     the codec bytes, value i spanning values[i]..values[i+1]
+ *
+ * A bucket is the top bucket_bits of the split-ordered key, i.e. the
+ * low bits of the hash, so its entries are contiguous. With at most
+ * two keys per bucket on average, a lookup reads one offset pair and
+ * scans a few adjacent so_keys.
+ * ────────────────────────────────────────────────────────────────── */
+
+#define FROZEN_MAGIC    "LFHMFRZN"
+#define FROZEN_VERSION  1
+#define FROZEN_HEADER   64
+#define FROZEN_BOM      0x01020304u
+#define FROZEN_BLOBS    0x1
+#define FROZEN_CHUNK    65536   /* Entries per critical section */
+
+struct freeze_buf {
+    const hashmap_codec_t *codec;
+    pbuf_t   so_keys, keys, values, blob;
+    uint64_t count;
+    uint32_t batch;                     /* Entries this critical section */
+};
+
+static int pbuf_put64(pbuf_t *b, uint64_t v)
+{
+    if (pbuf_reserve(b, 8) != 0)
+        return -1;
+    memcpy(b->data + b->len, &v, 8);
+    b->len += 8;
+    return 0;
+}
+
+static int freeze_entry(void *ctx, const struct hm_node *node, void *value)
+{
+    struct freeze_buf *fb = ctx;
+    if (pbuf_put64(&fb->so_keys, node->so_key) != 0 ||
+        pbuf_put64(&fb->keys, node->key) != 0)
+        return -1;
+
+    uint64_t word = (uint64_t)(uintptr_t)value;
+    if (fb->codec) {
+        word = fb->blob.len;
+        size_t room = fb->blob.cap - fb->blob.len;
+        size_t n = fb->codec->encode(value, fb->blob.data + fb->blob.len, room,
+                                     fb->codec->arg);
+        if (n != SIZE_MAX && n > room) {
+            if (pbuf_reserve(&fb->blob, n) != 0)
+                return -1;
+            n = fb->codec->encode(value, fb->blob.data + fb->blob.len, n,
+                                  fb->codec->arg);
+        }
+        if (n == SIZE_MAX)
+            return -1;
+        fb->blob.len += n;
+    }
+    if (pbuf_put64(&fb->values, word) != 0)
+        return -1;
+    fb->count++;
+    fb->batch++;
+    return 0;
+}
+
+static bool freeze_full(void *ctx)
+{
+    return ((struct freeze_buf *)ctx)->batch >= FROZEN_CHUNK;
+}
+
+static int freeze_flush(void *ctx)
+{
+    ((struct freeze_buf *)ctx)->batch = 0;
+    return 0;
+}
+
+static inline size_t frozen_bucket(uint64_t so_key, uint32_t bits)
+{
+    return bits ? (size_t)(so_key >> (64 - bits)) : 0;
+}
+
+int hashmap_freeze(hashmap_t *map, int fd)
+{
+    return hashmap_freeze_with(map, fd, NULL);
+}
+
+int hashmap_freeze_with(hashmap_t *map, int fd, const hashmap_codec_t *codec)
+{
+    struct freeze_buf fb = { .codec = codec };
+    struct walk_sink sink = { freeze_entry, freeze_full, freeze_flush, &fb };
+    int rc = walk_map(map, &sink);
+    if (rc == 0 && codec)
+        rc = pbuf_put64(&fb.values, fb.blob.len);   /* end of the last blob */
+
+    uint64_t *offsets = NULL;
+    uint32_t bits = 0;
+    while (((uint64_t)2 << bits) <= fb.count)
+        bits++;                                     /* ~2 keys per bucket */
+    size_t nb = (size_t)1 << bits;
+    if (rc == 0 && !(offsets = calloc(nb + 1, sizeof(*offsets))))
+        rc = -1;
+
+    if (rc == 0) {
+        const uint64_t *so = (const uint64_t *)fb.so_keys.data;
+        for (uint64_t i = 0; i < fb.count; i++)
+            offsets[frozen_bucket(so[i], bits) + 1]++;
+        for (size_t b = 0; b < nb; b++)
+            offsets[b + 1] += offsets[b];
+
+        size_t off_bytes = (nb + 1) * sizeof(*offsets);
+        size_t blob_pad = (8 - fb.blob.len % 8) % 8;
+        uint32_t crc = crc32c(0, offsets, off_bytes);
+        crc = crc32c(crc, fb.so_keys.data, fb.so_keys.len);
+        crc = crc32c(crc, fb.keys.data, fb.keys.len);
+        crc = crc32c(crc, fb.values.data, fb.values.len);
+        crc = crc32c(crc, fb.blob.data, fb.blob.len);
+
+        uint8_t h[FROZEN_HEADER] = { 0 };
+        uint32_t flags = codec ? FROZEN_BLOBS : 0, version = FROZEN_VERSION;
+        uint32_t bom = FROZEN_BOM;
+        uint64_t blob_bytes = fb.blob.len;
+        uint64_t file_size = FROZEN_HEADER + off_bytes + fb.so_keys.len +
+                             fb.keys.len + fb.values.len + fb.blob.len + blob_pad;
+        memcpy(h, FROZEN_MAGIC, 8);
+        memcpy(h + 8, &version, 4);
+        memcpy(h + 12, &flags, 4);
+        memcpy(h + 16, &fb.count, 8);
+        memcpy(h + 24, &bits, 4);
+        memcpy(h + 28, &bom, 4);
+        memcpy(h + 32, &crc, 4);
+        memcpy(h + 40, &blob_bytes, 8);
+        memcpy(h + 48, &file_size, 8);
+        uint32_t hcrc = crc32c(0, h, 60);
+        memcpy(h + 60, &hcrc, 4);
+
+        static const uint8_t zeros[8];
+        if (write_full(fd, h, FROZEN_HEADER) != 0 ||
+            write_full(fd, offsets, off_bytes) != 0 ||
+            write_full(fd, fb.so_keys.data, fb.so_keys.len) != 0 ||
+            write_full(fd, fb.keys.data, fb.keys.len) != 0 ||
+            write_full(fd, fb.values.data, fb.values.len) != 0 ||
+            write_full(fd, fb.blob.data, fb.blob.len) != 0 ||
+            write_full(fd, zeros, blob_pad) != 0)
+            rc = -1;
+    }
+
+    free(offsets);
+    free(fb.so_keys.data);
+    free(fb.keys.data);
+    free(fb.values.data);
+    free(fb.blob.data);
+    return rc;
+}
+
+hashmap_frozen_t *hashmap_frozen_open(int fd)
+{
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || sb.st_size < FROZEN_HEADER)
+        return NULL;
+    size_t size = (size_t)sb.st_size;
+    const uint8_t *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    uint32_t version, flags, bits, bom, hcrc;
+    uint64_t count, blob_bytes, file_size;
+    memcpy(&version, base + 8, 4);
+    memcpy(&flags, base + 12, 4);
+    memcpy(&count, base + 16, 8);
+    memcpy(&bits, base + 24, 4);
+    memcpy(&bom, base + 28, 4);
+    memcpy(&blob_bytes, base + 40, 8);
+    memcpy(&file_size, base + 48, 8);
+    memcpy(&hcrc, base + 60, 4);
+
+    bool blobs = flags & FROZEN_BLOBS;
+    uint64_t words = bits < 40 && count < ((uint64_t)1 << 40)
+        ? ((uint64_t)1 << bits) + 1 + 3 * count + (blobs ? 1 : 0) : UINT64_MAX;
+    if (memcmp(base, FROZEN_MAGIC, 8) != 0 || hcrc != crc32c(0, base, 60) ||
+        version != FROZEN_VERSION || bom != FROZEN_BOM || file_size != size ||
+        words == UINT64_MAX || FROZEN_HEADER + 8 * words + blob_bytes > size) {
+        munmap((void *)base, size);
+        return NULL;
+    }
+
+    hashmap_frozen_t *fm = calloc(1, sizeof(*fm));
+    if (!fm) {
+        munmap((void *)base, size);
+        return NULL;
+    }
+    fm->base = base;
+    fm->size = size;
+    fm->count = count;
+    fm->bucket_bits = bits;
+    fm->blobs = blobs;
+    fm->offsets = (const uint64_t *)(base + FROZEN_HEADER);
+    fm->so_keys = fm->offsets + ((size_t)1 << bits) + 1;
+    fm->keys = fm->so_keys + count;
+    fm->values = fm->keys + count;
+    fm->blob = (const uint8_t *)(fm->values + count + (blobs ? 1 : 0));
+    return fm;
+}
+
+/* Index of `key` in the image, or -1 */
+static int64_t frozen_find(const hashmap_frozen_t *fm, uint64_t key)
+{
+    if (key == 0) return -1;
+    uint64_t so_key = make_so_regular(key);
+    size_t b = frozen_bucket(so_key, fm->bucket_bits);
+    uint64_t hi = fm->offsets[b + 1];
+    if (hi > fm->count) hi = fm->count;     /* never trust the file */
+    for (uint64_t i = fm->offsets[b]; i < hi; i++) {
+        if (fm->so_keys[i] > so_key)
+            break;
+        if (fm->so_keys[i] == so_key && fm->keys[i] == key)
+            return (int64_t)i;
+    }
+    return -1;
+}
+
+void *hashmap_frozen_get(const hashmap_frozen_t *fm, uint64_t key)
+{
+    int64_t i = frozen_find(fm, key);
+    if (i < 0)
+        return NULL;
+    if (!fm->blobs)
+        return (void *)(uintptr_t)fm->values[i];
+    size_t len;
+    return (void *)hashmap_frozen_get_bytes(fm, key, &len);
+}
+
+const void *hashmap_frozen_get_bytes(const hashmap_frozen_t *fm, uint64_t key,
+                                     size_t *len)
+{
+    int64_t i = frozen_find(fm, key);
+    if (i < 0 || !fm->blobs)
+        return NULL;
+    uint64_t start = fm->values[i], end = fm->values[i + 1];
+    uint64_t limit = (uint64_t)(fm->base + fm->size - fm->blob);
+    if (start > end || end > limit)
+        return NULL;
+    *len = (size_t)(end - start);
+    return fm->blob + start;
+}
+
+size_t hashmap_frozen_count(const hashmap_frozen_t *fm)
+{
+    return (size_t)fm->count;
+}
+
+int hashmap_frozen_verify(const hashmap_frozen_t *fm)
+{
+    uint32_t crc;
+    uint64_t blob_bytes;
+    memcpy(&crc, fm->base + 32, 4);
+    memcpy(&blob_bytes, fm->base + 40, 8);
+    const uint8_t *body = fm->base + FROZEN_HEADER;
+    size_t len = (size_t)(fm->blob - body) + blob_bytes;
+    return crc32c(0, body, len) == crc ? 0 : -1;
+}
+
+void hashmap_frozen_close(hashmap_frozen_t *fm)
+{
+    if (!fm) return;
+    munmap((void *)fm->base, fm->size);
+    free(fm);
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Write-ahead log
+ *
+ * A record is an op byte, the varint sequence number and key, and for
+ * a put the value as in a dump (a varint word, or a varint length and
+ * codec bytes). Records are redo-only and idempotent given their order,
+ * so recovery applies, per key, just the one with the highest sequence
+ * number — on top of whatever state the map was loaded in, as long as
+ * the log covers every update since that state was captured.
+ * ────────────────────────────────────────────────────────────────── */
+
+#define WAL_PUT     1       /* Value word          */
+#define WAL_PUT_BY  2       /* Codec bytes         */
+#define WAL_REMOVE  3
+
+static bool log_record(hashmap_t *map, int slot, uint64_t key, uint64_t seq,
+                       void *value)
+{
+    struct hm_wal *wal = map->wal;
+    pbuf_t *b = wal_record(wal->log, slot);
+    if (!b || pbuf_reserve(b, 1 + 2 * VARINT_MAX) != 0)
+        goto fail;
+    b->data[b->len++] = !value ? WAL_REMOVE : wal->coded ? WAL_PUT_BY : WAL_PUT;
+    b->len += varint_put(b->data + b->len, seq);
+    b->len += varint_put(b->data + b->len, key);
+    if (value && value_put(b, wal->coded ? &wal->codec : NULL, value) != 0)
+        goto fail;
+    return true;
+fail:
+    wal_fail(wal->log);   /* reported by hashmap_wal_sync */
+    return false;
+}
+
+struct wal_entry {
+    uint64_t       seq, key, word;   /* word: value, or length of bytes */
+    const uint8_t *bytes;            /* WAL_PUT_BY: encoded value       */
+    uint8_t        op;
+};
+
+/* By key, newest first */
+static int wal_entry_cmp(const void *a, const void *b)
+{
+    const struct wal_entry *x = a, *y = b;
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    return x->seq > y->seq ? -1 : x->seq < y->seq;
+}
+
+/* Parse a log's records; -1 if any is malformed */
+static int wal_parse(const pbuf_t *log, struct wal_entry **out, size_t *count)
+{
+    const uint8_t *p = log->data, *end = log->data + log->len;
+    struct wal_entry *e = NULL;
+    size_t n = 0, cap = 0;
+
+    while (p < end) {
+        if (n == cap) {
+            cap = cap ? cap * 2 : 1024;
+            struct wal_entry *grown = realloc(e, cap * sizeof(*e));
+            if (!grown) goto bad;
+            e = grown;
+        }
+        struct wal_entry *r = &e[n];
+        r->op = *p++;
+        r->word = 0;
+        r->bytes = NULL;
+        if (varint_get(&p, end, &r->seq) != 0 || varint_get(&p, end, &r->key) != 0 ||
+            r->key == 0 || r->op < WAL_PUT || r->op > WAL_REMOVE)
+            goto bad;
+        if (r->op != WAL_REMOVE && varint_get(&p, end, &r->word) != 0)
+            goto bad;
+        if (r->op == WAL_PUT_BY) {
+            if (r->word > (uint64_t)(end - p)) goto bad;
+            r->bytes = p;
+            p += r->word;
+        } else if (r->op == WAL_PUT && r->word == 0) {
+            goto bad;
+        }
+        n++;
+    }
+    *out = e;
+    *count = n;
+    return 0;
+bad:
+    free(e);
+    return -1;
+}
+
+/* Apply the newest record of each key and note the highest seq */
+static int wal_replay(hashmap_t *map, const pbuf_t *log,
+                      const hashmap_codec_t *codec, uint64_t *last_seq)
+{
+    struct wal_entry *e;
+    size_t n;
+    if (wal_parse(log, &e, &n) != 0)
+        return -1;
+    if (n > 1)
+        qsort(e, n, sizeof(*e), wal_entry_cmp);
+
+    int rc = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (e[i].seq > *last_seq)
+            *last_seq = e[i].seq;
+        if (i > 0 && e[i].key == e[i - 1].key)
+            continue;  /* superseded */
+
+        if (e[i].op == WAL_REMOVE) {
+            hashmap_remove(map, e[i].key);
+            continue;
+        }
+        void *val = (void *)(uintptr_t)e[i].word;
+        if (e[i].op == WAL_PUT_BY) {
+            val = codec ? codec->decode(e[i].bytes, (size_t)e[i].word, codec->arg)
+                        : NULL;
+            if (!val) {
+                rc = -1;
+                break;
+            }
+        } else if (map->value_free) {
+            rc = -1;   /* a word cannot be an owned value */
+            break;
+        }
+        hashmap_put(map, e[i].key, val);
+    }
+    free(e);
+    return rc;
+}
+
+int hashmap_wal_open(hashmap_t *map, int fd, const hashmap_wal_config_t *cfg)
+{
+    static const hashmap_wal_config_t defaults = { 0 };
+    if (!cfg) cfg = &defaults;
+    if (map->wal || (!map->snapshots && !LOG_PAIR_CAS) ||
+        (map->value_free && !cfg->codec) || tls_epoch_slot < 0)
+        return -1;
+
+    pbuf_t log = { 0 };
+    uint64_t last_seq = 0;
+    if (wal_read(fd, &log) != 0 ||
+        wal_replay(map, &log, cfg->codec, &last_seq) != 0) {
+        free(log.data);
+        return -1;
+    }
+    free(log.data);
+
+    struct hm_wal *wal = aligned_alloc(_Alignof(struct hm_wal), sizeof(*wal));
+    if (!wal) return -1;
+    memset(wal, 0, sizeof(*wal));
+    wal->base = last_seq;
+    for (int i = 0; i < LOG_CLOCKS; i++)
+        atomic_store_explicit(&wal->clocks[i].seq, last_seq, memory_order_relaxed);
+    static const enum wal_sync policy[] = {
+        [HASHMAP_WAL_SYNC_NONE]     = WAL_SYNC_NONE,
+        [HASHMAP_WAL_SYNC_INTERVAL] = WAL_SYNC_INTERVAL,
+        [HASHMAP_WAL_SYNC_ALWAYS]   = WAL_SYNC_ALWAYS,
+    };
+    wal->log = wal_open(fd, policy[cfg->sync], cfg->interval_ms,
+                        cfg->buffer_bytes ? cfg->buffer_bytes : 256 * 1024);
+    if (!wal->log) {
+        free(wal);
+        return -1;
+    }
+    if (cfg->codec) {
+        wal->codec = *cfg->codec;
+        wal->coded = true;
+    }
+    map->wal = wal;
+    return 0;
+}
+
+int hashmap_wal_sync(hashmap_t *map)
+{
+    return map->wal ? wal_sync(map->wal->log) : -1;
+}
+
+int hashmap_wal_rotate(hashmap_t *map, int fd)
+{
+    return map->wal ? wal_rotate(map->wal->log, fd) : -1;
+}
+
+int hashmap_wal_close(hashmap_t *map)
+{
+    struct hm_wal *wal = map->wal;
+    if (!wal) return 0;
+    map->wal = NULL;
+    int rc = wal_close(wal->log);
+    free(wal);
+    return rc;
+}
+
+/* ──────────────────────────────────────────────────────────────────
+ * Incremental checkpoints
+ *
+ * File layout (integers little-endian):
+ *
+ *   header  "LFHMCKPT", u32 version, u32 flags, u64 generation, u32
+ *           range bits, u32 CRC32C of the preceding 28 bytes
+ *   block   u32 range, u32 entries, u32 payload bytes, u32 CRC32C of
+ *           the header's first 12 bytes and the payload, then entries
+ *           as in a dump; a range is one or more consecutive blocks
+ *           (one empty block if it holds nothing), in range order
+ *   end     a block of range CKPT_END whose payload is the u64 total
+ *           of entries and the u64 number of ranges
+ *
+ * A generation is one past the checkpoint before it; a delta applies
+ * only on top of its predecessor, a full checkpoint on anything.
+ * ────────────────────────────────────────────────────────────────── */
+
+#define CKPT_MAGIC      "LFHMCKPT"
+#define CKPT_VERSION    1
+#define CKPT_HEADER     32
+#define CKPT_BLOCK_HDR  16
+#define CKPT_FULL       0x1             /* flags: every range           */
+#define CKPT_CODEC      0x2             /* flags: codec-encoded values  */
+#define CKPT_END        UINT32_MAX      /* Range of the end block       */
+
+struct hm_ckpt {
+    hashmap_t             *map;
+    int                    fd;
+    const hashmap_codec_t *codec;
+    bool                   full;
+    uint64_t               gen;
+    int                    rc;
+    pthread_t              thread;
+};
+
+/*
+ * One writer at a time: the claim is taken with a CAS before anything
+ * is read, and the generation allocated under it, so no two checkpoints
+ * share a generation or split the dirty bits. A started checkpoint
+ * holds the claim until hashmap_checkpoint_wait has joined it.
+ */
+static bool ckpt_claim(hashmap_t *map, uint64_t *gen)
+{
+    bool idle = false;
+    if (!atomic_compare_exchange_strong(&map->ckpt_busy, &idle, true))
+        return false;
+    *gen = atomic_load(&map->ckpt_gen) + 1;
+    return true;
+}
+
+static void ckpt_release(hashmap_t *map)
+{
+    atomic_store(&map->ckpt_busy, false);
+}
+
+struct ckpt_writer {
+    hashmap_t             *map;
+    int                    fd;
+    int                    slot;
+    bool                   quiesce;     /* QSBR writer thread: go offline */
+    const hashmap_codec_t *codec;
+    pbuf_t                 buf;         /* Block header + payload     */
+    uint32_t               range;
+    uint32_t               entries;     /* In the current block       */
+    uint32_t               blocks;      /* Written for the range      */
+    uint64_t               total, ranges;
+};
+
+/* Split-ordered keys of range r: [lo, hi), hi == 0 for the last */
+static void ckpt_bounds(uint32_t bits, size_t r, uint64_t *lo, uint64_t *hi)
+{
+    *lo = bits ? (uint64_t)r << (64 - bits) : 0;
+    *hi = bits && r + 1 < ((size_t)1 << bits) ? (uint64_t)(r + 1) << (64 - bits) : 0;
+}
+
+static int ckpt_flush(struct ckpt_writer *w)
+{
+    uint8_t *h = w->buf.data;
+    size_t len = w->buf.len - CKPT_BLOCK_HDR;
+    put_le32(h, w->range);
+    put_le32(h + 4, w->entries);
+    put_le32(h + 8, (uint32_t)len);
+    put_le32(h + 12, crc32c(crc32c(0, h, 12), h + CKPT_BLOCK_HDR, len));
+
+    /* The block holds copies only: don't hold up grace periods on I/O */
+    if (w->quiesce)
+        hashmap_thread_offline(w->map, w->slot);
+    int rc = write_full(w->fd, h, w->buf.len);
+    if (w->quiesce)
+        hashmap_quiescent(w->map, w->slot);
+
+    w->buf.len = CKPT_BLOCK_HDR;
+    w->entries = 0;
+    w->blocks++;
+    return rc;
+}
+
+static int ckpt_sink_entry(void *ctx, const struct hm_node *node, void *value)
+{
+    struct ckpt_writer *w = ctx;
+    if (pbuf_reserve(&w->buf, VARINT_MAX) != 0)
+        return -1;
+    w->buf.len += varint_put(w->buf.data + w->buf.len, node->key);
+    if (value_put(&w->buf, w->codec, value) != 0)
+        return -1;
+    w->entries++;
+    w->total++;
+    return 0;
+}
+
+static bool ckpt_sink_full(void *ctx)
+{
+    const struct ckpt_writer *w = ctx;
+    return w->buf.len - CKPT_BLOCK_HDR >= DUMP_BLOCK;
+}
+
+static int ckpt_sink_flush(void *ctx)
+{
+    return ckpt_flush(ctx);
+}
+
+/* Write range r as its blocks */
+static int ckpt_range(struct ckpt_writer *w, uint32_t bits, size_t r)
+{
+    uint64_t lo, hi;
+    ckpt_bounds(bits, r, &lo, &hi);
+    w->range = (uint32_t)r;
+    w->blocks = 0;
+    w->ranges++;
+
+    struct walk_sink sink = { ckpt_sink_entry, ckpt_sink_full, ckpt_sink_flush, w };
+    if (walk_live(w->map, w->slot, lo, hi, &sink) != 0)
+        return -1;
+    return w->entries || !w->blocks ? ckpt_flush(w) : 0;
+}
+
+/* Write checkpoint `gen`; the caller holds the claim */
+static int ckpt_write(hashmap_t *map, int slot, bool quiesce, int fd,
+                      const hashmap_codec_t *codec, bool full, uint64_t gen)
+{
+    if (slot < 0)
+        return -1;
+
+    uint32_t bits = map->dirty ? map->dirty_bits : 0;
+    size_t nranges = (size_t)1 << bits, words = (nranges + 63) / 64;
+
+    uint8_t h[CKPT_HEADER] = { 0 };
+    memcpy(h, CKPT_MAGIC, 8);
+    put_le32(h + 8, CKPT_VERSION);
+    put_le32(h + 12, (full ? CKPT_FULL : 0) | (codec ? CKPT_CODEC : 0));
+    put_le64(h + 16, gen);
+    put_le32(h + 24, bits);
+    put_le32(h + 28, crc32c(0, h, 28));
+    if (write_full(fd, h, CKPT_HEADER) != 0)
+        return -1;
+
+    struct ckpt_writer w = {
+        .map = map, .fd = fd, .slot = slot, .quiesce = quiesce && map->qsbr,
+        .codec = codec,
+    };
+    uint64_t *taken = map->dirty ? calloc(words, sizeof(*taken)) : NULL;
+    if ((map->dirty && !taken) ||
+        pbuf_reserve(&w.buf, CKPT_BLOCK_HDR + DUMP_BLOCK + 2 * VARINT_MAX) != 0) {
+        free(taken);
+        free(w.buf.data);
+        return -1;
+    }
+    w.buf.len = CKPT_BLOCK_HDR;
+
+    int rc = 0;
+    for (size_t r = 0; r < nranges && rc == 0; r++) {
+        if (map->dirty) {
+            _Atomic(uint64_t) *word = &map->dirty[r / 64];
+            uint64_t bit = (uint64_t)1 << (r % 64);
+            uint64_t seen = atomic_load_explicit(word, memory_order_relaxed);
+            if (!full && !seen) {
+                r |= 63;  /* 64 clean ranges */
+                continue;
+            }
+            if (!full && !(seen & bit))
+                continue;
+            /* Clear, then walk: see "Dirty ranges" */
+            if (atomic_fetch_and_explicit(word, ~bit, memory_order_relaxed) & bit)
+                taken[r / 64] |= bit;
+            atomic_thread_fence(memory_order_seq_cst);
+        }
+        rc = ckpt_range(&w, bits, r);
+    }
+
+    if (rc == 0) {
+        w.range = CKPT_END;
+        put_le64(w.buf.data + CKPT_BLOCK_HDR, w.total);
+        put_le64(w.buf.data + CKPT_BLOCK_HDR + 8, w.ranges);
+        w.buf.len = CKPT_BLOCK_HDR + 16;
+        rc = ckpt_flush(&w);
+    }
+    if (rc == 0 && fdatasync(fd) != 0 && errno != EINVAL)
+        rc = -1;  /* EINVAL: a pipe or socket, nothing to sync */
+
+    if (rc == 0) {
+        atomic_store(&map->ckpt_gen, gen);
+    } else if (map->dirty) {
+        for (size_t i = 0; i < words; i++)
+            if (taken[i])
+                atomic_fetch_or_explicit(&map->dirty[i], taken[i], memory_order_relaxed);
+    }
+    free(taken);
+    free(w.buf.data);
+    return rc;
+}
+
+int hashmap_checkpoint(hashmap_t *map, int fd, const hashmap_codec_t *codec,
+                       bool full)
+{
+    uint64_t gen;
+    if (map->hazard_mode || (!full && !map->dirty) || !ckpt_claim(map, &gen))
+        return -1;
+    int rc = ckpt_write(map, tls_epoch_slot, false, fd, codec, full, gen);
+    ckpt_release(map);
+    return rc;
+}
+
+static void *ckpt_main(void *arg)
+{
+    struct hm_ckpt *c = arg;
+    int slot = hashmap_thread_register(c->map);
+    c->rc = ckpt_write(c->map, slot, true, c->fd, c->codec, c->full, c->gen);
+    if (slot >= 0)
+        hashmap_thread_unregister(c->map, slot);
+    return NULL;
+}
+
+int hashmap_checkpoint_start(hashmap_t *map, int fd, const hashmap_codec_t *codec,
+                             bool full)
+{
+    uint64_t gen;
+    if (map->hazard_mode || (!full && !map->dirty) || !ckpt_claim(map, &gen))
+        return -1;
+    struct hm_ckpt *c = calloc(1, sizeof(*c));
+    if (!c) {
+        ckpt_release(map);
+        return -1;
+    }
+    *c = (struct hm_ckpt){ .map = map, .fd = fd, .codec = codec, .full = full,
+                           .gen = gen };
+    if (pthread_create(&c->thread, NULL, ckpt_main, c) != 0) {
+        free(c);
+        ckpt_release(map);
+        return -1;
+    }
+    atomic_store(&map->ckpt, c);
+    return 0;
+}
+
+int hashmap_checkpoint_wait(hashmap_t *map)
+{
+    struct hm_ckpt *c = atomic_exchange(&map->ckpt, NULL);
+    if (!c) return 0;
+    pthread_join(c->thread, NULL);
+    int rc = c->rc;
+    free(c);
+    ckpt_release(map);
+    return rc;
+}
+
+static int ckpt_sink_key(void *ctx, const struct hm_node *node, void *value)
+{
+    (void)value;
+    pbuf_t *keys = ctx;
+    if (pbuf_reserve(keys, sizeof(uint64_t)) != 0)
+        return -1;
+    memcpy(keys->data + keys->len, &node->key, sizeof(uint64_t));
+    keys->len += sizeof(uint64_t);
+    return 0;
+}
+
+static bool ckpt_sink_never(void *ctx)
+{
+    (void)ctx;
+    return false;
+}
+
+/* Remove the map's keys in range r */
+static int ckpt_clear(hashmap_t *map, int slot, uint32_t bits, size_t r)
+{
+    uint64_t lo, hi;
+    ckpt_bounds(bits, r, &lo, &hi);
+    pbuf_t keys = { 0 };
+    struct walk_sink sink = { ckpt_sink_key, ckpt_sink_never, NULL, &keys };
+    int rc = walk_live(map, slot, lo, hi, &sink);
+    for (size_t i = 0; rc == 0 && i < keys.len; i += sizeof(uint64_t)) {
+        uint64_t key;
+        memcpy(&key, keys.data + i, sizeof(key));
+        hashmap_remove(map, key);
+    }
+    free(keys.data);
+    return rc;
+}
+
+/* Put one block's entries, all of which must belong to range r */
+static int ckpt_block(hashmap_t *map, uint32_t bits, size_t r, const uint8_t *p,
+                      const uint8_t *end, uint32_t entries,
+                      const hashmap_codec_t *codec)
+{
+    for (uint32_t i = 0; i < entries; i++) {
+        uint64_t key, word;
+        if (varint_get(&p, end, &key) != 0 || varint_get(&p, end, &word) != 0)
+            return -1;
+        void *val = (void *)(uintptr_t)word;
+        if (codec) {
+            if (word > (uint64_t)(end - p))
+                return -1;
+            val = codec->decode(p, (size_t)word, codec->arg);
+            p += word;
+        }
+        if (key == 0 || !val || dirty_range(bits, make_so_regular(key)) != r) {
+            if (codec && val && map->value_free)
+                map->value_free(val);
+            return -1;
+        }
+        hashmap_put(map, key, val);
+    }
+    return p == end ? 0 : -1;
+}
+
+/* After a restored range: it matches the chain, so it is clean */
+static void ckpt_restored(hashmap_t *map, uint32_t bits, int64_t r)
+{
+    if (r < 0 || !map->dirty || map->dirty_bits != bits)
+        return;
+    atomic_fetch_and_explicit(&map->dirty[r / 64], ~((uint64_t)1 << (r % 64)),
+                              memory_order_relaxed);
+}
+
+int hashmap_checkpoint_apply(hashmap_t *map, int fd, const hashmap_codec_t *codec)
+{
+    int slot = tls_epoch_slot;
+    if (map->hazard_mode || slot < 0)
+        return -1;
+
+    uint8_t h[CKPT_HEADER];
+    if (read_full(fd, h, CKPT_HEADER) != 0 || memcmp(h, CKPT_MAGIC, 8) != 0 ||
+        get_le32(h + 28) != crc32c(0, h, 28) || get_le32(h + 8) != CKPT_VERSION)
+        return -1;
+    uint32_t flags = get_le32(h + 12), bits = get_le32(h + 24);
+    uint64_t gen = get_le64(h + 16);
+    bool coded = flags & CKPT_CODEC;
+    if (coded != (codec != NULL) || (map->value_free && !codec) ||
+        bits > CKPT_RANGE_BITS_MAX ||
+        (!(flags & CKPT_FULL) && gen != atomic_load(&map->ckpt_gen) + 1))
+        return -1;
+    size_t nranges = (size_t)1 << bits;
+
+    pbuf_t buf = { 0 };
+    int64_t range = -1;         /* Range being restored */
+    uint64_t total = 0, ranges = 0;
+    int rc = 0;
+    for (;;) {
+        uint8_t bh[CKPT_BLOCK_HDR];
+        if (read_full(fd, bh, CKPT_BLOCK_HDR) != 0) {
+            rc = -1;
+            break;
+        }
+        uint32_t r = get_le32(bh), entries = get_le32(bh + 4), len = get_le32(bh + 8);
+        buf.len = 0;
+        if (len > DUMP_BLOCK_MAX || pbuf_reserve(&buf, len) != 0 ||
+            read_full(fd, buf.data, len) != 0 ||
+            crc32c(crc32c(0, bh, 12), buf.data, len) != get_le32(bh + 12)) {
+            rc = -1;
+            break;
+        }
+        if (r != range)
+            ckpt_restored(map, bits, range);
+        if (r == CKPT_END) {
+            if (len != 16 || get_le64(buf.data) != total ||
+                get_le64(buf.data + 8) != ranges)
+                rc = -1;
+            break;
+        }
+        if (r >= nranges || (int64_t)r < range) {
+            rc = -1;
+            break;
+        }
+        if (r != range) {
+            range = r;
+            ranges++;
+            if ((rc = ckpt_clear(map, slot, bits, r)) != 0)
+                break;
+        }
+        if ((rc = ckpt_block(map, bits, r, buf.data, buf.data + len, entries, codec)) != 0)
+            break;
+        total += entries;
+    }
+    free(buf.data);
+
+    if (rc == 0)
+        atomic_store(&map->ckpt_gen, gen);
+    return rc;
 }
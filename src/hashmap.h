@@ -8,6 +8,7 @@
  * - Lock-free get/put/remove via CAS
  * - Amortized resize without stop-the-world rehash
  * - Split ordering: elements sorted by bit-reversed hash
+ * - Optional MVCC snapshot mode for point-in-time read views
  *
  * Author: G.H. Murray
  * Date:   2026-02-17
@@ -18,17 +19,32 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdbool.h>
 #include <stdatomic.h>
 
 #include "epoch.h"
+#include "hazard.h"
+#include "latency.h"
 
 /* Initial capacity (must be power of 2) */
 #define HASHMAP_INIT_CAP    16
 
-/* Load factor threshold for resize (percentage) */
+/* Default load factor threshold for resize (percentage) */
 #define HASHMAP_LOAD_FACTOR 75
 
+/* Histogram bins in hashmap_profile_t (the last bin counts >= BINS-1) */
+#define HASHMAP_PROFILE_BINS 16
+
+struct hm_version;  /* MVCC value record (snapshot mode only) */
+struct hm_kept_buckets;  /* Superseded bucket array (hazard mode only) */
+struct hm_thread_stats;  /* Per-slot counters (HASHMAP_STATS builds only) */
+struct hm_lat_slot;      /* Per-slot latency histograms (sampling only) */
+struct hm_thread_mem;    /* Per-slot memory accounting counters */
+struct hm_wal;           /* Write-ahead log and its value codec */
+struct hm_ckpt;          /* Checkpoint writer thread in flight */
+struct numa_arena;       /* Node memory under NUMA placement or hugepages */
+
 /*
  * struct hm_node — A node in the lock-free sorted linked list.
  *
@@ -39,11 +55,179 @@
 struct hm_node {
     _Atomic(uintptr_t)  next;       /* next ptr | mark bit in LSB       */
     uint64_t            key;        /* Original key (0 = sentinel)       */
-    uint64_t            so_key;     /* Split-ordered key (bit-reversed)  */
+    _Alignas(16)                    /* value + seq: one 16-byte CAS word */
     _Atomic(void *)     value;      /* User value (NULL = deleted/dummy) */
+    union {
+        _Atomic(struct hm_version *) versions; /* MVCC chain (snapshots) */
+        _Atomic(uint64_t) seq;      /* value's log number (default mode) */
+    };
+    uint64_t            so_key;     /* Split-ordered key (bit-reversed)  */
     bool                is_dummy;   /* true for bucket sentinel nodes    */
 };
 
+/*
+ * Memory reclamation backend.
+ *
+ * EPOCH (default) is cheapest per operation, but a thread preempted
+ * inside an operation holds back every free until it resumes. HAZARD
+ * protects only the nodes each operation is touching, so garbage stays
+ * bounded under preemption at the cost of a fence per node visited.
+ */
+enum hashmap_reclaim {
+    HASHMAP_RECLAIM_EPOCH = 0,
+    HASHMAP_RECLAIM_HAZARD,
+};
+
+/* Destructor for values owned by the map (see value_free) */
+typedef void (*hashmap_value_free_fn)(void *value);
+
+/*
+ * NUMA placement of nodes and bucket arrays. Every policy but OFF takes
+ * nodes from per-NUMA-node arenas, and a reclaimed node goes back to
+ * the arena of the node its memory is on, not the reclaiming thread's.
+ */
+enum hashmap_numa {
+    HASHMAP_NUMA_OFF,         /* malloc: first touch by the allocating thread */
+    HASHMAP_NUMA_LOCAL,       /* Nodes on the inserting thread's NUMA node    */
+    HASHMAP_NUMA_INTERLEAVE,  /* Nodes and bucket arrays page-interleaved     */
+    HASHMAP_NUMA_BUCKET,      /* Nodes homed by split-order range, arrays
+                                 interleaved; see hashmap_numa_home          */
+};
+
+/*
+ * Page size behind nodes and large bucket arrays. Either hugepage kind
+ * puts nodes in 2 MB arenas as NUMA placement does (and bucket arrays
+ * of 1 MB and up in mappings of their own), so a random lookup in a
+ * large map touches a few TLB entries instead of one per node visited.
+ */
+enum hashmap_hugepages {
+    HASHMAP_HUGEPAGES_OFF,          /* malloc'd, base pages                 */
+    HASHMAP_HUGEPAGES_TRANSPARENT,  /* madvise(MADV_HUGEPAGE): THP must be
+                                       "madvise" or "always"               */
+    HASHMAP_HUGEPAGES_EXPLICIT,     /* MAP_HUGETLB from the reserved pool
+                                       (vm.nr_hugepages), transparent when
+                                       it runs out                         */
+};
+
+/*
+ * hashmap_config_t — Creation-time options (zero-initialize for defaults).
+ */
+typedef struct hashmap_config {
+    /*
+     * Reclamation backend. The options below marked EBR only are
+     * ignored under HASHMAP_RECLAIM_HAZARD, and snapshots are rejected.
+     */
+    enum hashmap_reclaim reclaim;
+
+    /*
+     * MVCC snapshot mode: every update pushes a stamped version record
+     * instead of overwriting in place, and removes leave tombstones until
+     * no open snapshot can see the removed value. Enables
+     * hashmap_snapshot_begin() at the cost of one allocation per update.
+     */
+    bool snapshots;
+
+    /*
+     * EBR only. Free retired nodes on a background thread instead of
+     * inside the next epoch_enter of whichever thread finds them
+     * expired, keeping bulk frees off the get/put path. With
+     * pin_reclaimer set, the thread runs on reclaim_cpu only.
+     */
+    bool background_reclaim;
+    bool pin_reclaimer;
+    int  reclaim_cpu;
+
+    /*
+     * EBR only. Free at most this many retired objects per operation,
+     * carrying the rest forward (0 = free each expired list at once).
+     */
+    uint32_t reclaim_batch;
+
+    /*
+     * Recycle reclaimed nodes through a per-thread pool that inserts
+     * allocate from, instead of free() + calloc().
+     */
+    bool node_pool;
+
+    /*
+     * EBR only. Retire pressure: a thread with retire_limit unreclaimed
+     * nodes, or a map with retire_ceiling, forces an epoch advance. If
+     * the ceiling is still exceeded, on_stall(stall_arg, slot, pending)
+     * names the slot holding the epoch back (see epoch_set_pressure).
+     * 0 = no limit.
+     */
+    uint32_t       retire_limit;
+    size_t         retire_ceiling;
+    epoch_stall_fn on_stall;
+    void          *stall_arg;
+
+    /*
+     * EBR only. Drop the full fence from every operation's epoch_enter
+     * and let the (rarer) epoch advance fence all threads with
+     * membarrier instead; suits read-dominated maps. Without kernel
+     * support the map keeps full fences (epoch.asymmetric stays false).
+     */
+    bool asymmetric_fences;
+
+    /*
+     * EBR only. Quiescent-state-based reclamation: get/put/remove make
+     * no epoch announcement at all; instead each registered thread
+     * calls hashmap_quiescent() whenever it holds no references (e.g.
+     * once per event-loop iteration) and hashmap_thread_offline() before
+     * blocking. A thread that does neither stalls reclamation.
+     */
+    bool qsbr;
+
+    /*
+     * EBR only. Map-owned values: a value displaced by put, replace_if,
+     * remove, remove_if or compute is retired with this destructor and
+     * destroyed once no reader can hold it; hashmap_destroy destroys the
+     * values still present. Readers keep a value valid beyond the call
+     * that returned it with hashmap_enter/exit (or, under QSBR, until
+     * their next quiescent report), so no per-read refcount is needed.
+     * A value the map declines (failed put_if_absent or replace_if)
+     * stays the caller's; a value must not be stored twice.
+     */
+    hashmap_value_free_fn value_free;
+
+    /*
+     * Resize threshold in live keys per 100 buckets (0 = the default
+     * HASHMAP_LOAD_FACTOR). Higher saves bucket memory at the cost of
+     * longer runs; hashmap_profile shows the trade-off on real data.
+     */
+    uint32_t load_factor;
+
+    /*
+     * Latency sampling: time 1 in sample_every operations (rounded up
+     * to a power of two; 0 = off) with the cycle counter, recording the
+     * whole call and its epoch_enter (reclamation included) separately
+     * into per-thread HDR histograms read by hashmap_latency(). Threads
+     * allocate their histograms (~70 KB) on their first sample.
+     */
+    uint32_t sample_every;
+
+    /*
+     * Incremental checkpoints: split the list into this many ranges
+     * (rounded up to a power of two, at most 2^24; 0 = off) — range r
+     * runs from the sentinel of the r-th bucket in split order at that
+     * many buckets to the next — and keep one dirty bit per range, set
+     * by every update that changes the map, so hashmap_checkpoint can
+     * rewrite just the changed ranges. A few thousand suits most maps.
+     */
+    uint32_t checkpoint_ranges;
+
+    /*
+     * NUMA placement (default OFF). Under BUCKET, the list is cut into
+     * one contiguous run per NUMA node, so each lookup stays on its
+     * key's home node; route work by hashmap_numa_home to keep it local.
+     * node_pool is ignored: the arenas keep per-thread caches of their own.
+     */
+    enum hashmap_numa numa;
+
+    /* Hugepage backing (default OFF); combines with any numa policy */
+    enum hashmap_hugepages hugepages;
+} hashmap_config_t;
+
 /*
  * hashmap_t — The hash map.
  */
@@ -53,8 +237,58 @@ typedef struct hashmap {
     _Atomic(size_t)            count;    /* Number of active elements    */
     struct hm_node             head;     /* List head sentinel           */
     epoch_t                    epoch;    /* EBR for safe memory reclaim  */
+    bool                       node_pool; /* Recycle reclaimed nodes     */
+    bool                       qsbr;      /* Ops skip epoch_enter/exit   */
+    hashmap_value_free_fn      value_free; /* Map owns values (or NULL)  */
+    struct hm_thread_stats    *stats;     /* NULL unless HASHMAP_STATS   */
+    struct hm_thread_mem      *mem;       /* Bytes per category, per slot */
+    uint32_t                   load_factor; /* Resize at count*100/cap   */
+
+    /* Latency sampling (NULL = off) */
+    _Atomic(struct hm_lat_slot *) *lat;       /* EPOCH_MAX_THREADS slots  */
+    uint32_t                   sample_mask;   /* Sample when tick & mask == 0 */
+
+    /* Durability (NULL = off; see hashmap_wal_open) */
+    struct hm_wal             *wal;
+
+    /* Incremental checkpoints (dirty == NULL: not tracked) */
+    _Atomic(uint64_t)         *dirty;         /* One bit per range        */
+    uint32_t                   dirty_bits;    /* log2 of the range count  */
+    _Atomic(uint64_t)          ckpt_gen;      /* Last written or applied  */
+    _Atomic(bool)              ckpt_busy;     /* A writer holds the claim */
+    _Atomic(struct hm_ckpt *)  ckpt;          /* Async writer, or NULL    */
+
+    /* NUMA placement and hugepages (arena == NULL: malloc) */
+    enum hashmap_numa          numa;
+    enum hashmap_hugepages     hugepages;
+    struct numa_arena         *arena;
+    int                        numa_nodes;
+
+    /* Hazard-pointer mode */
+    bool                       hazard_mode;
+    hazard_domain_t            hazard;
+    _Atomic(struct hm_kept_buckets *) kept_buckets; /* Freed at destroy */
+
+    /* MVCC snapshot mode */
+    bool                       snapshots;
+    _Atomic(uint64_t)          version_clock;  /* Next snapshot version   */
+    _Atomic(uint32_t)          snap_active;    /* Open snapshots           */
+    _Atomic(uint64_t)          snap_floor[EPOCH_MAX_THREADS]; /* 0 = none */
 } hashmap_t;
 
+/*
+ * hashmap_snapshot_t — A point-in-time read view (snapshot mode only).
+ *
+ * Holds the owning thread's epoch open from begin to end, so superseded
+ * versions it may still need are retained by EBR. One open snapshot per
+ * registered thread.
+ */
+typedef struct hashmap_snapshot {
+    hashmap_t *map;
+    int        slot;
+    uint64_t   version;   /* Sees updates stamped <= version */
+} hashmap_snapshot_t;
+
 /*
  * hashmap_thread_register — Register calling thread for safe memory reclamation.
  * Must be called once per thread before any get/put/remove. Returns slot id.
@@ -66,11 +300,68 @@ int hashmap_thread_register(hashmap_t *map);
  */
 void hashmap_thread_unregister(hashmap_t *map, int slot);
 
+/*
+ * hashmap_thread_flush — Hand the thread's pending retired nodes to the
+ * map for reclamation by other threads. Call before going idle while
+ * staying registered; otherwise they wait for this thread's next op.
+ * In hazard mode, frees every retired node no thread protects.
+ */
+void hashmap_thread_flush(hashmap_t *map, int slot);
+
+/*
+ * hashmap_quiescent — QSBR mode: declare that the calling thread holds
+ * no pointers obtained from the map (values stay valid as usual). Lets
+ * grace periods complete and frees the thread's expired retires. Also
+ * brings an offline thread back online. No-op in other modes.
+ */
+void hashmap_quiescent(hashmap_t *map, int slot);
+
+/*
+ * hashmap_thread_offline — QSBR mode: stop holding back reclamation
+ * until the next hashmap_quiescent(), e.g. while blocked in poll(). The
+ * thread must not access the map while offline. No-op in other modes.
+ */
+void hashmap_thread_offline(hashmap_t *map, int slot);
+
+/*
+ * hashmap_numa_nodes — NUMA nodes on this host (1 without NUMA support)
+ */
+int hashmap_numa_nodes(void);
+
+/*
+ * hashmap_numa_home — Index of the NUMA node `key`'s node lives on
+ * under HASHMAP_NUMA_BUCKET (a fixed function of the key), or -1 under
+ * other policies. Serving a key from a thread on that node keeps its
+ * whole lookup local.
+ */
+int hashmap_numa_home(const hashmap_t *map, uint64_t key);
+
+/*
+ * hashmap_enter — Open a read-side section on the calling thread
+ *
+ * Values returned by get/put/remove (and nodes) stay valid until the
+ * matching hashmap_exit, even if another thread removes them meanwhile.
+ * Sections nest and are cheap inside one another; each operation in
+ * between skips its own fence. No-op under QSBR (reports delimit
+ * sections) and hazard pointers.
+ */
+void hashmap_enter(hashmap_t *map);
+
+/*
+ * hashmap_exit — Close the section opened by hashmap_enter
+ */
+void hashmap_exit(hashmap_t *map);
+
 /*
  * hashmap_create — Create a new hash map
  */
 hashmap_t *hashmap_create(void);
 
+/*
+ * hashmap_create_with — Create a hash map with options (NULL = defaults)
+ */
+hashmap_t *hashmap_create_with(const hashmap_config_t *cfg);
+
 /*
  * hashmap_destroy — Destroy the hash map and free all nodes
  *
@@ -84,11 +375,29 @@ void hashmap_destroy(hashmap_t *map);
  * @key:   Key (must be non-zero; 0 is reserved for sentinels)
  * @value: Value to associate (must be non-NULL)
  *
- * Returns previous value if key existed, NULL if new insertion.
+ * Returns previous value if key existed, NULL if new insertion. With
+ * value_free set the previous value is retired: it is only valid
+ * inside the caller's hashmap_enter section.
  * Thread-safe, lock-free.
  */
 void *hashmap_put(hashmap_t *map, uint64_t key, void *value);
 
+/*
+ * hashmap_put_if_absent — Insert only if `key` has no value
+ *
+ * Returns NULL if the value was inserted, otherwise the existing value
+ * (left unchanged). Thread-safe, lock-free.
+ */
+void *hashmap_put_if_absent(hashmap_t *map, uint64_t key, void *value);
+
+/*
+ * hashmap_replace_if — Set `key` to `value` only if it maps to `expected`
+ *
+ * Returns true if the value was replaced. Thread-safe, lock-free.
+ */
+bool hashmap_replace_if(hashmap_t *map, uint64_t key,
+                        void *expected, void *value);
+
 /*
  * hashmap_get — Look up a value by key
  *
@@ -100,14 +409,460 @@ void *hashmap_get(hashmap_t *map, uint64_t key);
 /*
  * hashmap_remove — Remove a key from the map
  *
- * Returns the removed value, or NULL if not found.
+ * Returns the removed value, or NULL if not found (retired, as for
+ * hashmap_put, when the map owns values).
  * Thread-safe, lock-free.
  */
 void *hashmap_remove(hashmap_t *map, uint64_t key);
 
+/*
+ * hashmap_remove_if — Remove `key` only if it maps to `expected`
+ *
+ * Returns true if the entry was removed. Thread-safe, lock-free.
+ */
+bool hashmap_remove_if(hashmap_t *map, uint64_t key, void *expected);
+
+/*
+ * hashmap_stats_t — Hot-path counters summed over all threads
+ *
+ * Counted only in builds with -DHASHMAP_STATS (make STATS=1); each
+ * thread bumps its own cache line, so enabled counters cost a few plain
+ * stores per operation and disabled ones nothing.
+ */
+typedef struct hashmap_stats {
+    uint64_t finds;             /* list_find calls                       */
+    uint64_t find_steps;        /* Nodes visited by them                 */
+    uint64_t find_restarts;     /* Searches sent back to a sentinel      */
+    uint64_t unlink_cas_fails;  /* Lost physical-unlink CASes            */
+    uint64_t insert_cas_fails;  /* Lost list_insert CASes                */
+    uint64_t mark_cas_fails;    /* Lost Harris-mark CASes                */
+    uint64_t value_cas_fails;   /* Lost value-word CASes (update races)  */
+    uint64_t bucket_inits;      /* Sentinels inserted lazily             */
+    uint64_t resizes;           /* Bucket-array doublings                */
+    uint64_t retired;           /* Nodes unlinked and retired            */
+    uint64_t max_retire_depth;  /* Deepest per-thread retire backlog     */
+    size_t   unreclaimed;       /* Now: retired, not yet freed (approx)  */
+} hashmap_stats_t;
+
+/*
+ * hashmap_stats — Sum every thread's counters into *out
+ *
+ * Safe to call while other threads operate (counts are then
+ * approximate). Returns 0, or -1 if the map was built without
+ * HASHMAP_STATS, in which case only `unreclaimed` is filled in.
+ */
+int hashmap_stats(hashmap_t *map, hashmap_stats_t *out);
+
+/*
+ * hashmap_memory_t — Bytes held by a map, by category
+ *
+ * Object sizes as requested from malloc (allocator overhead is not
+ * included), kept up to date on every allocation, retire and free
+ * rather than by walking. Values are the caller's and not counted,
+ * owned or not; nodes in a thread's node pool belong to the thread.
+ */
+typedef struct hashmap_memory {
+    size_t nodes;           /* Regular nodes not yet retired (incl. marked) */
+    size_t sentinels;       /* Bucket sentinels (freed only with the map)   */
+    size_t versions;        /* MVCC records not yet retired                 */
+    size_t buckets;         /* Current bucket array                         */
+    size_t retired_buckets; /* Replaced arrays awaiting EBR / kept (hazard) */
+    size_t retired;         /* Retired nodes and records not yet freed      */
+    size_t retire_records;  /* epoch_node / hazard_node wrappers (approx.)  */
+    size_t reclaim_state;   /* epoch_t and hazard domain embedded in the map */
+    size_t fixed;           /* Rest of hashmap_t, counters, histograms      */
+    size_t total;
+} hashmap_memory_t;
+
+/*
+ * hashmap_memory_usage — Sum the per-thread byte counters into *out
+ *
+ * Safe to call while other threads operate; categories are then each
+ * approximate, and retire_records lags by up to EPOCH_PRESSURE_CHUNK
+ * retires per thread, as epoch_unreclaimed. Returns 0.
+ */
+int hashmap_memory_usage(hashmap_t *map, hashmap_memory_t *out);
+
+/*
+ * Sampled operation kinds and phases. PUT covers every update that
+ * stores a value (put, put_if_absent, replace_if, compute), REMOVE the
+ * deletes. ENTER is the part of the call spent entering the epoch,
+ * including any reclamation done there; TOTAL the whole call.
+ */
+enum hashmap_lat_op {
+    HASHMAP_LAT_GET,
+    HASHMAP_LAT_PUT,
+    HASHMAP_LAT_REMOVE,
+    HASHMAP_LAT_OPS
+};
+
+enum hashmap_lat_phase {
+    HASHMAP_LAT_TOTAL,
+    HASHMAP_LAT_ENTER,
+    HASHMAP_LAT_PHASES
+};
+
+/*
+ * hashmap_latency — Merge every thread's samples for (op, phase)
+ *
+ * Lock-free; safe while threads record. Quantiles are in nanoseconds,
+ * within ~3%. Returns 0, or -1 if the map does not sample.
+ */
+int hashmap_latency(hashmap_t *map, enum hashmap_lat_op op,
+                    enum hashmap_lat_phase phase, lat_summary_t *out);
+
+/*
+ * hashmap_compute_fn — Compute a key's new value from its current one
+ * (NULL if absent). Return NULL to remove (or not insert) the key.
+ */
+typedef void *(*hashmap_compute_fn)(uint64_t key, void *old, void *arg);
+
+/*
+ * hashmap_compute — Atomically replace `key`'s value with fn(key, old)
+ *
+ * fn may be called more than once if the update races with another
+ * writer, so it must be free of side effects. Returns the value the key
+ * maps to afterwards (NULL if absent). Thread-safe, lock-free.
+ */
+void *hashmap_compute(hashmap_t *map, uint64_t key,
+                      hashmap_compute_fn fn, void *arg);
+
 /*
  * hashmap_count — Return current number of elements
  */
 size_t hashmap_count(hashmap_t *map);
 
+/*
+ * hashmap_visit_fn — Scan callback, invoked once per live entry.
+ */
+typedef void (*hashmap_visit_fn)(uint64_t key, void *value, void *arg);
+
+/*
+ * hashmap_parallel_for_each — Visit every entry using up to `nthreads` workers
+ *
+ * The list is split at initialized bucket sentinels (whose so_keys
+ * partition the key space) into disjoint segments, which the calling
+ * thread and up to nthreads-1 helper threads consume. Each helper
+ * registers its own epoch slot; `fn` may run concurrently on different
+ * entries and must be thread-safe.
+ *
+ * Weakly consistent: entries inserted or removed during the scan may or
+ * may not be visited, but no entry is visited twice.
+ * Returns 0 on success, -1 on invalid arguments.
+ */
+int hashmap_parallel_for_each(hashmap_t *map, int nthreads,
+                              hashmap_visit_fn fn, void *arg);
+
+/*
+ * hashmap_profile_t — Shape of the list, from one walk
+ *
+ * A run is the regular nodes between a sentinel and the next one: what
+ * a search starting at that sentinel may have to pass. Occupancy counts
+ * live keys per bucket of the current array, whether or not the bucket
+ * has a sentinel yet (its keys then lie in an ancestor's run).
+ */
+typedef struct hashmap_profile {
+    size_t capacity;        /* Bucket array size                          */
+    size_t sentinels;       /* Initialized buckets (sentinels in the list) */
+    size_t live;            /* Regular nodes with a current value         */
+    size_t marked;          /* Harris-marked, not yet unlinked            */
+    size_t dead;            /* Unmarked but valueless (mid-delete/tombstone) */
+    size_t longest_run;     /* Most regular nodes between two sentinels   */
+    double mean_run;        /* Regular nodes per sentinel                 */
+    double expected_steps;  /* Mean nodes passed by a search that hits    */
+    size_t occupancy[HASHMAP_PROFILE_BINS]; /* Buckets with i live keys   */
+    size_t runs[HASHMAP_PROFILE_BINS];      /* Runs of i regular nodes    */
+} hashmap_profile_t;
+
+/*
+ * hashmap_profile — Walk the list once and fill in *out
+ *
+ * Weakly consistent like a scan; safe alongside updates under EBR and
+ * QSBR (the caller should be registered). Returns 0, or -1 for
+ * hazard-pointer maps, whose nodes cannot be walked unprotected, or if
+ * out of memory.
+ */
+int hashmap_profile(hashmap_t *map, hashmap_profile_t *out);
+
+/*
+ * hashmap_profile_json — Write a profile as one JSON object to `f`
+ *
+ * Includes the derived load factor and uninitialized-bucket fraction.
+ * Returns 0, or -1 on a write error.
+ */
+int hashmap_profile_json(const hashmap_profile_t *p, FILE *f);
+
+/*
+ * hashmap_snapshot_begin — Open a consistent read view of the map
+ *
+ * Lock-free and never blocks writers. The calling thread must be
+ * registered and must not already hold an open snapshot on this map.
+ * Returns 0 on success, -1 if the map is not in snapshot mode or the
+ * thread cannot open one.
+ */
+int hashmap_snapshot_begin(hashmap_t *map, hashmap_snapshot_t *snap);
+
+/*
+ * hashmap_snapshot_get — Look up the value `key` had when snap was opened
+ */
+void *hashmap_snapshot_get(const hashmap_snapshot_t *snap, uint64_t key);
+
+/*
+ * hashmap_snapshot_for_each — Visit every entry visible in the snapshot
+ *
+ * Sequential, in split order. Runs on the snapshot's thread.
+ */
+void hashmap_snapshot_for_each(const hashmap_snapshot_t *snap,
+                               hashmap_visit_fn fn, void *arg);
+
+/*
+ * hashmap_snapshot_end — Close the view and release retained versions
+ *
+ * When the last open snapshot closes, tombstones left by removes during
+ * the snapshot are collected in one sweep over the list.
+ */
+void hashmap_snapshot_end(hashmap_snapshot_t *snap);
+
+/*
+ * hashmap_codec_t — Value serialization for dump and load
+ *
+ * encode writes the bytes of `value` to buf if they fit in cap and
+ * returns how many there are (SIZE_MAX on failure); it is called again
+ * with a larger buffer if they did not fit. decode rebuilds a value
+ * from them (NULL on failure). Without a codec, the value word itself
+ * is stored, which suits values that are small integers or handles.
+ */
+typedef struct hashmap_codec {
+    size_t (*encode)(void *value, void *buf, size_t cap, void *arg);
+    void  *(*decode)(const void *buf, size_t len, void *arg);
+    void   *arg;
+} hashmap_codec_t;
+
+/*
+ * hashmap_dump — Write a binary image of the map to `fd`
+ *
+ * Entries are streamed in split order in checksummed blocks. In
+ * snapshot mode the image is exactly one snapshot, and the thread's
+ * epoch stays open for the whole dump; otherwise it is weakly
+ * consistent like a scan, and the epoch is left between blocks so a
+ * slow disk does not hold up reclamation. The calling thread must be
+ * registered (and, in snapshot mode, hold no open snapshot). Returns
+ * 0, or -1 for hazard-pointer maps, on a write error or if the codec
+ * fails.
+ */
+int hashmap_dump(hashmap_t *map, int fd);
+int hashmap_dump_with(hashmap_t *map, int fd, const hashmap_codec_t *codec);
+
+/*
+ * hashmap_load — Rebuild a map from a hashmap_dump image read from `fd`
+ *
+ * One sequential pass with plain stores: nodes are appended in the
+ * order they were dumped, with the bucket array sized for the entry
+ * count up front and the sentinels of occupied buckets linked as they
+ * are reached. `cfg` configures the new map as hashmap_create_with;
+ * `codec` must be given exactly when the dump used one, and is required
+ * for a map that owns its values. Returns NULL if the image is
+ * truncated, fails a checksum or is out of order, or out of memory.
+ */
+hashmap_t *hashmap_load(int fd);
+hashmap_t *hashmap_load_with(int fd, const hashmap_config_t *cfg,
+                             const hashmap_codec_t *codec);
+
+/*
+ * hashmap_frozen_t — An immutable map image mapped read-only
+ *
+ * Written by hashmap_freeze and queried in place: no deserialization,
+ * no registration, no epoch, and the pages are shared through the page
+ * cache by every process that maps the same file. Entries are sorted
+ * by split-ordered key; a table indexed by the top bucket_bits of that
+ * key gives each bucket's range. The image is in host byte order.
+ */
+typedef struct hashmap_frozen {
+    const uint8_t  *base;           /* The mapping                   */
+    size_t          size;
+    uint64_t        count;
+    uint32_t        bucket_bits;
+    bool            blobs;          /* Values are codec bytes        */
+    const uint64_t *offsets;        /* 2^bucket_bits + 1 entry starts */
+    const uint64_t *so_keys;
+    const uint64_t *keys;
+    const uint64_t *values;         /* Words, or blob starts (+1 end) */
+    const uint8_t  *blob;
+} hashmap_frozen_t;
+
+/*
+ * hashmap_freeze — Write a frozen image of the map to `fd`
+ *
+ * Consistency and threading as hashmap_dump. With a codec, each value
+ * is stored as its encoded bytes and read back in place with
+ * hashmap_frozen_get_bytes; without, the value word is stored. Returns
+ * 0, or -1 for hazard-pointer maps, on a write error, out of memory or
+ * if the codec fails.
+ */
+int hashmap_freeze(hashmap_t *map, int fd);
+int hashmap_freeze_with(hashmap_t *map, int fd, const hashmap_codec_t *codec);
+
+/*
+ * hashmap_frozen_open — Map an image read-only (fd may be closed after)
+ *
+ * Checks the header and section sizes only, so opening costs the same
+ * for any size; hashmap_frozen_verify checksums the rest. Returns NULL
+ * if the file is not a frozen image for this host, or on error.
+ */
+hashmap_frozen_t *hashmap_frozen_open(int fd);
+
+/*
+ * hashmap_frozen_get — Value for `key` (NULL if absent), as hashmap_get.
+ * For a codec image, a pointer to the value's bytes in the mapping.
+ */
+void *hashmap_frozen_get(const hashmap_frozen_t *fm, uint64_t key);
+
+/*
+ * hashmap_frozen_get_bytes — The encoded bytes of `key`'s value and
+ * their length (NULL if absent or not a codec image)
+ */
+const void *hashmap_frozen_get_bytes(const hashmap_frozen_t *fm, uint64_t key,
+                                     size_t *len);
+
+/*
+ * hashmap_frozen_count — Number of entries in the image
+ */
+size_t hashmap_frozen_count(const hashmap_frozen_t *fm);
+
+/*
+ * hashmap_frozen_verify — Checksum the whole image: 0 if intact, else -1
+ */
+int hashmap_frozen_verify(const hashmap_frozen_t *fm);
+
+/*
+ * hashmap_frozen_close — Unmap the image
+ */
+void hashmap_frozen_close(hashmap_frozen_t *fm);
+
+/*
+ * Write-ahead log sync policy: when a put or remove's record is on disk
+ */
+enum hashmap_wal_sync {
+    HASHMAP_WAL_SYNC_NONE,      /* Written every interval, never fsynced */
+    HASHMAP_WAL_SYNC_INTERVAL,  /* Written and fdatasynced every interval */
+    HASHMAP_WAL_SYNC_ALWAYS,    /* Before the update returns (group commit) */
+};
+
+typedef struct hashmap_wal_config {
+    enum hashmap_wal_sync  sync;
+    uint32_t               interval_ms;   /* Commit period (0 = 10 ms)      */
+    uint32_t               buffer_bytes;  /* Per-thread buffer (0 = 256 KB) */
+    const hashmap_codec_t *codec;         /* Log value bytes, not words      */
+} hashmap_wal_config_t;
+
+/*
+ * hashmap_wal_open — Recover from the log at `fd`, then log to it
+ *
+ * Replays the log's intact records on top of the map's contents —
+ * typically a hashmap_load of the last checkpoint — dropping a torn
+ * tail, then appends a record of every later update that changes the
+ * map (put, put_if_absent, replace_if, remove, remove_if, compute).
+ * Each thread encodes its records into a buffer of its own with no
+ * lock; a committer thread writes all buffers as one checksummed batch
+ * per commit, so concurrent updates share each write and fdatasync.
+ * Each record's sequence number is CASed in with its update — beside
+ * the node's value as one 16-byte word, or in the version record in
+ * snapshot mode — so replay applies a key's updates in the order they
+ * took effect and updates stay lock-free. An update is visible to
+ * readers as soon as it is applied, before its record is durable, even
+ * under SYNC_ALWAYS.
+ *
+ * The caller must be registered and no other thread may use the map
+ * until this returns. `codec` is required when the map owns its values
+ * and must decode the log's records if it has any. Returns 0, or -1 if
+ * the log is unreadable or not a log, a log is already open, or the
+ * target has no 16-byte CAS and the map is not in snapshot mode.
+ */
+int hashmap_wal_open(hashmap_t *map, int fd, const hashmap_wal_config_t *cfg);
+
+/*
+ * hashmap_wal_sync — Make every update that has returned durable.
+ * Returns 0, or -1 if any log write, sync or record encoding has
+ * failed since the log was opened (such errors are sticky).
+ */
+int hashmap_wal_sync(hashmap_t *map);
+
+/*
+ * hashmap_wal_rotate — Sync the current log, then continue in `fd`
+ *
+ * For checkpoints: rotate, hashmap_dump the map, and once the dump is
+ * on disk the old log can be deleted; recovery loads the dump and
+ * replays the new log, which holds every update the dump may have
+ * missed. Returns 0 or -1 (the old log stays in use).
+ */
+int hashmap_wal_rotate(hashmap_t *map, int fd);
+
+/*
+ * hashmap_wal_close — Commit, sync (unless HASHMAP_WAL_SYNC_NONE) and
+ * stop logging. No other thread may be using the map. The fd stays open.
+ * Called by hashmap_destroy. Returns -1 if the log had failed.
+ */
+int hashmap_wal_close(hashmap_t *map);
+
+/*
+ * hashmap_checkpoint — Write the ranges changed since the last one
+ *
+ * A checkpoint is a chain: one full checkpoint (every range) followed
+ * by deltas, each holding the current contents of just the ranges
+ * whose dirty bit was set, so a quiet map costs a few empty blocks. A
+ * range's bit is cleared before it is walked, and the walk leaves the
+ * epoch between blocks like a live dump, so updates never wait: one
+ * that lands behind the walk sets the bit again and goes into the next
+ * delta. Each range is weakly consistent, as hashmap_dump. The file is
+ * fdatasynced before returning. A delta needs checkpoint_ranges; a
+ * full checkpoint of an untracked map is one range.
+ *
+ * With a write-ahead log, rotate it first; once the checkpoint is on
+ * disk, logs older than the new one can go. The calling thread must be
+ * registered. One checkpoint is written at a time. Returns 0, or -1 for
+ * hazard-pointer maps, while another is being written or has not been
+ * waited for, on a write error or if the codec fails. On a write error
+ * or codec failure, the ranges it had taken are marked dirty again, so
+ * the next delta still covers them.
+ */
+int hashmap_checkpoint(hashmap_t *map, int fd, const hashmap_codec_t *codec,
+                       bool full);
+
+/*
+ * hashmap_checkpoint_start — hashmap_checkpoint on a writer thread of
+ * its own (which registers itself), returning at once. It counts as
+ * being written until hashmap_checkpoint_wait; `codec` must outlive
+ * it. Returns 0, or -1 if another checkpoint is being written (either
+ * way) or the thread cannot be started.
+ */
+int hashmap_checkpoint_start(hashmap_t *map, int fd, const hashmap_codec_t *codec,
+                             bool full);
+
+/*
+ * hashmap_checkpoint_wait — Wait for the started checkpoint and return
+ * its result (0 if none was started). Called by hashmap_destroy.
+ */
+int hashmap_checkpoint_wait(hashmap_t *map);
+
+/*
+ * hashmap_checkpoint_apply — Restore one checkpoint of a chain
+ *
+ * Each range in the file replaces the map's contents of that range.
+ * Restoring is applying the full checkpoint and then each delta in
+ * order (a delta must be the one after the last checkpoint applied);
+ * the map then continues the chain. The caller must be registered and
+ * no other thread may use the map. `codec` as for hashmap_load_with.
+ * Returns 0, or -1 if the file is corrupt, out of order, or on error,
+ * in which case the map may hold part of it.
+ */
+int hashmap_checkpoint_apply(hashmap_t *map, int fd, const hashmap_codec_t *codec);
+
+#ifdef HASHMAP_FAULTS
+/*
+ * Fault injection (test builds): the next n version-record allocations
+ * fail as if out of memory
+ */
+extern _Atomic int hashmap_fault_versions;
+#endif
+
 #endif /* HASHMAP_H */
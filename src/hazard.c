@@ -0,0 +1,211 @@
+/*
+ * hazard.c — Hazard-pointer memory reclamation
+ *
+ * Per-thread retire lists scanned against a sorted snapshot of every
+ * published hazard. Lists of departed threads go to a lock-free orphan
+ * list that the next scanning thread adopts.
+ *
+ * Author: G.H. Murray
+ * Date:   2026-02-17
+ */
+
+#define _GNU_SOURCE
+#include "hazard.h"
+#include "probes.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void hazard_init(hazard_domain_t *d, hazard_free_fn free_fn)
+{
+    memset(d, 0, sizeof(*d));
+    for (int i = 0; i < HAZARD_MAX_THREADS; i++) {
+        for (int j = 0; j < HAZARD_PER_THREAD; j++)
+            atomic_store(&d->threads[i].hp[j], NULL);
+        atomic_store(&d->threads[i].active, false);
+        d->threads[i].retired = NULL;
+        d->threads[i].retired_count = 0;
+    }
+    d->free_fn = free_fn;
+    atomic_store(&d->orphans, NULL);
+    atomic_store(&d->unreclaimed, 0);
+}
+
+static __thread hazard_domain_t *tls_reclaiming;   /* Running a destructor */
+
+static void run_fn(hazard_domain_t *d, hazard_free_fn fn, void *ptr)
+{
+    if (!fn) return;
+    hazard_domain_t *outer = tls_reclaiming;
+    tls_reclaiming = d;
+    fn(ptr);
+    tls_reclaiming = outer;
+}
+
+hazard_domain_t *hazard_reclaiming(void)
+{
+    return tls_reclaiming;
+}
+
+static void free_node(hazard_domain_t *d, struct hazard_node *n)
+{
+    run_fn(d, n->fn, n->ptr);
+    free(n);
+}
+
+void hazard_destroy(hazard_domain_t *d)
+{
+    for (int i = 0; i < HAZARD_MAX_THREADS; i++) {
+        struct hazard_node *n = d->threads[i].retired;
+        while (n) {
+            struct hazard_node *next = n->next;
+            free_node(d, n);
+            n = next;
+        }
+        d->threads[i].retired = NULL;
+        d->threads[i].retired_count = 0;
+    }
+
+    struct hazard_node *n = atomic_exchange(&d->orphans, NULL);
+    while (n) {
+        struct hazard_node *next = n->next;
+        free_node(d, n);
+        n = next;
+    }
+    atomic_store(&d->unreclaimed, 0);
+}
+
+int hazard_register(hazard_domain_t *d)
+{
+    for (int i = 0; i < HAZARD_MAX_THREADS; i++) {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&d->threads[i].active, &expected, true))
+            return i;
+    }
+    return -1;
+}
+
+void hazard_unregister(hazard_domain_t *d, int slot)
+{
+    if (slot < 0 || slot >= HAZARD_MAX_THREADS) return;
+    hazard_thread_t *t = &d->threads[slot];
+
+    hazard_clear(d, slot);
+    hazard_scan(d, slot);
+
+    /* Whatever others still protect outlives us on the orphan list */
+    if (t->retired) {
+        struct hazard_node *tail = t->retired;
+        while (tail->next)
+            tail = tail->next;
+        struct hazard_node *top = atomic_load_explicit(&d->orphans, memory_order_relaxed);
+        do {
+            tail->next = top;
+        } while (!atomic_compare_exchange_weak_explicit(
+                     &d->orphans, &top, t->retired,
+                     memory_order_release, memory_order_relaxed));
+        t->retired = NULL;
+        t->retired_count = 0;
+    }
+
+    atomic_store(&t->active, false);
+}
+
+static int cmp_ptr(const void *a, const void *b)
+{
+    uintptr_t x = *(const uintptr_t *)a, y = *(const uintptr_t *)b;
+    return (x > y) - (x < y);
+}
+
+void hazard_scan(hazard_domain_t *d, int slot)
+{
+    hazard_thread_t *t = &d->threads[slot];
+
+    /* Adopt orphans: taking the whole list at once avoids ABA */
+    if (atomic_load_explicit(&d->orphans, memory_order_relaxed)) {
+        struct hazard_node *o = atomic_exchange_explicit(&d->orphans, NULL,
+                                                         memory_order_acquire);
+        while (o) {
+            struct hazard_node *next = o->next;
+            o->next = t->retired;
+            t->retired = o;
+            t->retired_count++;
+            o = next;
+        }
+    }
+    if (!t->retired)
+        return;
+
+    /* Pairs with hazard_protect: unlinks before this are seen by readers */
+    atomic_thread_fence(memory_order_seq_cst);
+
+    uintptr_t hz[HAZARD_MAX_THREADS * HAZARD_PER_THREAD];
+    size_t nhz = 0;
+    for (int i = 0; i < HAZARD_MAX_THREADS; i++) {
+        for (int j = 0; j < HAZARD_PER_THREAD; j++) {
+            void *p = atomic_load_explicit(&d->threads[i].hp[j], memory_order_acquire);
+            if (p)
+                hz[nhz++] = (uintptr_t)p;
+        }
+    }
+    qsort(hz, nhz, sizeof(hz[0]), cmp_ptr);
+
+    struct hazard_node *keep = NULL;
+    uint32_t kept = 0;
+    int64_t freed = 0;
+    struct hazard_node *n = t->retired;
+    while (n) {
+        struct hazard_node *next = n->next;
+        uintptr_t key = (uintptr_t)n->ptr;
+        if (nhz && bsearch(&key, hz, nhz, sizeof(hz[0]), cmp_ptr)) {
+            n->next = keep;
+            keep = n;
+            kept++;
+        } else {
+            free_node(d, n);
+            freed++;
+        }
+        n = next;
+    }
+    t->retired = keep;
+    t->retired_count = kept;
+    PROBE4(hazard, scan, d, slot, freed, kept);
+
+    if (freed)
+        atomic_fetch_sub_explicit(&d->unreclaimed, freed, memory_order_relaxed);
+}
+
+void hazard_retire(hazard_domain_t *d, int slot, void *ptr)
+{
+    hazard_retire_fn(d, slot, ptr, d->free_fn);
+}
+
+void hazard_retire_fn(hazard_domain_t *d, int slot, void *ptr, hazard_free_fn fn)
+{
+    if (slot < 0 || slot >= HAZARD_MAX_THREADS) {
+        run_fn(d, fn, ptr);
+        return;
+    }
+
+    struct hazard_node *n = malloc(sizeof(*n));
+    if (!n) {
+        run_fn(d, fn, ptr);
+        return;
+    }
+    n->ptr = ptr;
+    n->fn = fn;
+
+    hazard_thread_t *t = &d->threads[slot];
+    n->next = t->retired;
+    t->retired = n;
+    atomic_fetch_add_explicit(&d->unreclaimed, 1, memory_order_relaxed);
+
+    if (++t->retired_count >= HAZARD_SCAN_THRESHOLD)
+        hazard_scan(d, slot);
+}
+
+size_t hazard_unreclaimed(hazard_domain_t *d)
+{
+    int64_t n = atomic_load_explicit(&d->unreclaimed, memory_order_relaxed);
+    return n > 0 ? (size_t)n : 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * hazard.h — Hazard-pointer memory reclamation
+ *
+ * Alternative to epoch.h for maps that must bound garbage even when a
+ * reader is preempted mid-operation. Each thread publishes the few
+ * nodes it is about to dereference; a retired node is freed once no
+ * published hazard points at it. A stalled thread pins at most
+ * HAZARD_PER_THREAD nodes instead of every node retired after it
+ * stalled (Michael, 2004).
+ *
+ * Retire is thread-local; each thread scans the hazards of all others
+ * once its list reaches HAZARD_SCAN_THRESHOLD, so garbage per thread is
+ * bounded by the threshold plus the hazards it sees.
+ *
+ * Author: G.H. Murray
+ * Date:   2026-02-17
+ */
+
+#ifndef HAZARD_H
+#define HAZARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define HAZARD_MAX_THREADS    64
+#define HAZARD_PER_THREAD     4
+#define HAZARD_SCAN_THRESHOLD (2 * HAZARD_PER_THREAD * HAZARD_MAX_THREADS)
+
+/* Callback for freeing a retired node */
+typedef void (*hazard_free_fn)(void *ptr);
+
+struct hazard_node {
+    struct hazard_node *next;
+    void               *ptr;
+    hazard_free_fn      fn;         /* Destructor (NULL = none) */
+};
+
+/*
+ * Per-thread state: published hazards + private retire list
+ */
+typedef struct hazard_thread {
+    _Atomic(void *)     hp[HAZARD_PER_THREAD];
+    _Atomic bool        active;         /* Registered?                 */
+    struct hazard_node *retired;
+    uint32_t            retired_count;
+} hazard_thread_t;
+
+/*
+ * hazard_domain_t — Hazard slots of every thread sharing a structure
+ */
+typedef struct hazard_domain {
+    hazard_thread_t     threads[HAZARD_MAX_THREADS];
+    hazard_free_fn      free_fn;
+    _Atomic(struct hazard_node *) orphans;  /* Lists of departed threads */
+    _Atomic int64_t     unreclaimed;        /* Retired, not yet freed    */
+} hazard_domain_t;
+
+/*
+ * hazard_init — Initialize a domain
+ */
+void hazard_init(hazard_domain_t *d, hazard_free_fn free_fn);
+
+/*
+ * hazard_destroy — Free every retired node (no thread may be active)
+ */
+void hazard_destroy(hazard_domain_t *d);
+
+/*
+ * hazard_register — Claim a slot for the calling thread (-1 if full)
+ */
+int hazard_register(hazard_domain_t *d);
+
+/*
+ * hazard_unregister — Release a slot
+ *
+ * Clears its hazards and frees what it can; nodes still protected by
+ * others go to the orphan list, adopted by the next thread to scan.
+ */
+void hazard_unregister(hazard_domain_t *d, int slot);
+
+/*
+ * hazard_protect — Publish hazard `i` of `slot`
+ *
+ * Sequentially consistent: a caller that re-reads the location `ptr`
+ * came from afterwards and still finds it there knows no scan can free
+ * it until the hazard is cleared.
+ */
+static inline void hazard_protect(hazard_domain_t *d, int slot, int i, void *ptr)
+{
+    atomic_store_explicit(&d->threads[slot].hp[i], ptr, memory_order_seq_cst);
+}
+
+/*
+ * hazard_clear — Drop all of the slot's hazards (end of an operation)
+ */
+static inline void hazard_clear(hazard_domain_t *d, int slot)
+{
+    for (int i = 0; i < HAZARD_PER_THREAD; i++)
+        atomic_store_explicit(&d->threads[slot].hp[i], NULL, memory_order_release);
+}
+
+/*
+ * hazard_retire — Defer freeing of an unlinked node
+ *
+ * Scans once the slot's list reaches HAZARD_SCAN_THRESHOLD. A negative
+ * slot frees immediately (unsafe but prevents leak, as epoch_retire).
+ */
+void hazard_retire(hazard_domain_t *d, int slot, void *ptr);
+
+/*
+ * hazard_retire_fn — Retire with a destructor of its own (NULL = none)
+ * instead of the domain's free_fn, as epoch_retire_fn.
+ */
+void hazard_retire_fn(hazard_domain_t *d, int slot, void *ptr, hazard_free_fn fn);
+
+/*
+ * hazard_scan — Free every node on the slot's list that no thread
+ * protects, adopting orphaned lists first. Only the slot's owner may
+ * call it.
+ */
+void hazard_scan(hazard_domain_t *d, int slot);
+
+/*
+ * hazard_reclaiming — The domain whose destructor is running on the
+ * calling thread, or NULL, as epoch_reclaiming.
+ */
+hazard_domain_t *hazard_reclaiming(void);
+
+/*
+ * hazard_unreclaimed — Retired, not yet freed node count
+ */
+size_t hazard_unreclaimed(hazard_domain_t *d);
+
+#endif /* HAZARD_H */
@@ -0,0 +1,142 @@
+/*
+ * latency.c — HDR latency histograms and cycle-counter calibration
+ *
+ * Author: G.H. Murray
+ * Date:   2026-02-17
+ */
+
+#define _GNU_SOURCE
+#include "latency.h"
+
+#include <string.h>
+#include <pthread.h>
+
+/* ── Calibration ── */
+
+static pthread_once_t calib_once = PTHREAD_ONCE_INIT;
+static double ns_per_tick = 1.0;
+
+static uint64_t mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void calibrate(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t n0 = mono_ns(), t0 = lat_now();
+    struct timespec nap = { .tv_sec = 0, .tv_nsec = 10 * 1000 * 1000 };
+    nanosleep(&nap, NULL);
+    uint64_t n1 = mono_ns(), t1 = lat_now();
+    if (t1 > t0)
+        ns_per_tick = (double)(n1 - n0) / (double)(t1 - t0);
+#endif
+}
+
+double lat_ns(uint64_t ticks)
+{
+    pthread_once(&calib_once, calibrate);
+    return (double)ticks * ns_per_tick;
+}
+
+/* ── Buckets ── */
+
+static size_t bucket_of(uint64_t v)
+{
+    if (v < LAT_SUB_COUNT)
+        return (size_t)v;
+    int e = 63 - __builtin_clzll(v);
+    if (e >= LAT_MAX_BITS)
+        return LAT_BUCKETS - 1;
+    int shift = e - (LAT_SUB_BITS - 1);
+    size_t sub = (size_t)(v >> shift) & (LAT_SUB_COUNT / 2 - 1);
+    return LAT_SUB_COUNT + (size_t)(e - LAT_SUB_BITS) * (LAT_SUB_COUNT / 2) + sub;
+}
+
+/* Largest value that lands in bucket `i` */
+static uint64_t bucket_upper(size_t i)
+{
+    if (i < LAT_SUB_COUNT)
+        return i;
+    size_t j = i - LAT_SUB_COUNT;
+    int e = (int)(j / (LAT_SUB_COUNT / 2)) + LAT_SUB_BITS;
+    uint64_t sub = j % (LAT_SUB_COUNT / 2);
+    int shift = e - (LAT_SUB_BITS - 1);
+    return ((LAT_SUB_COUNT / 2 + sub + 1) << shift) - 1;
+}
+
+/* Owner-only update: no RMW needed */
+static inline void bump(_Atomic uint64_t *c, uint64_t n)
+{
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+void lat_record(lat_hist_t *h, uint64_t ticks)
+{
+    bump(&h->buckets[bucket_of(ticks)], 1);
+    bump(&h->count, 1);
+    bump(&h->sum, ticks);
+
+    uint64_t lo = atomic_load_explicit(&h->min, memory_order_relaxed);
+    if (lo == 0 || ticks < lo)
+        atomic_store_explicit(&h->min, ticks ? ticks : 1, memory_order_relaxed);
+    if (ticks > atomic_load_explicit(&h->max, memory_order_relaxed))
+        atomic_store_explicit(&h->max, ticks, memory_order_relaxed);
+}
+
+void lat_merge(lat_accum_t *dst, const lat_hist_t *src)
+{
+    uint64_t n = atomic_load_explicit(&src->count, memory_order_relaxed);
+    if (!n) return;
+
+    for (size_t i = 0; i < LAT_BUCKETS; i++)
+        dst->buckets[i] += atomic_load_explicit(&src->buckets[i], memory_order_relaxed);
+    dst->count += n;
+    dst->sum += atomic_load_explicit(&src->sum, memory_order_relaxed);
+
+    uint64_t lo = atomic_load_explicit(&src->min, memory_order_relaxed);
+    uint64_t hi = atomic_load_explicit(&src->max, memory_order_relaxed);
+    if (lo && (dst->min == 0 || lo < dst->min))
+        dst->min = lo;
+    if (hi > dst->max)
+        dst->max = hi;
+}
+
+static uint64_t quantile(const lat_accum_t *a, uint64_t total, double q)
+{
+    uint64_t rank = (uint64_t)(q * (double)total);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LAT_BUCKETS; i++) {
+        seen += a->buckets[i];
+        if (seen >= rank) {
+            uint64_t v = bucket_upper(i);
+            return v < a->max ? v : a->max;
+        }
+    }
+    return a->max;
+}
+
+void lat_summarize(const lat_accum_t *a, lat_summary_t *out)
+{
+    memset(out, 0, sizeof(*out));
+
+    /* Buckets, not count: a merge racing a writer may see them differ */
+    uint64_t total = 0;
+    for (size_t i = 0; i < LAT_BUCKETS; i++)
+        total += a->buckets[i];
+    if (!total)
+        return;
+
+    out->count = total;
+    out->mean = lat_ns(a->sum) / (double)a->count;
+    out->min = (uint64_t)lat_ns(a->min);
+    out->p50 = (uint64_t)lat_ns(quantile(a, total, 0.50));
+    out->p90 = (uint64_t)lat_ns(quantile(a, total, 0.90));
+    out->p99 = (uint64_t)lat_ns(quantile(a, total, 0.99));
+    out->p999 = (uint64_t)lat_ns(quantile(a, total, 0.999));
+    out->max = (uint64_t)lat_ns(a->max);
+}
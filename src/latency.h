@@ -0,0 +1,109 @@
+/*
+ * latency.h — Cycle-counter timestamps and HDR latency histograms
+ *
+ * lat_now() reads the TSC (rdtsc after an lfence, so earlier loads have
+ * completed; rdtscp at the end of a timed region) on x86-64, and the
+ * monotonic clock elsewhere. lat_ns() converts using a ratio calibrated
+ * once against CLOCK_MONOTONIC; the TSC is assumed invariant.
+ *
+ * lat_hist_t is a log-linear (HDR-style) histogram: values below
+ * LAT_SUB_COUNT are exact, and each power-of-two range above is split
+ * into LAT_SUB_COUNT / 2 buckets, so any recorded value is known to
+ * within ~3%. A histogram has one writer, its owning thread, which
+ * updates it with relaxed load + store; readers merge any number of
+ * them with relaxed loads while they are being written.
+ *
+ * Author: G.H. Murray
+ * Date:   2026-02-17
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define LAT_SUB_BITS  6
+#define LAT_SUB_COUNT (1 << LAT_SUB_BITS)
+#define LAT_MAX_BITS  48        /* Values up to 2^48 cycles (~1 day) */
+#define LAT_BUCKETS   (LAT_SUB_COUNT + (LAT_MAX_BITS - LAT_SUB_BITS) * (LAT_SUB_COUNT / 2))
+
+typedef struct lat_hist {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t min;       /* 0 = no sample yet */
+    _Atomic uint64_t max;
+    _Atomic uint64_t buckets[LAT_BUCKETS];
+} lat_hist_t;
+
+/*
+ * Summary of one or more merged histograms, in nanoseconds
+ */
+typedef struct lat_summary {
+    uint64_t count;
+    double   mean;
+    uint64_t min, p50, p90, p99, p999, max;
+} lat_summary_t;
+
+/* Timestamp at the start of a timed region */
+static inline uint64_t lat_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_lfence();
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/* Timestamp at the end of a timed region (waits for it to retire) */
+static inline uint64_t lat_now_end(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned aux;
+    uint64_t t = __rdtscp(&aux);
+    _mm_lfence();
+    return t;
+#else
+    return lat_now();
+#endif
+}
+
+/*
+ * lat_ns — Convert a lat_now() difference to nanoseconds
+ *
+ * The first call calibrates the counter (~10 ms); later calls are cheap.
+ */
+double lat_ns(uint64_t ticks);
+
+/*
+ * lat_record — Add a sample (owner thread only)
+ */
+void lat_record(lat_hist_t *h, uint64_t ticks);
+
+/*
+ * lat_merge — Add `src` into the plain accumulator `dst` (LAT_BUCKETS
+ * counts plus count/sum/min/max), safe while src is being written.
+ */
+typedef struct lat_accum {
+    uint64_t count, sum, min, max;
+    uint64_t buckets[LAT_BUCKETS];
+} lat_accum_t;
+
+void lat_merge(lat_accum_t *dst, const lat_hist_t *src);
+
+/*
+ * lat_summarize — Quantiles of an accumulator, converted to ns. Each
+ * quantile is the upper bound of the bucket it falls in, capped at max.
+ */
+void lat_summarize(const lat_accum_t *a, lat_summary_t *out);
+
+#endif /* LATENCY_H */
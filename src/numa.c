@@ -0,0 +1,348 @@
+/*
+ * numa.c — NUMA topology, page placement and node-homed arenas
+ *
+ * Author: G.H. Murray
+ * Date:   2026-02-17
+ */
+
+#define _GNU_SOURCE
+#include "numa.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/* From <numaif.h>, which ships with libnuma rather than the libc */
+#define MPOL_PREFERRED   1
+#define MPOL_INTERLEAVE  3
+
+/* From <linux/mman.h>, which clashes with <sys/mman.h> on older libcs */
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB     (21 << 26)
+#endif
+
+#define NUMA_MAX_CPUS    4096
+#define NUMA_MAX_ID      1024               /* Kernel node ids we can name */
+#define CHUNK_HEADER     64                 /* struct numa_chunk, padded   */
+
+/* ── Topology ── */
+
+static int     topo_nodes = 1;
+static int     topo_ids[NUMA_MAX_NODES];            /* Index -> kernel id   */
+static int     topo_index[NUMA_MAX_ID];             /* Kernel id -> index   */
+static uint8_t topo_cpu[NUMA_MAX_CPUS];             /* CPU -> index         */
+static pthread_once_t topo_once = PTHREAD_ONCE_INIT;
+
+/* Parse a sysfs list such as "0-3,8,10-11", calling fn for each number */
+static void parse_list(const char *path, void (*fn)(int n, void *arg), void *arg)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+    int lo, hi;
+    char sep;
+    while (fscanf(f, "%d", &lo) == 1) {
+        hi = lo;
+        if (fscanf(f, "%c", &sep) == 1 && sep == '-') {
+            if (fscanf(f, "%d", &hi) != 1)
+                break;
+            if (fscanf(f, "%c", &sep) != 1)
+                sep = '\n';
+        }
+        for (int n = lo; n <= hi; n++)
+            fn(n, arg);
+        if (sep != ',')
+            break;
+    }
+    fclose(f);
+}
+
+struct node_list {
+    int ids[NUMA_MAX_ID];
+    int count;
+};
+
+static void add_node(int id, void *arg)
+{
+    struct node_list *l = arg;
+    if (id >= 0 && id < NUMA_MAX_ID && l->count < NUMA_MAX_ID)
+        l->ids[l->count++] = id;
+}
+
+static void add_cpu(int cpu, void *arg)
+{
+    if (cpu >= 0 && cpu < NUMA_MAX_CPUS)
+        topo_cpu[cpu] = (uint8_t)*(int *)arg;
+}
+
+static void topo_init(void)
+{
+    static struct node_list l;
+    parse_list("/sys/devices/system/node/online", add_node, &l);
+    if (l.count == 0)
+        return;   /* no NUMA support: one node, id 0 */
+    topo_nodes = l.count < NUMA_MAX_NODES ? l.count : NUMA_MAX_NODES;
+
+    for (int i = 0; i < l.count; i++) {
+        int index = i % NUMA_MAX_NODES;   /* past the limit, share pools */
+        if (i < NUMA_MAX_NODES)
+            topo_ids[i] = l.ids[i];
+        topo_index[l.ids[i]] = index;
+
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", l.ids[i]);
+        parse_list(path, add_cpu, &index);
+    }
+}
+
+int numa_node_count(void)
+{
+    pthread_once(&topo_once, topo_init);
+    return topo_nodes;
+}
+
+int numa_current_node(void)
+{
+    pthread_once(&topo_once, topo_init);
+    if (topo_nodes == 1)
+        return 0;
+    int cpu = sched_getcpu();
+    return cpu >= 0 && cpu < NUMA_MAX_CPUS ? topo_cpu[cpu] : 0;
+}
+
+int numa_node_cpus(int index, int *cpus, int max)
+{
+    pthread_once(&topo_once, topo_init);
+    int n = 0;
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int cpu = 0; cpu < NUMA_MAX_CPUS && cpu < online && n < max; cpu++)
+        if (topo_cpu[cpu] == index)
+            cpus[n++] = cpu;
+    return n;
+}
+
+int numa_bind(void *addr, size_t len, int index)
+{
+    pthread_once(&topo_once, topo_init);
+    unsigned long mask[NUMA_MAX_ID / (8 * sizeof(unsigned long))] = { 0 };
+    const int bits = 8 * sizeof(unsigned long);
+    int mode = MPOL_PREFERRED;
+    if (index < 0) {
+        mode = MPOL_INTERLEAVE;
+        for (int i = 0; i < topo_nodes; i++)
+            mask[topo_ids[i] / bits] |= 1ul << (topo_ids[i] % bits);
+    } else {
+        int id = topo_ids[index % topo_nodes];
+        mask[id / bits] |= 1ul << (id % bits);
+    }
+    return syscall(SYS_mbind, addr, len, mode, mask, (unsigned long)NUMA_MAX_ID, 0) == 0
+           ? 0 : -1;
+}
+
+int numa_page_nodes(void *const *addrs, size_t n, int *nodes)
+{
+    pthread_once(&topo_once, topo_init);
+    if (n == 0) return 0;
+    if (syscall(SYS_move_pages, 0, (unsigned long)n, addrs, NULL, nodes, 0) != 0)
+        return -1;
+    for (size_t i = 0; i < n; i++)
+        nodes[i] = nodes[i] >= 0 && nodes[i] < NUMA_MAX_ID ? topo_index[nodes[i]] : -1;
+    return 0;
+}
+
+/* ── Arenas ── */
+
+static struct numa_chunk *chunk_of(const void *p)
+{
+    return (struct numa_chunk *)((uintptr_t)p & ~((uintptr_t)NUMA_CHUNK - 1));
+}
+
+/* `bytes` (a multiple of `align`, a power of two) at an aligned address */
+static uint8_t *map_aligned(size_t bytes, size_t align)
+{
+    size_t span = bytes + align;
+    uint8_t *raw = mmap(NULL, span, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+        return NULL;
+    uint8_t *base = (uint8_t *)(((uintptr_t)raw + align - 1) & ~((uintptr_t)align - 1));
+    if (base > raw)
+        munmap(raw, (size_t)(base - raw));
+    if (raw + span > base + bytes)
+        munmap(base + bytes, (size_t)(raw + span - (base + bytes)));
+    return base;
+}
+
+void *numa_map(size_t bytes, bool interleave, enum numa_pages pages)
+{
+    void *p = NULL;
+    if (pages == NUMA_PAGES_SMALL) {
+        p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return NULL;
+    } else {
+        bytes = (bytes + NUMA_HUGE_PAGE - 1) & ~((size_t)NUMA_HUGE_PAGE - 1);
+        if (pages == NUMA_PAGES_HUGETLB) {
+            p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+            if (p == MAP_FAILED)
+                p = NULL;   /* pool empty or none reserved: go transparent */
+        }
+        if (!p) {
+            if (!(p = map_aligned(bytes, NUMA_HUGE_PAGE)))
+                return NULL;
+            madvise(p, bytes, MADV_HUGEPAGE);   /* advisory */
+        }
+    }
+    if (interleave)
+        numa_bind(p, bytes, -1);   /* best effort, before first touch */
+    return p;
+}
+
+void numa_unmap(void *p, size_t bytes, enum numa_pages pages)
+{
+    if (pages != NUMA_PAGES_SMALL)
+        bytes = (bytes + NUMA_HUGE_PAGE - 1) & ~((size_t)NUMA_HUGE_PAGE - 1);
+    munmap(p, bytes);
+}
+
+/* Map a chunk aligned to its size and bind it before anything touches it */
+static int chunk_new(numa_arena_t *a, int node)
+{
+    uint8_t *base;
+    if (a->pages == NUMA_PAGES_SMALL)
+        base = map_aligned(NUMA_CHUNK, NUMA_CHUNK);
+    else
+        base = numa_map(NUMA_CHUNK, false, a->pages);  /* 2 MB-aligned */
+    if (!base)
+        return -1;
+    if (a->place != NUMA_PLACE_ANY)
+        numa_bind(base, NUMA_CHUNK, a->place == NUMA_PLACE_INTERLEAVE ? -1 : node);
+
+    struct numa_pool *pool = &a->pools[node];
+    struct numa_chunk *c = (struct numa_chunk *)base;
+    c->node = node;
+    c->next = pool->chunks;
+    pool->chunks = c;
+    pool->bump = base + CHUNK_HEADER;
+    pool->end = base + NUMA_CHUNK;
+    return 0;
+}
+
+/* One object from the pool (lock held): a freed one, else carved */
+static void *pool_get(numa_arena_t *a, int node)
+{
+    struct numa_pool *pool = &a->pools[node];
+    void *p = pool->free;
+    if (p) {
+        pool->free = *(void **)p;
+        return p;
+    }
+    if ((size_t)(pool->end - pool->bump) < a->obj && chunk_new(a, node) != 0)
+        return NULL;
+    p = pool->bump;
+    pool->bump += a->obj;
+    return p;
+}
+
+numa_arena_t *numa_arena_create(size_t obj, enum numa_placement place,
+                                enum numa_pages pages)
+{
+    numa_arena_t *a = aligned_alloc(_Alignof(numa_arena_t), sizeof(*a));
+    if (!a) return NULL;
+    memset(a, 0, sizeof(*a));
+    a->obj = (obj + 15) & ~(size_t)15;
+    if (a->obj < sizeof(void *))
+        a->obj = sizeof(void *);
+    a->place = place;
+    a->pages = pages;
+    a->nodes = place == NUMA_PLACE_NODES ? numa_node_count() : 1;
+    for (int i = 0; i < NUMA_MAX_NODES; i++)
+        pthread_mutex_init(&a->pools[i].lock, NULL);
+    return a;
+}
+
+void numa_arena_destroy(numa_arena_t *a)
+{
+    if (!a) return;
+    for (int i = 0; i < NUMA_MAX_NODES; i++) {
+        struct numa_chunk *c = a->pools[i].chunks;
+        while (c) {
+            struct numa_chunk *next = c->next;
+            munmap(c, NUMA_CHUNK);
+            c = next;
+        }
+        pthread_mutex_destroy(&a->pools[i].lock);
+    }
+    free(a);
+}
+
+void *numa_alloc(numa_arena_t *a, int slot, int node)
+{
+    node = (unsigned)node < (unsigned)a->nodes ? node : 0;
+    struct numa_pool *pool = &a->pools[node];
+    void *p;
+
+    if (slot < 0) {
+        pthread_mutex_lock(&pool->lock);
+        p = pool_get(a, node);
+        pthread_mutex_unlock(&pool->lock);
+    } else {
+        struct numa_cache *c = &a->slots[slot].node[node];
+        if (!c->head) {
+            /* Refill a batch under one lock */
+            pthread_mutex_lock(&pool->lock);
+            for (int i = 0; i < NUMA_BATCH; i++) {
+                void *q = pool_get(a, node);
+                if (!q) break;
+                *(void **)q = c->head;
+                c->head = q;
+                c->len++;
+            }
+            pthread_mutex_unlock(&pool->lock);
+        }
+        p = c->head;
+        if (p) {
+            c->head = *(void **)p;
+            c->len--;
+        }
+    }
+    if (p)
+        memset(p, 0, a->obj);
+    return p;
+}
+
+void numa_free(numa_arena_t *a, int slot, void *p)
+{
+    int node = chunk_of(p)->node;
+    struct numa_pool *pool = &a->pools[node];
+
+    if (slot < 0) {
+        pthread_mutex_lock(&pool->lock);
+        *(void **)p = pool->free;
+        pool->free = p;
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+
+    struct numa_cache *c = &a->slots[slot].node[node];
+    *(void **)p = c->head;
+    c->head = p;
+    if (++c->len <= NUMA_CACHE_MAX)
+        return;
+
+    /* Hand a batch back to the node's pool */
+    pthread_mutex_lock(&pool->lock);
+    for (int i = 0; i < NUMA_BATCH; i++) {
+        void *q = c->head;
+        c->head = *(void **)q;
+        *(void **)q = pool->free;
+        pool->free = q;
+    }
+    c->len -= NUMA_BATCH;
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,154 @@
+/*
+ * numa.h — NUMA topology and node-homed object arenas
+ *
+ * The topology is read once from sysfs; placement uses the mbind and
+ * move_pages system calls directly, so there is no libnuma dependency.
+ * On a kernel without NUMA support every call degrades to one node and
+ * binding becomes a no-op.
+ *
+ * An arena hands out fixed-size objects from 2 MB chunks, each bound to
+ * one node (or page-interleaved over all of them) before it is first
+ * touched. Every chunk starts with a header naming its node, so a freed
+ * object goes back to the pool of the node its memory is on, whichever
+ * thread frees it. Each epoch slot keeps a small per-node cache in
+ * front of the pools, touched only by the slot's owner; pools are
+ * locked and exchange objects with the caches in batches. Memory goes
+ * back to the system only when the arena is destroyed.
+ *
+ * Chunks and large mappings can be backed by 2 MB pages: transparent
+ * hugepages (madvise), or explicit ones from the hugetlbfs pool, which
+ * fall back to transparent when the pool is empty. Either way one TLB
+ * entry covers a whole chunk instead of 512.
+ *
+ * Author: G.H. Murray
+ * Date:   2026-02-17
+ */
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "epoch.h"
+
+#define NUMA_MAX_NODES   16                 /* Pools per arena              */
+#define NUMA_CHUNK       (2u << 20)         /* Bound unit, aligned to itself */
+#define NUMA_CACHE_MAX   64                 /* Per slot and node            */
+#define NUMA_BATCH       32                 /* Moved per pool visit         */
+
+/*
+ * numa_node_count — Online nodes (at least 1; at most NUMA_MAX_NODES
+ * are told apart, the rest share pools)
+ */
+int numa_node_count(void);
+
+/*
+ * numa_current_node — Index (0 .. numa_node_count()-1) of the node the
+ * calling thread is running on
+ */
+int numa_current_node(void);
+
+/*
+ * numa_node_cpus — CPUs of node `index` as a list (up to `max`);
+ * returns how many. For pinning threads in benchmarks and tests.
+ */
+int numa_node_cpus(int index, int *cpus, int max);
+
+/*
+ * numa_bind — Place [addr, addr+len) (page-aligned) on node `index`,
+ * preferred rather than strict, or interleave it over all nodes when
+ * index < 0. Pages already touched stay where they are. Returns 0, or
+ * -1 if the kernel refused (placement is then the kernel's default).
+ */
+int numa_bind(void *addr, size_t len, int index);
+
+/*
+ * numa_page_nodes — Node index holding each address's page (-1 if not
+ * resident) in `nodes`. Returns 0, or -1 if the kernel cannot tell.
+ */
+int numa_page_nodes(void *const *addrs, size_t n, int *nodes);
+
+enum numa_pages {
+    NUMA_PAGES_SMALL,        /* Base pages                                   */
+    NUMA_PAGES_THP,          /* madvise(MADV_HUGEPAGE)                        */
+    NUMA_PAGES_HUGETLB,      /* MAP_HUGETLB, else as NUMA_PAGES_THP           */
+};
+
+#define NUMA_HUGE_PAGE   (2u << 20)
+
+/*
+ * numa_map — Zeroed anonymous memory of `bytes` (rounded up to 2 MB for
+ * hugepages, and then 2 MB-aligned), page-interleaved over all nodes
+ * if asked. NULL on failure. numa_unmap must be given the same bytes
+ * and pages.
+ */
+void *numa_map(size_t bytes, bool interleave, enum numa_pages pages);
+void numa_unmap(void *p, size_t bytes, enum numa_pages pages);
+
+/* ── Arenas ── */
+
+enum numa_placement {
+    NUMA_PLACE_ANY,          /* No binding: one pool                          */
+    NUMA_PLACE_NODES,        /* A pool per node, chunks bound to theirs       */
+    NUMA_PLACE_INTERLEAVE,   /* One pool, chunks page-interleaved             */
+};
+
+struct numa_chunk {
+    struct numa_chunk *next;
+    int                node;               /* Pool index                  */
+};
+
+struct numa_pool {
+    _Alignas(64) pthread_mutex_t lock;
+    void              *free;               /* Linked through first word   */
+    uint8_t           *bump, *end;         /* Uncarved rest of the chunk  */
+    struct numa_chunk *chunks;
+};
+
+struct numa_cache {
+    void     *head;
+    uint32_t  len;
+};
+
+struct numa_slot {
+    _Alignas(64) struct numa_cache node[NUMA_MAX_NODES];
+};
+
+typedef struct numa_arena {
+    size_t            obj;                 /* Object size (>= a pointer)  */
+    int               nodes;               /* Pools in use                */
+    enum numa_placement place;
+    enum numa_pages   pages;
+    struct numa_pool  pools[NUMA_MAX_NODES];
+    struct numa_slot  slots[EPOCH_MAX_THREADS];
+} numa_arena_t;
+
+/*
+ * numa_arena_create — An arena of `obj`-byte objects in chunks of the
+ * given pages. `node` arguments matter only under NUMA_PLACE_NODES.
+ * Returns NULL if out of memory.
+ */
+numa_arena_t *numa_arena_create(size_t obj, enum numa_placement place,
+                                enum numa_pages pages);
+
+/*
+ * numa_arena_destroy — Unmap every chunk (outstanding objects included)
+ */
+void numa_arena_destroy(numa_arena_t *a);
+
+/*
+ * numa_alloc — A zeroed object on node `node` (an index), through the
+ * cache of `slot` (or straight from the pool if slot < 0). NULL if out
+ * of memory.
+ */
+void *numa_alloc(numa_arena_t *a, int slot, int node);
+
+/*
+ * numa_free — Return an object to its own node's cache or pool
+ */
+void numa_free(numa_arena_t *a, int slot, void *p);
+
+#endif /* NUMA_H */
@@ -0,0 +1,105 @@
+/*
+ * persist.h — Byte-level helpers for the map's on-disk formats
+ *
+ * CRC32C (Castagnoli, software slicing-by-8), LEB128 varints,
+ * little-endian fixed-width fields, a growable byte buffer, and
+ * read/write loops that retry on EINTR and short transfers.
+ *
+ * Author: G.H. Murray
+ * Date:   2026-02-17
+ */
+
+#ifndef PERSIST_H
+#define PERSIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define VARINT_MAX 10   /* Bytes in the longest uint64_t varint */
+
+/*
+ * crc32c — Extend `crc` (0 to start) over `len` bytes
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+/*
+ * varint_put — Encode `v` at `p` (room for VARINT_MAX); returns length
+ */
+static inline size_t varint_put(uint8_t *p, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+/*
+ * varint_get — Decode from *p, advancing it; -1 if truncated or overlong
+ */
+static inline int varint_get(const uint8_t **p, const uint8_t *end, uint64_t *v)
+{
+    uint64_t x = 0;
+    for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+        uint8_t b = *(*p)++;
+        x |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = x;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static inline void put_le32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static inline void put_le64(uint8_t *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static inline uint32_t get_le32(const uint8_t *p)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++)
+        v |= (uint32_t)p[i] << (8 * i);
+    return v;
+}
+
+static inline uint64_t get_le64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++)
+        v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+/*
+ * pbuf_t — Growable byte buffer (zero-initialize; free data when done)
+ */
+typedef struct pbuf {
+    uint8_t *data;
+    size_t   len;
+    size_t   cap;
+} pbuf_t;
+
+/*
+ * pbuf_reserve — Make room for `extra` more bytes; -1 if out of memory
+ */
+int pbuf_reserve(pbuf_t *b, size_t extra);
+
+/*
+ * write_full / read_full — Transfer exactly `len` bytes. Return 0, or
+ * -1 on error or (read_full) end of file first.
+ */
+int write_full(int fd, const void *buf, size_t len);
+int read_full(int fd, void *buf, size_t len);
+
+#endif /* PERSIST_H */
@@ -0,0 +1,61 @@
+/*
+ * probes.h — Static user-space tracepoints (USDT)
+ *
+ * When <sys/sdt.h> is available (systemtap-sdt-dev / systemtap-sdt-devel)
+ * each PROBE site compiles to one nop plus an ELF note naming it and
+ * locating its arguments; perf and bpftrace attach by patching the nop,
+ * so an untraced probe costs a nop and needs nothing at run time.
+ * Without the header, or with -DHASHMAP_NO_USDT, probes compile away
+ * and their arguments are not evaluated.
+ *
+ * Providers and probes (arguments in order):
+ *
+ *   hashmap:resize_start   map, capacity, count
+ *   hashmap:resize_end     map, new capacity, won (0 = lost the race / OOM)
+ *   hashmap:bucket_init    map, bucket index
+ *   hashmap:find_restart   map, key       (predecessor deleted under us)
+ *   hashmap:insert_retry   map, key       (link CAS lost)
+ *   hashmap:unlink_retry   map, key       (physical unlink CAS lost)
+ *   hashmap:mark_retry     map, key       (logical delete CAS lost)
+ *   hashmap:value_retry    map, key       (value / version CAS lost)
+ *   epoch:advance          epoch, new global epoch
+ *   epoch:reclaim          epoch, objects freed in one batch
+ *   epoch:pressure         epoch, slot, backlog (retire ceiling hit)
+ *   hazard:scan            domain, slot, freed, kept
+ *
+ * Example:
+ *   bpftrace -e 'usdt:./bench:epoch:reclaim { @ = hist(arg1); }'
+ *
+ * Arguments are plain integers and pointers; keep them cheap, they are
+ * computed at every site even when nobody is tracing.
+ *
+ * Author: G.H. Murray
+ * Date:   2026-02-17
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#if !defined(HASHMAP_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HASHMAP_USDT 1
+#endif
+#endif
+
+#ifdef HASHMAP_USDT
+#define PROBE1(prov, name, a)          DTRACE_PROBE1(prov, name, a)
+#define PROBE2(prov, name, a, b)       DTRACE_PROBE2(prov, name, a, b)
+#define PROBE3(prov, name, a, b, c)    DTRACE_PROBE3(prov, name, a, b, c)
+#define PROBE4(prov, name, a, b, c, d) DTRACE_PROBE4(prov, name, a, b, c, d)
+#else
+/* sizeof keeps variables used only by probes "used", without evaluating */
+#define PROBE1(prov, name, a)          ((void)sizeof(a))
+#define PROBE2(prov, name, a, b)       ((void)sizeof(a), (void)sizeof(b))
+#define PROBE3(prov, name, a, b, c)    \
+    ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c))
+#define PROBE4(prov, name, a, b, c, d) \
+    ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c), (void)sizeof(d))
+#endif
+
+#endif /* PROBES_H */
@@ -7,12 +7,16 @@
 
 #define _GNU_SOURCE
 #include "hashmap.h"
+#include "numa.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <pthread.h>
+#include <sched.h>
 #include <time.h>
+#include <unistd.h>
 
 static void test_basic(void)
 {
@@ -106,6 +110,1872 @@ static void test_many_keys(void)
     printf("  PASSED\n\n");
 }
 
+/* ── Conditional updates ── */
+
+static void *incr_fn(uint64_t key, void *old, void *arg)
+{
+    (void)key; (void)arg;
+    return (void *)((uintptr_t)old + 1);
+}
+
+static void *drop_fn(uint64_t key, void *old, void *arg)
+{
+    (void)key; (void)old; (void)arg;
+    return NULL;
+}
+
+static void run_conditional(const char *mode, hashmap_config_t cfg)
+{
+    printf("  [%s mode]\n", mode);
+
+    hashmap_t *map = hashmap_create_with(&cfg);
+    assert(map != NULL);
+    int slot = hashmap_thread_register(map);
+
+    int a = 1, b = 2, c = 3;
+
+    /* put_if_absent */
+    assert(hashmap_put_if_absent(map, 10, &a) == NULL);
+    assert(hashmap_put_if_absent(map, 10, &b) == &a);
+    assert(hashmap_get(map, 10) == &a);
+    assert(hashmap_count(map) == 1);
+    printf("  put_if_absent: OK\n");
+
+    /* replace_if */
+    assert(!hashmap_replace_if(map, 10, &b, &c));
+    assert(hashmap_replace_if(map, 10, &a, &b));
+    assert(hashmap_get(map, 10) == &b);
+    assert(!hashmap_replace_if(map, 11, &a, &b));
+    assert(hashmap_count(map) == 1);
+    printf("  replace_if: OK\n");
+
+    /* remove_if */
+    assert(!hashmap_remove_if(map, 10, &a));
+    assert(hashmap_get(map, 10) == &b);
+    assert(hashmap_remove_if(map, 10, &b));
+    assert(hashmap_get(map, 10) == NULL);
+    assert(hashmap_count(map) == 0);
+    assert(!hashmap_remove_if(map, 10, &b));
+    printf("  remove_if: OK\n");
+
+    /* compute: insert, update, remove */
+    assert(hashmap_compute(map, 20, incr_fn, NULL) == (void *)1);
+    assert(hashmap_compute(map, 20, incr_fn, NULL) == (void *)2);
+    assert(hashmap_get(map, 20) == (void *)2);
+    assert(hashmap_count(map) == 1);
+    assert(hashmap_compute(map, 20, drop_fn, NULL) == NULL);
+    assert(hashmap_get(map, 20) == NULL);
+    assert(hashmap_compute(map, 21, drop_fn, NULL) == NULL);
+    assert(hashmap_count(map) == 0);
+
+    /* Re-insert after remove */
+    assert(hashmap_put_if_absent(map, 10, &c) == NULL);
+    assert(hashmap_get(map, 10) == &c);
+    printf("  compute: OK\n");
+
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+}
+
+static void test_conditional(void)
+{
+    printf("=== test_conditional ===\n");
+    run_conditional("default", (hashmap_config_t){ 0 });
+    run_conditional("snapshot", (hashmap_config_t){ .snapshots = true });
+    run_conditional("hazard", (hashmap_config_t){ .reclaim = HASHMAP_RECLAIM_HAZARD });
+    run_conditional("qsbr", (hashmap_config_t){ .qsbr = true });
+    printf("  PASSED\n\n");
+}
+
+#define CNT_THREADS 4
+#define CNT_KEYS    16
+#define CNT_INCRS   20000
+
+struct counter_args {
+    hashmap_t *map;
+    int        first_inserts;  /* put_if_absent wins */
+};
+
+static void *counter_worker(void *arg)
+{
+    struct counter_args *a = arg;
+    int slot = hashmap_thread_register(a->map);
+
+    /* Every thread races to claim the dedup keys; exactly one wins each */
+    for (uint64_t k = 1000; k < 1000 + CNT_KEYS; k++)
+        if (hashmap_put_if_absent(a->map, k, a) == NULL)
+            a->first_inserts++;
+
+    for (int i = 0; i < CNT_INCRS; i++) {
+        hashmap_compute(a->map, (uint64_t)(i % CNT_KEYS) + 1, incr_fn, NULL);
+        if (i % 64 == 0)
+            hashmap_quiescent(a->map, slot);  /* no-op outside QSBR */
+    }
+
+    hashmap_thread_unregister(a->map, slot);
+    return NULL;
+}
+
+static void run_compute_counters(const char *mode, hashmap_config_t cfg)
+{
+    hashmap_t *map = hashmap_create_with(&cfg);
+    assert(map != NULL);
+
+    pthread_t threads[CNT_THREADS];
+    struct counter_args args[CNT_THREADS];
+    for (int i = 0; i < CNT_THREADS; i++) {
+        args[i].map = map;
+        args[i].first_inserts = 0;
+        pthread_create(&threads[i], NULL, counter_worker, &args[i]);
+    }
+
+    int claimed = 0;
+    for (int i = 0; i < CNT_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        claimed += args[i].first_inserts;
+    }
+
+    int slot = hashmap_thread_register(map);
+    uintptr_t total = 0;
+    for (uint64_t k = 1; k <= CNT_KEYS; k++)
+        total += (uintptr_t)hashmap_get(map, k);
+    printf("  [%s mode] %d threads × %d increments: total %lu, %d/%d dedup claims\n",
+           mode, CNT_THREADS, CNT_INCRS,
+           (unsigned long)total, claimed, CNT_KEYS);
+    assert(total == (uintptr_t)CNT_THREADS * CNT_INCRS);
+    assert(claimed == CNT_KEYS);
+    assert(hashmap_count(map) == 2 * CNT_KEYS);
+
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+}
+
+static void test_compute_counters(void)
+{
+    printf("=== test_compute_counters ===\n");
+    run_compute_counters("default", (hashmap_config_t){ 0 });
+    run_compute_counters("snapshot", (hashmap_config_t){ .snapshots = true });
+    run_compute_counters("hazard", (hashmap_config_t){ .reclaim = HASHMAP_RECLAIM_HAZARD });
+    run_compute_counters("qsbr", (hashmap_config_t){ .qsbr = true });
+    printf("  PASSED\n\n");
+}
+
+/* ── Updates out of memory ── */
+
+static void *count_calls(uint64_t key, void *old, void *arg)
+{
+    (void)key;
+    (*(int *)arg)++;
+    return (void *)((uintptr_t)old + 1);
+}
+
+/* A failed version-record allocation fails the update; it never spins */
+static void test_update_nomem(void)
+{
+    printf("=== test_update_nomem ===\n");
+
+    hashmap_config_t cfg = { .snapshots = true };
+    hashmap_t *map = hashmap_create_with(&cfg);
+    int slot = hashmap_thread_register(map);
+    hashmap_put(map, 1, (void *)10);
+
+    atomic_store(&hashmap_fault_versions, 1);
+    hashmap_put(map, 1, (void *)11);
+    assert(hashmap_get(map, 1) == (void *)10);
+
+    atomic_store(&hashmap_fault_versions, 1);
+    assert(hashmap_remove(map, 1) == NULL);          /* nothing removed */
+    assert(hashmap_get(map, 1) == (void *)10);
+
+    atomic_store(&hashmap_fault_versions, 1);
+    assert(!hashmap_replace_if(map, 1, (void *)10, (void *)12));
+
+    int calls = 0;
+    atomic_store(&hashmap_fault_versions, 1);
+    hashmap_compute(map, 1, count_calls, &calls);
+    assert(calls == 1);
+    assert(hashmap_get(map, 1) == (void *)10);
+
+    atomic_store(&hashmap_fault_versions, 1);
+    hashmap_put(map, 2, (void *)20);                 /* insert path */
+    assert(hashmap_get(map, 2) == NULL);
+    assert(hashmap_count(map) == 1);
+
+    /* And the map works again once memory is back */
+    assert(atomic_load(&hashmap_fault_versions) == 0);
+    hashmap_compute(map, 1, count_calls, &calls);
+    assert(calls == 2 && hashmap_get(map, 1) == (void *)11);
+    hashmap_put(map, 2, (void *)20);
+    assert(hashmap_count(map) == 2);
+    printf("  put, remove, replace_if, compute and insert each fail once\n");
+
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    printf("  PASSED\n\n");
+}
+
+/* ── Parallel scan ── */
+
+struct scan_totals {
+    _Atomic(uint64_t) visits;
+    _Atomic(uint64_t) key_sum;
+};
+
+static void scan_visit(uint64_t key, void *value, void *arg)
+{
+    struct scan_totals *t = arg;
+    assert(*(int *)value == (int)(key - 1));
+    atomic_fetch_add(&t->visits, 1);
+    atomic_fetch_add(&t->key_sum, key);
+}
+
+static void test_parallel_for_each(void)
+{
+    printf("=== test_parallel_for_each ===\n");
+
+    hashmap_t *map = hashmap_create();
+    assert(map != NULL);
+    int slot = hashmap_thread_register(map);
+
+    int values[5000];
+    uint64_t expect_sum = 0;
+    for (int i = 0; i < 5000; i++) {
+        values[i] = i;
+        hashmap_put(map, (uint64_t)(i + 1), &values[i]);
+        expect_sum += (uint64_t)(i + 1);
+    }
+
+    /* Removed keys must not be visited */
+    for (int i = 0; i < 5000; i += 10) {
+        hashmap_remove(map, (uint64_t)(i + 1));
+        expect_sum -= (uint64_t)(i + 1);
+    }
+
+    int nthreads[] = { 1, 4, 16 };
+    for (size_t n = 0; n < sizeof(nthreads) / sizeof(nthreads[0]); n++) {
+        struct scan_totals t;
+        atomic_store(&t.visits, 0);
+        atomic_store(&t.key_sum, 0);
+        assert(hashmap_parallel_for_each(map, nthreads[n], scan_visit, &t) == 0);
+        assert(atomic_load(&t.visits) == hashmap_count(map));
+        assert(atomic_load(&t.key_sum) == expect_sum);
+        printf("  %2d threads: visited %llu entries\n", nthreads[n],
+               (unsigned long long)atomic_load(&t.visits));
+    }
+
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    printf("  PASSED\n\n");
+}
+
+/* ── MVCC snapshots ── */
+
+static void snap_sum(uint64_t key, void *value, void *arg)
+{
+    (void)key;
+    *(long *)arg += *(int *)value;
+}
+
+static void test_snapshot_basic(void)
+{
+    printf("=== test_snapshot_basic ===\n");
+
+    hashmap_config_t cfg = { .snapshots = true };
+    hashmap_t *map = hashmap_create_with(&cfg);
+    assert(map != NULL);
+    int slot = hashmap_thread_register(map);
+
+    int before[1000], after[1000];
+    long sum_before = 0;
+    for (int i = 0; i < 1000; i++) {
+        before[i] = i;
+        after[i] = i + 1000;
+        sum_before += i;
+        assert(hashmap_put(map, (uint64_t)(i + 1), &before[i]) == NULL);
+    }
+
+    hashmap_snapshot_t snap;
+    assert(hashmap_snapshot_begin(map, &snap) == 0);
+    assert(hashmap_snapshot_begin(map, &snap) == -1);  /* one per thread */
+
+    /* Mutate underneath the snapshot: update, remove, insert */
+    for (int i = 0; i < 500; i++)
+        assert(hashmap_put(map, (uint64_t)(i + 1), &after[i]) == &before[i]);
+    for (int i = 500; i < 750; i++)
+        assert(hashmap_remove(map, (uint64_t)(i + 1)) == &before[i]);
+    for (int i = 0; i < 100; i++)
+        hashmap_put(map, (uint64_t)(5000 + i), &after[i]);
+
+    /* Live view sees the changes */
+    assert(hashmap_get(map, 1) == &after[0]);
+    assert(hashmap_get(map, 600) == NULL);
+    assert(hashmap_count(map) == 850);
+
+    /* Snapshot still sees the original contents */
+    for (int i = 0; i < 1000; i++)
+        assert(hashmap_snapshot_get(&snap, (uint64_t)(i + 1)) == &before[i]);
+    assert(hashmap_snapshot_get(&snap, 5000) == NULL);
+
+    long sum = 0;
+    hashmap_snapshot_for_each(&snap, snap_sum, &sum);
+    assert(sum == sum_before);
+    printf("  snapshot isolated from 850 concurrent changes\n");
+
+    hashmap_snapshot_end(&snap);
+
+    /* Removed-then-reinserted keys come back cleanly */
+    assert(hashmap_get(map, 600) == NULL);
+    assert(hashmap_put(map, 600, &after[599]) == NULL);
+    assert(hashmap_get(map, 600) == &after[599]);
+    assert(hashmap_count(map) == 851);
+
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    printf("  PASSED\n\n");
+}
+
+#define SNAP_KEYS   512
+#define SNAP_GENS   200
+
+struct snap_writer_args {
+    hashmap_t *map;
+    int       *gens;
+    _Atomic(bool) done;
+};
+
+/* Rewrites every key in ascending order, one generation at a time */
+static void *snap_writer(void *arg)
+{
+    struct snap_writer_args *a = arg;
+    int slot = hashmap_thread_register(a->map);
+
+    for (int g = 1; g < SNAP_GENS; g++)
+        for (int k = 1; k <= SNAP_KEYS; k++)
+            hashmap_put(a->map, (uint64_t)k, &a->gens[g]);
+
+    atomic_store(&a->done, true);
+    hashmap_thread_unregister(a->map, slot);
+    return NULL;
+}
+
+static void snap_collect(uint64_t key, void *value, void *arg)
+{
+    ((int *)arg)[key] = *(int *)value;
+}
+
+static void test_snapshot_concurrent(void)
+{
+    printf("=== test_snapshot_concurrent ===\n");
+
+    hashmap_config_t cfg = { .snapshots = true };
+    hashmap_t *map = hashmap_create_with(&cfg);
+    int slot = hashmap_thread_register(map);
+
+    static int gens[SNAP_GENS];
+    for (int g = 0; g < SNAP_GENS; g++)
+        gens[g] = g;
+    for (int k = 1; k <= SNAP_KEYS; k++)
+        hashmap_put(map, (uint64_t)k, &gens[0]);
+
+    struct snap_writer_args args = { .map = map, .gens = gens };
+    atomic_store(&args.done, false);
+    pthread_t writer;
+    pthread_create(&writer, NULL, snap_writer, &args);
+
+    /*
+     * A consistent view of an in-order rewrite is a prefix at generation
+     * g followed by a suffix at g-1.
+     */
+    int snapshots = 0;
+    while (!atomic_load(&args.done)) {
+        hashmap_snapshot_t snap;
+        assert(hashmap_snapshot_begin(map, &snap) == 0);
+
+        int seen[SNAP_KEYS + 1] = { 0 };
+        hashmap_snapshot_for_each(&snap, snap_collect, seen);
+        for (int k = 2; k <= SNAP_KEYS; k++) {
+            assert(seen[k] <= seen[k - 1]);
+            assert(seen[1] - seen[k] <= 1);
+        }
+        /* Point lookups agree with the scan */
+        for (int k = 1; k <= SNAP_KEYS; k += 37)
+            assert(*(int *)hashmap_snapshot_get(&snap, (uint64_t)k) == seen[k]);
+
+        hashmap_snapshot_end(&snap);
+        snapshots++;
+        sched_yield();
+    }
+    pthread_join(writer, NULL);
+    printf("  %d snapshots consistent during %d rewrites\n",
+           snapshots, SNAP_GENS - 1);
+
+    assert(hashmap_count(map) == SNAP_KEYS);
+    for (int k = 1; k <= SNAP_KEYS; k++)
+        assert(hashmap_get(map, (uint64_t)k) == &gens[SNAP_GENS - 1]);
+
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    printf("  PASSED\n\n");
+}
+
+/* ── Map-owned values ── */
+
+#define OWN_READERS 3
+#define OWN_KEYS    64
+#define OWN_ROUNDS  400
+#define OWN_MAGIC   0x0a11c0de
+#define OWN_POISON  0xdeadbeef
+
+struct owned { uint32_t magic; };
+
+static _Atomic int own_allocs, own_frees, own_bad, own_done;
+
+static struct owned *owned_alloc(void)
+{
+    struct owned *v = malloc(sizeof(*v));
+    v->magic = OWN_MAGIC;
+    atomic_fetch_add(&own_allocs, 1);
+    return v;
+}
+
+static void owned_free(void *value)
+{
+    struct owned *v = value;
+    assert(v->magic == OWN_MAGIC);  /* destroyed once */
+    v->magic = OWN_POISON;
+    atomic_fetch_add(&own_frees, 1);
+    free(v);
+}
+
+/* Dereference values well after get returns, inside a guard */
+static void *own_reader(void *arg)
+{
+    hashmap_t *map = arg;
+    int slot = hashmap_thread_register(map);
+    for (unsigned n = 0; !atomic_load(&own_done); n++) {
+        hashmap_enter(map);
+        for (uint64_t k = 1; k <= OWN_KEYS; k++) {
+            struct owned *v = hashmap_get(map, k);
+            if (v && v->magic != OWN_MAGIC)
+                atomic_fetch_add(&own_bad, 1);
+        }
+        hashmap_exit(map);
+        hashmap_quiescent(map, slot);  /* no-op outside QSBR */
+    }
+    hashmap_thread_unregister(map, slot);
+    return NULL;
+}
+
+/* Single writer: the compute always applies, taking the new value */
+static void *own_swap_fn(uint64_t key, void *old, void *arg)
+{
+    (void)key; (void)old;
+    return arg;
+}
+
+static void run_value_ownership(const char *mode, hashmap_config_t cfg)
+{
+    atomic_store(&own_allocs, 0);
+    atomic_store(&own_frees, 0);
+    atomic_store(&own_bad, 0);
+    atomic_store(&own_done, 0);
+
+    cfg.value_free = owned_free;
+    hashmap_t *map = hashmap_create_with(&cfg);
+    assert(map != NULL);
+
+    pthread_t readers[OWN_READERS];
+    for (int i = 0; i < OWN_READERS; i++)
+        pthread_create(&readers[i], NULL, own_reader, map);
+
+    /* Overwrite, remove, replace_if and compute all displace values */
+    int slot = hashmap_thread_register(map);
+    for (int r = 0; r < OWN_ROUNDS; r++) {
+        for (uint64_t k = 1; k <= OWN_KEYS; k++) {
+            switch ((r + k) % 4) {
+            case 0:
+                hashmap_put(map, k, owned_alloc());
+                break;
+            case 1:
+                hashmap_remove(map, k);
+                break;
+            case 2: {
+                hashmap_enter(map);
+                void *cur = hashmap_get(map, k);
+                struct owned *v = owned_alloc();
+                if (!cur || !hashmap_replace_if(map, k, cur, v)) {
+                    atomic_fetch_sub(&own_allocs, 1);  /* declined: ours */
+                    free(v);
+                }
+                hashmap_exit(map);
+                break;
+            }
+            default:
+                hashmap_compute(map, k, own_swap_fn, owned_alloc());
+                break;
+            }
+        }
+        hashmap_quiescent(map, slot);
+        if (r % 16 == 0)
+            sched_yield();
+    }
+    atomic_store(&own_done, 1);
+    for (int i = 0; i < OWN_READERS; i++)
+        pthread_join(readers[i], NULL);
+
+    int freed_live = atomic_load(&own_frees);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    printf("  [%s mode] %d values, %d destroyed during run, %d poisoned reads\n",
+           mode, atomic_load(&own_allocs), freed_live, atomic_load(&own_bad));
+    assert(atomic_load(&own_bad) == 0);
+    assert(freed_live > 0);
+    assert(atomic_load(&own_frees) == atomic_load(&own_allocs));
+}
+
+static void test_value_ownership(void)
+{
+    printf("=== test_value_ownership ===\n");
+    run_value_ownership("default", (hashmap_config_t){ 0 });
+    run_value_ownership("snapshot", (hashmap_config_t){ .snapshots = true });
+    run_value_ownership("qsbr", (hashmap_config_t){ .qsbr = true });
+
+    /* Values are not protected by hazards */
+    hashmap_config_t hz = { .reclaim = HASHMAP_RECLAIM_HAZARD, .value_free = owned_free };
+    assert(hashmap_create_with(&hz) == NULL);
+    printf("  PASSED\n\n");
+}
+
+/* ── Instrumentation counters ── */
+
+#define STATS_KEYS 10000
+
+static void test_stats(void)
+{
+    printf("=== test_stats ===\n");
+
+    hashmap_t *map = hashmap_create();
+    assert(map != NULL);
+    int slot = hashmap_thread_register(map);
+
+    for (uint64_t k = 1; k <= STATS_KEYS; k++)
+        hashmap_put(map, k, (void *)k);
+    for (uint64_t k = 1; k <= STATS_KEYS; k++)
+        assert(hashmap_get(map, k) == (void *)k);
+    for (uint64_t k = 1; k <= STATS_KEYS; k++)
+        hashmap_remove(map, k);
+
+    hashmap_stats_t st;
+    if (hashmap_stats(map, &st) != 0) {
+        printf("  built without HASHMAP_STATS — SKIPPED\n\n");
+        hashmap_thread_unregister(map, slot);
+        hashmap_destroy(map);
+        return;
+    }
+
+    printf("  %lu finds, %.1f steps/find, %lu bucket inits, %lu resizes, "
+           "%lu retired (max depth %lu)\n",
+           (unsigned long)st.finds, (double)st.find_steps / (double)st.finds,
+           (unsigned long)st.bucket_inits, (unsigned long)st.resizes,
+           (unsigned long)st.retired, (unsigned long)st.max_retire_depth);
+
+    /* Single thread: every put, get and remove searches once; no races */
+    assert(st.finds >= 3 * STATS_KEYS);
+    assert(st.find_steps >= st.finds);
+    assert(st.resizes >= 8);                  /* 16 → 16384 buckets */
+    assert(st.bucket_inits > 0 && st.bucket_inits < 16384);
+    assert(st.retired == STATS_KEYS);
+    assert(st.max_retire_depth > 0);
+    assert(st.find_restarts == 0 && st.insert_cas_fails == 0 &&
+           st.value_cas_fails == 0 && st.unlink_cas_fails == 0);
+
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    printf("  PASSED\n\n");
+}
+
+/* ── Profiling ── */
+
+#define PROF_KEYS 1000
+
+static void test_profile(void)
+{
+    printf("=== test_profile ===\n");
+
+    hashmap_t *map = hashmap_create();
+    assert(map != NULL);
+    int slot = hashmap_thread_register(map);
+    for (uint64_t k = 1; k <= PROF_KEYS; k++)
+        hashmap_put(map, k, (void *)k);
+    for (uint64_t k = 1; k <= PROF_KEYS; k += 2)
+        hashmap_remove(map, k);
+
+    hashmap_profile_t p;
+    assert(hashmap_profile(map, &p) == 0);
+    printf("  cap %zu, %zu sentinels, %zu live, longest run %zu, %.2f steps/hit\n",
+           p.capacity, p.sentinels, p.live, p.longest_run, p.expected_steps);
+
+    assert(p.capacity == atomic_load(&map->size));
+    assert(p.live == PROF_KEYS / 2 && p.marked == 0 && p.dead == 0);
+    assert(p.sentinels >= 1 && p.sentinels <= p.capacity);
+    assert(p.longest_run >= 1 && p.expected_steps >= 1.0);
+
+    size_t buckets = 0, runs = 0, keys = 0;
+    for (int i = 0; i < HASHMAP_PROFILE_BINS; i++) {
+        buckets += p.occupancy[i];
+        runs += p.runs[i];
+        keys += (size_t)i * p.occupancy[i];
+    }
+    assert(buckets == p.capacity);
+    assert(runs == p.sentinels);      /* no resize during the walk */
+    assert(keys <= p.live);           /* the last bin is open-ended */
+
+    /* JSON export */
+    char *json = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&json, &len);
+    assert(hashmap_profile_json(&p, f) == 0);
+    fclose(f);
+    assert(json[0] == '{' && strstr(json, "\"live\":500,"));
+    assert(strstr(json, "\"occupancy\":[") && strstr(json, "\"runs\":["));
+    free(json);
+
+    /* A higher load factor trades buckets for longer runs */
+    hashmap_config_t dense = { .load_factor = 400 };
+    hashmap_t *dmap = hashmap_create_with(&dense);
+    for (uint64_t k = 1; k <= PROF_KEYS; k++)
+        hashmap_put(dmap, k, (void *)k);
+    hashmap_profile_t dp;
+    assert(hashmap_profile(dmap, &dp) == 0);
+    printf("  load factor 400: cap %zu, %.2f steps/hit\n",
+           dp.capacity, dp.expected_steps);
+    assert(dp.capacity < p.capacity);
+    hashmap_destroy(dmap);
+
+    hashmap_config_t hz = { .reclaim = HASHMAP_RECLAIM_HAZARD };
+    hashmap_t *hmap = hashmap_create_with(&hz);
+    assert(hashmap_profile(hmap, &p) == -1);
+    hashmap_destroy(hmap);
+
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    printf("  PASSED\n\n");
+}
+
+/* ── Latency sampling ── */
+
+#define LAT_KEYS 4096
+
+static void test_latency(void)
+{
+    printf("=== test_latency ===\n");
+
+    /* Every operation sampled: counts are exact */
+    hashmap_config_t all = { .sample_every = 1 };
+    hashmap_t *map = hashmap_create_with(&all);
+    int slot = hashmap_thread_register(map);
+    for (uint64_t k = 1; k <= LAT_KEYS; k++)
+        hashmap_put(map, k, (void *)k);
+    for (uint64_t k = 1; k <= LAT_KEYS; k++)
+        hashmap_get(map, k);
+    for (uint64_t k = 1; k <= LAT_KEYS; k += 2)
+        hashmap_remove(map, k);
+
+    lat_summary_t get, enter, put, rem;
+    assert(hashmap_latency(map, HASHMAP_LAT_GET, HASHMAP_LAT_TOTAL, &get) == 0);
+    assert(hashmap_latency(map, HASHMAP_LAT_GET, HASHMAP_LAT_ENTER, &enter) == 0);
+    assert(hashmap_latency(map, HASHMAP_LAT_PUT, HASHMAP_LAT_TOTAL, &put) == 0);
+    assert(hashmap_latency(map, HASHMAP_LAT_REMOVE, HASHMAP_LAT_TOTAL, &rem) == 0);
+    printf("  get p50 %lu ns (enter %lu ns) p99.9 %lu ns, put p50 %lu ns, remove p50 %lu ns\n",
+           (unsigned long)get.p50, (unsigned long)enter.p50, (unsigned long)get.p999,
+           (unsigned long)put.p50, (unsigned long)rem.p50);
+
+    assert(get.count == LAT_KEYS && enter.count == LAT_KEYS);
+    assert(put.count == LAT_KEYS && rem.count == LAT_KEYS / 2);
+    assert(get.min <= get.p50 && get.p50 <= get.p90 && get.p90 <= get.p99 &&
+           get.p99 <= get.p999 && get.p999 <= get.max);
+    assert(get.max > 0 && get.mean > 0.0);
+    assert(enter.mean <= get.mean);
+
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    /* 1 in 128 (100 rounds up) */
+    hashmap_config_t some = { .sample_every = 100 };
+    map = hashmap_create_with(&some);
+    slot = hashmap_thread_register(map);
+    for (uint64_t k = 1; k <= LAT_KEYS; k++)
+        hashmap_put(map, k, (void *)k);
+    assert(hashmap_latency(map, HASHMAP_LAT_PUT, HASHMAP_LAT_TOTAL, &put) == 0);
+    printf("  sample_every 100: %lu of %d puts sampled\n",
+           (unsigned long)put.count, LAT_KEYS);
+    assert(put.count == LAT_KEYS / 128 || put.count == LAT_KEYS / 128 + 1);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    /* Off by default */
+    map = hashmap_create();
+    assert(hashmap_latency(map, HASHMAP_LAT_GET, HASHMAP_LAT_TOTAL, &get) == -1);
+    hashmap_destroy(map);
+    printf("  PASSED\n\n");
+}
+
+/* ── Memory accounting ── */
+
+#define MEM_KEYS    4096
+#define MEM_THREADS 4
+
+static void *mem_churn(void *arg)
+{
+    hashmap_t *map = arg;
+    int slot = hashmap_thread_register(map);
+    uint32_t x = 2463534242u + (uint32_t)slot;
+    for (int i = 0; i < 20000; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        uint64_t k = 1 + x % MEM_KEYS;
+        if (x & 1)
+            hashmap_put(map, k, (void *)k);
+        else
+            hashmap_remove(map, k);
+    }
+    hashmap_thread_unregister(map, slot);
+    return NULL;
+}
+
+/* Enter the epoch until nothing retired is left (false if it never is) */
+static bool mem_drain(hashmap_t *map, hashmap_memory_t *m)
+{
+    for (int i = 0; i < 1000; i++) {
+        hashmap_get(map, 1);
+        hashmap_memory_usage(map, m);
+        if (m->retired == 0 && m->retired_buckets == 0)
+            return true;
+    }
+    return false;
+}
+
+static void test_memory(void)
+{
+    printf("=== test_memory ===\n");
+    const size_t node = sizeof(struct hm_node);
+    hashmap_memory_t m;
+
+    hashmap_t *map = hashmap_create();
+    int slot = hashmap_thread_register(map);
+    assert(hashmap_memory_usage(map, &m) == 0);
+    assert(m.nodes == 0 && m.sentinels == 0 && m.versions == 0);
+    assert(m.buckets == HASHMAP_INIT_CAP * sizeof(struct hm_node *));
+    assert(m.reclaim_state >= sizeof(epoch_t) && m.fixed > 0);
+    size_t empty = m.total;
+
+    for (uint64_t k = 1; k <= MEM_KEYS; k++)
+        hashmap_put(map, k, (void *)k);
+    hashmap_memory_usage(map, &m);
+    printf("  %d keys: nodes %zu, sentinels %zu, buckets %zu, retired buckets %zu, total %zu\n",
+           MEM_KEYS, m.nodes, m.sentinels, m.buckets, m.retired_buckets, m.total);
+    assert(m.nodes == MEM_KEYS * node);
+    assert(m.buckets == atomic_load(&map->size) * sizeof(struct hm_node *));
+    assert(m.nodes + m.sentinels + m.versions + m.buckets + m.retired_buckets +
+           m.retired + m.retire_records + m.reclaim_state + m.fixed == m.total);
+
+    hashmap_profile_t p;
+    assert(hashmap_profile(map, &p) == 0);
+    assert(m.sentinels == (p.sentinels - 1) * node);  /* head is embedded */
+
+    /* Removes move nodes to retired; reclamation brings it back to 0 */
+    for (uint64_t k = 1; k <= MEM_KEYS; k++)
+        hashmap_remove(map, k);
+    hashmap_memory_usage(map, &m);
+    assert(m.nodes == 0 && m.retired > 0);
+    assert(mem_drain(map, &m));
+    assert(m.nodes == 0 && m.total > empty);  /* sentinels and buckets stay */
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    /* Concurrent churn: the counters agree with a walk of the list */
+    map = hashmap_create();
+    pthread_t threads[MEM_THREADS];
+    for (int i = 0; i < MEM_THREADS; i++)
+        pthread_create(&threads[i], NULL, mem_churn, map);
+    for (int i = 0; i < MEM_THREADS; i++)
+        pthread_join(threads[i], NULL);
+    slot = hashmap_thread_register(map);
+    assert(mem_drain(map, &m));
+    assert(hashmap_profile(map, &p) == 0);
+    printf("  after churn: %zu live + %zu marked nodes, nodes %zu bytes\n",
+           p.live, p.marked, m.nodes);
+    assert(m.nodes == (p.live + p.marked + p.dead) * node);
+    assert(m.sentinels == (p.sentinels - 1) * node);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    /* Snapshot mode: one record per live key once old ones are pruned */
+    hashmap_config_t snap = { .snapshots = true };
+    map = hashmap_create_with(&snap);
+    slot = hashmap_thread_register(map);
+    for (uint64_t k = 1; k <= 100; k++)
+        hashmap_put(map, k, (void *)k);
+    hashmap_memory_usage(map, &m);
+    size_t one_each = m.versions;
+    assert(one_each > 0 && one_each % 100 == 0);
+    for (int round = 1; round < 3; round++)
+        for (uint64_t k = 1; k <= 100; k++)
+            hashmap_put(map, k, (void *)(k + (uint64_t)round));
+    assert(mem_drain(map, &m));
+    assert(m.versions == one_each);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    /* Hazard mode: replaced arrays are kept until destroy */
+    hashmap_config_t hz = { .reclaim = HASHMAP_RECLAIM_HAZARD };
+    map = hashmap_create_with(&hz);
+    slot = hashmap_thread_register(map);
+    for (uint64_t k = 1; k <= MEM_KEYS; k++)
+        hashmap_put(map, k, (void *)k);
+    hashmap_memory_usage(map, &m);
+    assert(m.retired_buckets > 0 && m.retired_buckets < m.buckets);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    printf("  PASSED\n\n");
+}
+
+/* ── Dump and load ── */
+
+#define DUMP_KEYS 20000
+
+static size_t str_encode(void *value, void *buf, size_t cap, void *arg)
+{
+    (void)arg;
+    size_t n = strlen(value);
+    if (n <= cap)
+        memcpy(buf, value, n);
+    return n;
+}
+
+static void *str_decode(const void *buf, size_t len, void *arg)
+{
+    (void)arg;
+    char *s = malloc(len + 1);
+    memcpy(s, buf, len);
+    s[len] = '\0';
+    return s;
+}
+
+/* A fresh unlinked temporary file */
+static int dump_file(void)
+{
+    FILE *f = tmpfile();
+    assert(f != NULL);
+    return dup(fileno(f));   /* the FILE is left open until exit */
+}
+
+struct dump_churn {
+    hashmap_t  *map;
+    atomic_bool stop;
+};
+
+static void *dump_churner(void *arg)
+{
+    struct dump_churn *c = arg;
+    int slot = hashmap_thread_register(c->map);
+    uint32_t x = 7;
+    while (!atomic_load(&c->stop)) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        uint64_t k = 1 + x % (DUMP_KEYS / 2);   /* the lower half only */
+        if (x & 1)
+            hashmap_put(c->map, k, (void *)k);
+        else
+            hashmap_remove(c->map, k);
+    }
+    hashmap_thread_unregister(c->map, slot);
+    return NULL;
+}
+
+static void test_dump_load(void)
+{
+    printf("=== test_dump_load ===\n");
+
+    /* Raw value words: key k holds 3k, except k = 1 mod 4 */
+    hashmap_t *map = hashmap_create();
+    int slot = hashmap_thread_register(map);
+    for (uint64_t k = 1; k <= DUMP_KEYS; k++)
+        hashmap_put(map, k, (void *)(k * 3));
+    for (uint64_t k = 1; k <= DUMP_KEYS; k += 4)
+        hashmap_remove(map, k);
+    size_t count = hashmap_count(map), cap = atomic_load(&map->size);
+
+    int fd = dump_file();
+    assert(hashmap_dump(map, fd) == 0);
+    off_t size = lseek(fd, 0, SEEK_CUR);
+
+    /* Weakly consistent under concurrent updates to the lower half */
+    struct dump_churn churn = { .map = map };
+    pthread_t th;
+    pthread_create(&th, NULL, dump_churner, &churn);
+    int live_fd = dump_file();
+    assert(hashmap_dump(map, live_fd) == 0);
+    atomic_store(&churn.stop, true);
+    pthread_join(th, NULL);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    lseek(fd, 0, SEEK_SET);
+    hashmap_t *copy = hashmap_load(fd);
+    assert(copy != NULL);
+    printf("  %zu entries in %ld bytes, reloaded at capacity %zu\n",
+           hashmap_count(copy), (long)size, atomic_load(&copy->size));
+
+    slot = hashmap_thread_register(copy);
+    assert(hashmap_count(copy) == count && atomic_load(&copy->size) == cap);
+    for (uint64_t k = 1; k <= DUMP_KEYS; k++)
+        assert(hashmap_get(copy, k) == (k % 4 == 1 ? NULL : (void *)(k * 3)));
+    hashmap_profile_t p;
+    assert(hashmap_profile(copy, &p) == 0);
+    assert(p.live == count && p.marked == 0 && p.dead == 0);
+
+    /* The loaded map is an ordinary one: it grows and shrinks */
+    for (uint64_t k = DUMP_KEYS + 1; k <= 2 * DUMP_KEYS; k++)
+        hashmap_put(copy, k, (void *)k);
+    for (uint64_t k = 2; k <= DUMP_KEYS; k += 4)
+        assert(hashmap_remove(copy, k) == (void *)(k * 3));
+    assert(hashmap_count(copy) == count + DUMP_KEYS - DUMP_KEYS / 4);
+    hashmap_thread_unregister(copy, slot);
+    hashmap_destroy(copy);
+
+    /* Corruption: a flipped payload byte or a short file is rejected */
+    uint8_t byte;
+    assert(pread(fd, &byte, 1, size / 2) == 1);
+    byte ^= 0x40;
+    assert(pwrite(fd, &byte, 1, size / 2) == 1);
+    lseek(fd, 0, SEEK_SET);
+    assert(hashmap_load(fd) == NULL);
+    byte ^= 0x40;
+    assert(pwrite(fd, &byte, 1, size / 2) == 1);
+    assert(ftruncate(fd, size - 1) == 0);
+    lseek(fd, 0, SEEK_SET);
+    assert(hashmap_load(fd) == NULL);
+    close(fd);
+
+    /* The live dump: untouched upper half intact, lower half plausible */
+    lseek(live_fd, 0, SEEK_SET);
+    copy = hashmap_load(live_fd);
+    assert(copy != NULL);
+    for (uint64_t k = DUMP_KEYS / 2 + 1; k <= DUMP_KEYS; k++)
+        assert(hashmap_get(copy, k) == (k % 4 == 1 ? NULL : (void *)(k * 3)));
+    for (uint64_t k = 1; k <= DUMP_KEYS / 2; k++) {
+        void *v = hashmap_get(copy, k);
+        assert(v == NULL || v == (void *)k || v == (void *)(k * 3));
+    }
+    hashmap_destroy(copy);
+    close(live_fd);
+
+    /* Owned string values through a codec, from a snapshot-mode map */
+    hashmap_config_t owned = { .snapshots = true, .value_free = free };
+    hashmap_codec_t codec = { .encode = str_encode, .decode = str_decode };
+    map = hashmap_create_with(&owned);
+    slot = hashmap_thread_register(map);
+    char text[32];
+    for (uint64_t k = 1; k <= 1000; k++) {
+        snprintf(text, sizeof(text), "value-%lu", (unsigned long)k);
+        hashmap_put(map, k, strdup(text));
+    }
+    fd = dump_file();
+    assert(hashmap_dump_with(map, fd, &codec) == 0);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    lseek(fd, 0, SEEK_SET);
+    assert(hashmap_load_with(fd, &owned, NULL) == NULL);   /* codec required */
+    lseek(fd, 0, SEEK_SET);
+    copy = hashmap_load_with(fd, &owned, &codec);
+    assert(copy != NULL && hashmap_count(copy) == 1000);
+    slot = hashmap_thread_register(copy);
+    hashmap_enter(copy);
+    for (uint64_t k = 1; k <= 1000; k++) {
+        snprintf(text, sizeof(text), "value-%lu", (unsigned long)k);
+        assert(strcmp(hashmap_get(copy, k), text) == 0);
+    }
+    hashmap_exit(copy);
+    hashmap_snapshot_t snap;
+    assert(hashmap_snapshot_begin(copy, &snap) == 0);
+    assert(strcmp(hashmap_snapshot_get(&snap, 7), "value-7") == 0);
+    hashmap_snapshot_end(&snap);
+    hashmap_thread_unregister(copy, slot);
+    hashmap_destroy(copy);
+    close(fd);
+
+    /* Hazard-pointer maps cannot be walked unprotected */
+    hashmap_config_t hz = { .reclaim = HASHMAP_RECLAIM_HAZARD };
+    map = hashmap_create_with(&hz);
+    slot = hashmap_thread_register(map);
+    fd = dump_file();
+    assert(hashmap_dump(map, fd) == -1);
+    close(fd);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    printf("  PASSED\n\n");
+}
+
+/* ── Frozen images ── */
+
+#define FROZEN_KEYS 20000
+
+static void test_frozen(void)
+{
+    printf("=== test_frozen ===\n");
+
+    /* Raw value words, same contents as the dump test */
+    hashmap_t *map = hashmap_create();
+    int slot = hashmap_thread_register(map);
+    for (uint64_t k = 1; k <= FROZEN_KEYS; k++)
+        hashmap_put(map, k, (void *)(k * 3));
+    for (uint64_t k = 1; k <= FROZEN_KEYS; k += 4)
+        hashmap_remove(map, k);
+    size_t count = hashmap_count(map);
+
+    int fd = dump_file();
+    assert(hashmap_freeze(map, fd) == 0);
+    off_t size = lseek(fd, 0, SEEK_CUR);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    /* Opened and read with no registration or epoch */
+    hashmap_frozen_t *fm = hashmap_frozen_open(fd);
+    assert(fm != NULL);
+    printf("  %zu entries in %ld bytes, %u bucket bits\n",
+           hashmap_frozen_count(fm), (long)size, fm->bucket_bits);
+    assert(hashmap_frozen_count(fm) == count);
+    for (uint64_t k = 1; k <= FROZEN_KEYS; k++)
+        assert(hashmap_frozen_get(fm, k) == (k % 4 == 1 ? NULL : (void *)(k * 3)));
+    assert(hashmap_frozen_get(fm, 0) == NULL);
+    assert(hashmap_frozen_get(fm, FROZEN_KEYS + 1) == NULL);
+    size_t len;
+    assert(hashmap_frozen_get_bytes(fm, 2, &len) == NULL);   /* not a codec image */
+    assert(hashmap_frozen_verify(fm) == 0);
+    hashmap_frozen_close(fm);
+
+    /* A flipped body byte opens but fails verification */
+    uint8_t byte;
+    assert(pread(fd, &byte, 1, size / 2) == 1);
+    byte ^= 0x40;
+    assert(pwrite(fd, &byte, 1, size / 2) == 1);
+    fm = hashmap_frozen_open(fd);
+    assert(fm != NULL && hashmap_frozen_verify(fm) == -1);
+    hashmap_frozen_close(fm);
+
+    /* A flipped header byte or a short file does not open */
+    assert(pread(fd, &byte, 1, 20) == 1);
+    byte ^= 0x01;
+    assert(pwrite(fd, &byte, 1, 20) == 1);
+    assert(hashmap_frozen_open(fd) == NULL);
+    byte ^= 0x01;
+    assert(pwrite(fd, &byte, 1, 20) == 1);
+    assert(ftruncate(fd, size - 8) == 0);
+    assert(hashmap_frozen_open(fd) == NULL);
+    close(fd);
+
+    /* Codec values are read in place from the mapping */
+    hashmap_config_t owned = { .snapshots = true, .value_free = free };
+    hashmap_codec_t codec = { .encode = str_encode, .decode = str_decode };
+    map = hashmap_create_with(&owned);
+    slot = hashmap_thread_register(map);
+    char text[32];
+    for (uint64_t k = 1; k <= 1000; k++) {
+        snprintf(text, sizeof(text), "value-%lu", (unsigned long)k);
+        hashmap_put(map, k, strdup(text));
+    }
+    fd = dump_file();
+    assert(hashmap_freeze_with(map, fd, &codec) == 0);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    fm = hashmap_frozen_open(fd);
+    close(fd);                                  /* the mapping stays valid */
+    assert(fm != NULL && hashmap_frozen_count(fm) == 1000);
+    assert(hashmap_frozen_verify(fm) == 0);
+    for (uint64_t k = 1; k <= 1000; k++) {
+        snprintf(text, sizeof(text), "value-%lu", (unsigned long)k);
+        const char *v = hashmap_frozen_get_bytes(fm, k, &len);
+        assert(v != NULL && len == strlen(text) && memcmp(v, text, len) == 0);
+        assert(hashmap_frozen_get(fm, k) == v);
+    }
+    assert(hashmap_frozen_get_bytes(fm, 1001, &len) == NULL);
+    hashmap_frozen_close(fm);
+
+    /* An empty map freezes to an empty image */
+    map = hashmap_create();
+    slot = hashmap_thread_register(map);
+    fd = dump_file();
+    assert(hashmap_freeze(map, fd) == 0);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    fm = hashmap_frozen_open(fd);
+    assert(fm != NULL && hashmap_frozen_count(fm) == 0);
+    assert(hashmap_frozen_get(fm, 1) == NULL && hashmap_frozen_verify(fm) == 0);
+    hashmap_frozen_close(fm);
+    close(fd);
+
+    printf("  PASSED\n\n");
+}
+
+/* ── Write-ahead log ── */
+
+#define WAL_THREADS 4
+#define WAL_KEYS    2048
+#define WAL_ROUNDS  8
+
+struct wal_args {
+    hashmap_t *map;
+    int        thread_id;
+};
+
+/* Every thread updates every key: same-key races decide the outcome */
+static void *wal_worker(void *arg)
+{
+    struct wal_args *a = arg;
+    int slot = hashmap_thread_register(a->map);
+    uint32_t x = 2463534242u + (uint32_t)a->thread_id;
+    for (int r = 0; r < WAL_ROUNDS; r++) {
+        for (uint64_t k = 1; k <= WAL_KEYS; k++) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            if (x % 5 == 0)
+                hashmap_remove(a->map, k);
+            else
+                hashmap_put(a->map, k, (void *)(((uint64_t)a->thread_id << 32) | x));
+        }
+    }
+    hashmap_thread_unregister(a->map, slot);
+    return NULL;
+}
+
+/* Register on `map` (a fresh `mode` one if NULL) and recover it from the log */
+static hashmap_t *wal_recover(hashmap_t *map, const hashmap_config_t *mode, int fd,
+                              const hashmap_wal_config_t *cfg, int *slot)
+{
+    if (!map) map = hashmap_create_with(mode);
+    assert(map != NULL);
+    *slot = hashmap_thread_register(map);
+    assert(hashmap_wal_open(map, fd, cfg) == 0);
+    return map;
+}
+
+/* The log's guarantees on maps configured as `mode` */
+static void run_wal(const char *name, hashmap_config_t mode)
+{
+    /* Concurrent writers, batched fsync: recovery matches exactly */
+    hashmap_wal_config_t cfg = { .sync = HASHMAP_WAL_SYNC_INTERVAL, .interval_ms = 2 };
+    hashmap_t *map = hashmap_create_with(&mode);
+    int slot = hashmap_thread_register(map);
+    int fd = dump_file();
+    assert(hashmap_wal_open(map, fd, &cfg) == 0);
+    assert(hashmap_wal_open(map, fd, &cfg) == -1);       /* already open */
+
+    pthread_t th[WAL_THREADS];
+    struct wal_args args[WAL_THREADS];
+    for (int i = 0; i < WAL_THREADS; i++) {
+        args[i] = (struct wal_args){ .map = map, .thread_id = i };
+        pthread_create(&th[i], NULL, wal_worker, &args[i]);
+    }
+    for (int i = 0; i < WAL_THREADS; i++)
+        pthread_join(th[i], NULL);
+
+    void **want = calloc(WAL_KEYS + 1, sizeof(void *));
+    for (uint64_t k = 1; k <= WAL_KEYS; k++)
+        want[k] = hashmap_get(map, k);
+    size_t count = hashmap_count(map);
+    assert(hashmap_wal_sync(map) == 0);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);                                 /* closes the log */
+    off_t size = lseek(fd, 0, SEEK_END);
+    printf("  %s: %d updates by %d threads in %ld bytes of log\n", name,
+           WAL_THREADS * WAL_ROUNDS * WAL_KEYS, WAL_THREADS, (long)size);
+
+    map = wal_recover(NULL, &mode, fd, &cfg, &slot);
+    assert(hashmap_count(map) == count);
+    for (uint64_t k = 1; k <= WAL_KEYS; k++)
+        assert(hashmap_get(map, k) == want[k]);
+
+    /* Appends continue after the recovered records; a key removed and
+       put again numbers after its previous incarnation */
+    hashmap_put(map, 1, (void *)7);
+    hashmap_remove(map, 2);
+    for (uint64_t i = 1; i <= 3; i++) {
+        hashmap_put(map, 3, (void *)(100 + i));
+        hashmap_remove(map, 3);
+    }
+    hashmap_put(map, 3, (void *)9);
+    want[1] = (void *)7;
+    want[2] = NULL;
+    want[3] = (void *)9;
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    map = wal_recover(NULL, &mode, fd, &cfg, &slot);
+    for (uint64_t k = 1; k <= WAL_KEYS; k++)
+        assert(hashmap_get(map, k) == want[k]);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    /* A torn last batch is dropped and truncated away */
+    size = lseek(fd, 0, SEEK_END);
+    uint8_t junk[5] = { 9, 0, 0, 0, 1 };
+    assert(pwrite(fd, junk, sizeof(junk), size) == (ssize_t)sizeof(junk));
+    map = wal_recover(NULL, &mode, fd, &cfg, &slot);
+    assert(lseek(fd, 0, SEEK_END) == size);
+    assert(hashmap_get(map, 1) == (void *)7);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    /* Checkpoint: rotate, dump, keep going; recover = load + new log */
+    map = wal_recover(NULL, &mode, fd, &cfg, &slot);
+    int next_fd = dump_file(), dump_fd = dump_file();
+    assert(hashmap_wal_rotate(map, next_fd) == 0);
+    assert(hashmap_dump(map, dump_fd) == 0);
+    for (uint64_t k = 1; k <= WAL_KEYS; k += 3) {
+        hashmap_put(map, k, (void *)(k + 1));
+        want[k] = (void *)(k + 1);
+    }
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    close(fd);
+
+    lseek(dump_fd, 0, SEEK_SET);
+    map = wal_recover(hashmap_load_with(dump_fd, &mode, NULL), &mode, next_fd, &cfg, &slot);
+    for (uint64_t k = 1; k <= WAL_KEYS; k++)
+        assert(hashmap_get(map, k) == want[k]);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    close(next_fd);
+    close(dump_fd);
+    free(want);
+
+    /* Owned values through a codec, each update durable on return */
+    hashmap_config_t owned = mode;
+    owned.value_free = free;
+    hashmap_codec_t codec = { .encode = str_encode, .decode = str_decode };
+    hashmap_wal_config_t always = { .sync = HASHMAP_WAL_SYNC_ALWAYS, .codec = &codec };
+    map = hashmap_create_with(&owned);
+    slot = hashmap_thread_register(map);
+    fd = dump_file();
+    assert(hashmap_wal_open(map, fd, &cfg) == -1);        /* codec required */
+    assert(hashmap_wal_open(map, fd, &always) == 0);
+    char text[32];
+    for (uint64_t k = 1; k <= 200; k++) {
+        snprintf(text, sizeof(text), "value-%lu", (unsigned long)k);
+        hashmap_put(map, k, strdup(text));
+    }
+    for (uint64_t k = 1; k <= 200; k += 2)
+        hashmap_remove(map, k);
+    hashmap_put(map, 2, strdup("replaced"));
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    map = wal_recover(NULL, &owned, fd, &always, &slot);
+    assert(hashmap_count(map) == 100);
+    hashmap_enter(map);
+    assert(strcmp(hashmap_get(map, 2), "replaced") == 0);
+    assert(strcmp(hashmap_get(map, 200), "value-200") == 0);
+    assert(hashmap_get(map, 199) == NULL);
+    hashmap_exit(map);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    close(fd);
+}
+
+static void test_wal(void)
+{
+    printf("=== test_wal ===\n");
+
+    run_wal("default", (hashmap_config_t){ 0 });
+    run_wal("snapshot", (hashmap_config_t){ .snapshots = true });
+
+    /* Hazard-pointer maps log too (they cannot take snapshots) */
+    hashmap_config_t hazard = { .reclaim = HASHMAP_RECLAIM_HAZARD };
+    hashmap_wal_config_t cfg = { .sync = HASHMAP_WAL_SYNC_ALWAYS };
+    int slot;
+    int fd = dump_file();
+    hashmap_t *map = wal_recover(NULL, &hazard, fd, &cfg, &slot);
+    for (uint64_t k = 1; k <= 100; k++)
+        hashmap_put(map, k, (void *)k);
+    for (uint64_t k = 1; k <= 100; k += 2)
+        hashmap_remove(map, k);
+    hashmap_put(map, 1, (void *)11);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    map = wal_recover(NULL, &hazard, fd, &cfg, &slot);
+    assert(hashmap_count(map) == 51);
+    assert(hashmap_get(map, 1) == (void *)11 && hashmap_get(map, 3) == NULL);
+    assert(hashmap_get(map, 100) == (void *)100);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    close(fd);
+
+    /* Not a log */
+    fd = dump_file();
+    assert(write(fd, "not a log at all", 16) == 16);
+    map = hashmap_create();
+    slot = hashmap_thread_register(map);
+    assert(hashmap_wal_open(map, fd, NULL) == -1);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    close(fd);
+
+    printf("  PASSED\n\n");
+}
+
+/* ── Incremental checkpoints ── */
+
+#define CKPT_RANGES 256
+#define CKPT_QUIET  64      /* Header and end block: nothing was dirty */
+
+struct ckpt_race {
+    hashmap_t  *map;
+    int         fd;
+    _Atomic int started;
+};
+
+/* Racing starts: the claim lets exactly one through */
+static void *ckpt_racer(void *arg)
+{
+    struct ckpt_race *r = arg;
+    if (hashmap_checkpoint_start(r->map, r->fd, NULL, false) == 0)
+        atomic_fetch_add(&r->started, 1);
+    return NULL;
+}
+
+/* Register on a fresh map and apply a checkpoint chain in order */
+static hashmap_t *ckpt_restore(const hashmap_config_t *cfg, const int *fds, int n,
+                               const hashmap_codec_t *codec, int *slot)
+{
+    hashmap_t *map = hashmap_create_with(cfg);
+    assert(map != NULL);
+    *slot = hashmap_thread_register(map);
+    for (int i = 0; i < n; i++) {
+        lseek(fds[i], 0, SEEK_SET);
+        assert(hashmap_checkpoint_apply(map, fds[i], codec) == 0);
+    }
+    return map;
+}
+
+static void test_checkpoint(void)
+{
+    printf("=== test_checkpoint ===\n");
+
+    hashmap_config_t cfg = { .checkpoint_ranges = CKPT_RANGES };
+    hashmap_t *map = hashmap_create_with(&cfg);
+    int slot = hashmap_thread_register(map);
+    for (uint64_t k = 1; k <= DUMP_KEYS; k++)
+        hashmap_put(map, k, (void *)k);
+
+    int fds[5];
+    for (int i = 0; i < 5; i++)
+        fds[i] = dump_file();
+    assert(hashmap_checkpoint(map, fds[0], NULL, true) == 0);
+
+    /* A few updates: only their ranges are rewritten */
+    hashmap_put(map, 5, (void *)55);
+    hashmap_remove(map, 6);
+    hashmap_put(map, DUMP_KEYS + 1, (void *)1);
+    assert(hashmap_checkpoint(map, fds[1], NULL, false) == 0);
+    off_t full = lseek(fds[0], 0, SEEK_END), delta = lseek(fds[1], 0, SEEK_END);
+    printf("  full %ld bytes, delta of 3 updates %ld bytes\n", (long)full, (long)delta);
+    assert(delta * 50 < full);
+
+    /* In the background, under churn: what it misses goes in the next */
+    struct dump_churn churn = { .map = map };
+    atomic_store(&churn.stop, false);
+    pthread_t th;
+    pthread_create(&th, NULL, dump_churner, &churn);
+    assert(hashmap_checkpoint_start(map, fds[2], NULL, false) == 0);
+    assert(hashmap_checkpoint_start(map, fds[2], NULL, false) == -1);  /* in flight */
+    assert(hashmap_checkpoint(map, fds[3], NULL, false) == -1);
+    for (uint64_t k = DUMP_KEYS / 2 + 1; k <= DUMP_KEYS; k += 7)
+        hashmap_put(map, k, (void *)(k * 3));
+    assert(hashmap_checkpoint_wait(map) == 0);
+    atomic_store(&churn.stop, true);
+    pthread_join(th, NULL);
+    assert(hashmap_checkpoint(map, fds[3], NULL, false) == 0);
+    assert(hashmap_checkpoint(map, fds[4], NULL, false) == 0);
+    assert(lseek(fds[4], 0, SEEK_END) == CKPT_QUIET);
+
+    void **want = calloc(DUMP_KEYS + 2, sizeof(void *));
+    for (uint64_t k = 1; k <= DUMP_KEYS + 1; k++)
+        want[k] = hashmap_get(map, k);
+    size_t count = hashmap_count(map);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    /* Deltas apply only in order */
+    map = ckpt_restore(&cfg, fds, 1, NULL, &slot);
+    lseek(fds[2], 0, SEEK_SET);
+    assert(hashmap_checkpoint_apply(map, fds[2], NULL) == -1);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    map = ckpt_restore(&cfg, fds, 5, NULL, &slot);
+    assert(hashmap_count(map) == count);
+    for (uint64_t k = 1; k <= DUMP_KEYS + 1; k++)
+        assert(hashmap_get(map, k) == want[k]);
+
+    /* The restored map is clean and continues the chain */
+    int next = dump_file();
+    assert(hashmap_checkpoint(map, next, NULL, false) == 0);
+    assert(lseek(next, 0, SEEK_END) == CKPT_QUIET);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    close(next);
+
+    /* A damaged delta is refused */
+    uint8_t byte;
+    assert(pread(fds[1], &byte, 1, 40) == 1);
+    byte ^= 0x40;
+    assert(pwrite(fds[1], &byte, 1, 40) == 1);
+    map = ckpt_restore(&cfg, fds, 1, NULL, &slot);
+    lseek(fds[1], 0, SEEK_SET);
+    assert(hashmap_checkpoint_apply(map, fds[1], NULL) == -1);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    for (int i = 0; i < 5; i++)
+        close(fds[i]);
+    free(want);
+
+    /* Untracked: full checkpoints only, as one range */
+    map = hashmap_create();
+    slot = hashmap_thread_register(map);
+    for (uint64_t k = 1; k <= 1000; k++)
+        hashmap_put(map, k, (void *)(k + 1));
+    fds[0] = dump_file();
+    assert(hashmap_checkpoint(map, fds[0], NULL, false) == -1);
+    assert(hashmap_checkpoint(map, fds[0], NULL, true) == 0);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    map = ckpt_restore(&cfg, fds, 1, NULL, &slot);
+    assert(hashmap_count(map) == 1000 && hashmap_get(map, 1000) == (void *)1001);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    close(fds[0]);
+
+    /* Owned values through a codec */
+    hashmap_config_t owned = { .checkpoint_ranges = 16, .value_free = free };
+    hashmap_codec_t codec = { .encode = str_encode, .decode = str_decode };
+    map = hashmap_create_with(&owned);
+    slot = hashmap_thread_register(map);
+    char text[32];
+    for (uint64_t k = 1; k <= 200; k++) {
+        snprintf(text, sizeof(text), "value-%lu", (unsigned long)k);
+        hashmap_put(map, k, strdup(text));
+    }
+    fds[0] = dump_file();
+    fds[1] = dump_file();
+    assert(hashmap_checkpoint(map, fds[0], &codec, true) == 0);
+    for (uint64_t k = 1; k <= 200; k += 2)
+        hashmap_remove(map, k);
+    hashmap_put(map, 2, strdup("replaced"));
+    assert(hashmap_checkpoint(map, fds[1], &codec, false) == 0);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+
+    map = ckpt_restore(&owned, fds, 2, &codec, &slot);
+    assert(hashmap_count(map) == 100);
+    hashmap_enter(map);
+    assert(strcmp(hashmap_get(map, 2), "replaced") == 0);
+    assert(strcmp(hashmap_get(map, 200), "value-200") == 0);
+    assert(hashmap_get(map, 199) == NULL);
+    hashmap_exit(map);
+    lseek(fds[0], 0, SEEK_SET);
+    assert(hashmap_checkpoint_apply(map, fds[0], NULL) == -1);  /* codec needed */
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    close(fds[0]);
+    close(fds[1]);
+
+    /* Concurrent starts: one writer, and the chain stays gapless */
+    map = hashmap_create_with(&cfg);
+    slot = hashmap_thread_register(map);
+    struct ckpt_race race = { .map = map, .fd = dump_file() };
+    atomic_store(&race.started, 0);
+    pthread_t racers[4];
+    for (int i = 0; i < 4; i++)
+        pthread_create(&racers[i], NULL, ckpt_racer, &race);
+    for (int i = 0; i < 4; i++)
+        pthread_join(racers[i], NULL);
+    assert(atomic_load(&race.started) == 1);
+    assert(hashmap_checkpoint_wait(map) == 0);
+    assert(atomic_load(&map->ckpt_gen) == 1);
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    close(race.fd);
+
+    printf("  PASSED\n\n");
+}
+
+/* ── Node pool + batched reclamation ── */
+
+#define POOL_THREADS 4
+#define POOL_KEYS    512
+#define POOL_ROUNDS  40
+
+struct pool_args {
+    hashmap_t *map;
+    int        thread_id;
+    int        bad;
+};
+
+/* Churn a private key range so every round retires and reallocates nodes */
+static void *pool_worker(void *arg)
+{
+    struct pool_args *a = arg;
+    int slot = hashmap_thread_register(a->map);
+    uint64_t base = (uint64_t)a->thread_id * POOL_KEYS;
+
+    for (int r = 0; r < POOL_ROUNDS; r++) {
+        for (uint64_t k = 1; k <= POOL_KEYS; k++)
+            hashmap_put(a->map, base + k, (void *)(base + k + (uint64_t)r));
+        for (uint64_t k = 1; k <= POOL_KEYS; k++) {
+            if (hashmap_get(a->map, base + k) != (void *)(base + k + (uint64_t)r))
+                a->bad++;
+        }
+        for (uint64_t k = 1; k <= POOL_KEYS; k += 2)
+            hashmap_remove(a->map, base + k);
+        for (uint64_t k = 1; k <= POOL_KEYS; k++) {
+            void *expect = (k & 1) ? NULL : (void *)(base + k + (uint64_t)r);
+            if (hashmap_get(a->map, base + k) != expect)
+                a->bad++;
+        }
+    }
+
+    hashmap_thread_unregister(a->map, slot);
+    return NULL;
+}
+
+/* pool_worker on POOL_THREADS threads; returns the mismatches seen */
+static int run_pool_churn(hashmap_t *map)
+{
+    pthread_t threads[POOL_THREADS];
+    struct pool_args args[POOL_THREADS];
+    for (int i = 0; i < POOL_THREADS; i++) {
+        args[i] = (struct pool_args){ .map = map, .thread_id = i };
+        pthread_create(&threads[i], NULL, pool_worker, &args[i]);
+    }
+    int bad = 0;
+    for (int i = 0; i < POOL_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        bad += args[i].bad;
+    }
+    return bad;
+}
+
+/* Put keys 1000000 + 1..n on top of the churn, then remove the odd ones */
+static void put_half(hashmap_t *map, uint64_t n)
+{
+    for (uint64_t k = 1; k <= n; k++)
+        hashmap_put(map, 1000000 + k, (void *)k);
+    for (uint64_t k = 1; k <= n; k += 2)
+        hashmap_remove(map, 1000000 + k);
+    for (uint64_t k = 1; k <= n; k++)
+        assert(hashmap_get(map, 1000000 + k) == (k % 2 ? NULL : (void *)k));
+    assert(hashmap_count(map) == POOL_THREADS * POOL_KEYS / 2 + n / 2);
+}
+
+/*
+ * Dump the map (churned, then put_half), destroy it and load it back
+ * under the same config; returns the copy, registered in *slot.
+ */
+static hashmap_t *check_reload(hashmap_t *map, int *slot,
+                               const hashmap_config_t *cfg, size_t expected)
+{
+    int fd = dump_file();
+    assert(hashmap_dump(map, fd) == 0);
+    hashmap_thread_unregister(map, *slot);
+    hashmap_destroy(map);
+    lseek(fd, 0, SEEK_SET);
+    map = hashmap_load_with(fd, cfg, NULL);
+    assert(map != NULL);
+    *slot = hashmap_thread_register(map);
+    assert(hashmap_count(map) == expected);
+    assert(hashmap_get(map, 1000000 + 2) == (void *)2);
+    assert(hashmap_get(map, 1000000 + 1) == NULL);
+    close(fd);
+    return map;
+}
+
+static void test_node_pool(void)
+{
+    printf("=== test_node_pool ===\n");
+
+    hashmap_config_t cfg = { .reclaim_batch = 16, .node_pool = true };
+    hashmap_t *map = hashmap_create_with(&cfg);
+    assert(map != NULL);
+
+    int bad = run_pool_churn(map);
+    printf("  %d threads × %d rounds, %d mismatches, %zu live\n",
+           POOL_THREADS, POOL_ROUNDS, bad, hashmap_count(map));
+    assert(bad == 0);
+    assert(hashmap_count(map) == POOL_THREADS * POOL_KEYS / 2);
+
+    hashmap_destroy(map);
+    printf("  PASSED\n\n");
+}
+
+/* ── NUMA placement ── */
+
+#define NUMA_KEYS 20000     /* Grows the bucket array past the mapped size */
+
+/* Share of the list's nodes on their BUCKET home node (-1 if unknown) */
+static double numa_homed(hashmap_t *map)
+{
+    size_t n = 0, home = 0;
+    void *addrs[256];
+    int nodes[256], want[256];
+    uintptr_t tagged = atomic_load(&map->head.next);
+    while (tagged) {
+        struct hm_node *node = (struct hm_node *)(tagged & ~(uintptr_t)1);
+        tagged = atomic_load(&node->next);
+        addrs[n % 256] = node;
+        want[n % 256] = node->is_dummy ? -1 : hashmap_numa_home(map, node->key);
+        if (++n % 256 == 0 || !tagged) {
+            size_t batch = (n - 1) % 256 + 1;
+            if (numa_page_nodes(addrs, batch, nodes) != 0)
+                return -1;
+            for (size_t i = 0; i < batch; i++)
+                home += want[i] < 0 || nodes[i] == want[i];
+        }
+    }
+    return n ? (double)home / n : 1.0;
+}
+
+static void test_numa(void)
+{
+    printf("=== test_numa ===\n");
+
+    static const struct {
+        const char       *name;
+        hashmap_config_t  cfg;
+    } cases[] = {
+        { "local",           { .numa = HASHMAP_NUMA_LOCAL } },
+        { "interleave",      { .numa = HASHMAP_NUMA_INTERLEAVE } },
+        { "bucket",          { .numa = HASHMAP_NUMA_BUCKET } },
+        { "bucket+snapshot", { .numa = HASHMAP_NUMA_BUCKET, .snapshots = true } },
+        { "local+hazard",    { .numa = HASHMAP_NUMA_LOCAL,
+                               .reclaim = HASHMAP_RECLAIM_HAZARD } },
+        { "local+pool",      { .numa = HASHMAP_NUMA_LOCAL, .node_pool = true } },
+    };
+    int nodes = hashmap_numa_nodes();
+    assert(nodes >= 1);
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        hashmap_t *map = hashmap_create_with(&cases[c].cfg);
+        assert(map != NULL);
+
+        /* Churn frees nodes on other threads than allocated them */
+        assert(run_pool_churn(map) == 0);
+
+        int slot = hashmap_thread_register(map);
+        put_half(map, NUMA_KEYS);
+
+        int home = hashmap_numa_home(map, 42);
+        if (cases[c].cfg.numa == HASHMAP_NUMA_BUCKET)
+            assert(home >= 0 && home < nodes);
+        else
+            assert(home == -1);
+        double homed = cases[c].cfg.numa == HASHMAP_NUMA_BUCKET ? numa_homed(map) : -1;
+        printf("  %-16s %zu live, capacity %zu", cases[c].name, hashmap_count(map),
+               atomic_load(&map->size));
+        if (homed >= 0)
+            printf(", %.1f%% of nodes on their home node", homed * 100);
+        printf("\n");
+
+        /* Dumped and reloaded under the same policy */
+        if (!cases[c].cfg.reclaim)
+            map = check_reload(map, &slot, &cases[c].cfg,
+                               POOL_THREADS * POOL_KEYS / 2 + NUMA_KEYS / 2);
+        hashmap_thread_unregister(map, slot);
+        hashmap_destroy(map);
+    }
+    if (nodes == 1)
+        printf("  1 NUMA node: placement not checked\n");
+
+    printf("  PASSED\n\n");
+}
+
+/* ── Hugepages ── */
+
+#define HUGE_KEYS 60000     /* Grows the bucket array to 1 MB, the mapped size */
+
+/* AnonHugePages of the process in kB (-1 if the kernel does not say) */
+static long huge_kb(void)
+{
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f) return -1;
+    char line[128];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1)
+            break;
+    fclose(f);
+    return kb;
+}
+
+static void test_hugepages(void)
+{
+    printf("=== test_hugepages ===\n");
+
+    static const struct {
+        const char       *name;
+        hashmap_config_t  cfg;
+    } cases[] = {
+        { "transparent",        { .hugepages = HASHMAP_HUGEPAGES_TRANSPARENT } },
+        { "explicit",           { .hugepages = HASHMAP_HUGEPAGES_EXPLICIT } },
+        { "transparent+bucket", { .hugepages = HASHMAP_HUGEPAGES_TRANSPARENT,
+                                  .numa = HASHMAP_NUMA_BUCKET } },
+        { "explicit+hazard",    { .hugepages = HASHMAP_HUGEPAGES_EXPLICIT,
+                                  .reclaim = HASHMAP_RECLAIM_HAZARD } },
+    };
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        hashmap_t *map = hashmap_create_with(&cases[c].cfg);
+        assert(map != NULL);
+
+        assert(run_pool_churn(map) == 0);
+
+        int slot = hashmap_thread_register(map);
+        put_half(map, HUGE_KEYS);
+
+        /* Nodes come from 2 MB chunks, the array from its own mapping */
+        size_t cap = atomic_load(&map->size);
+        struct hm_node **buckets = atomic_load(&map->buckets);
+        assert(cap * sizeof(*buckets) >= (1 << 20));
+        assert(((uintptr_t)buckets & ((2u << 20) - 1)) == 0);
+        assert(map->arena != NULL && map->arena->pages != NUMA_PAGES_SMALL);
+        long kb = huge_kb();
+        printf("  %-19s %zu live, capacity %zu, AnonHugePages %ld kB\n",
+               cases[c].name, hashmap_count(map), cap, kb);
+
+        if (!cases[c].cfg.reclaim)
+            map = check_reload(map, &slot, &cases[c].cfg,
+                               POOL_THREADS * POOL_KEYS / 2 + HUGE_KEYS / 2);
+        hashmap_thread_unregister(map, slot);
+        hashmap_destroy(map);
+    }
+
+    printf("  PASSED\n\n");
+}
+
+/* ── Hazard-pointer backend ── */
+
+#define HZ_WRITERS 4
+#define HZ_KEYS    256
+#define HZ_ROUNDS  100
+
+struct hz_args {
+    hashmap_t   *map;
+    int          thread_id;
+    _Atomic int *parked;     /* scanner is blocked inside its visit */
+    size_t       peak;       /* max unreclaimed seen while parked  */
+};
+
+static _Atomic int hz_release;
+
+/* Parks the scan on its first entry, holding that node's hazards */
+static void hz_park_visit(uint64_t key, void *value, void *arg)
+{
+    (void)key; (void)value;
+    _Atomic int *parked = arg;
+    if (atomic_exchange(parked, 1) == 0) {
+        while (!atomic_load(&hz_release))
+            sched_yield();
+    }
+}
+
+static void *hz_scanner(void *arg)
+{
+    struct hz_args *a = arg;
+    int slot = hashmap_thread_register(a->map);
+    hashmap_parallel_for_each(a->map, 1, hz_park_visit, a->parked);
+    hashmap_thread_unregister(a->map, slot);
+    return NULL;
+}
+
+static void *hz_writer(void *arg)
+{
+    struct hz_args *a = arg;
+    int slot = hashmap_thread_register(a->map);
+    uint64_t base = (uint64_t)(a->thread_id + 1) * 100000;
+
+    while (!atomic_load(a->parked))
+        sched_yield();
+    for (int r = 0; r < HZ_ROUNDS; r++) {
+        for (uint64_t k = 1; k <= HZ_KEYS; k++)
+            hashmap_put(a->map, base + k, (void *)k);
+        for (uint64_t k = 1; k <= HZ_KEYS; k++)
+            hashmap_remove(a->map, base + k);
+        size_t n = hazard_unreclaimed(&a->map->hazard);
+        if (n > a->peak) a->peak = n;
+    }
+
+    hashmap_thread_unregister(a->map, slot);
+    return NULL;
+}
+
+static void test_hazard_reclaim(void)
+{
+    printf("=== test_hazard_reclaim ===\n");
+
+    hashmap_config_t bad = { .reclaim = HASHMAP_RECLAIM_HAZARD, .snapshots = true };
+    assert(hashmap_create_with(&bad) == NULL);
+
+    hashmap_config_t cfg = { .reclaim = HASHMAP_RECLAIM_HAZARD };
+    hashmap_t *map = hashmap_create_with(&cfg);
+    assert(map != NULL);
+    int slot = hashmap_thread_register(map);
+    int values[64];
+    for (int i = 0; i < 64; i++) {
+        values[i] = i;
+        hashmap_put(map, (uint64_t)(i + 1), &values[i]);
+    }
+
+    _Atomic int parked = 0;
+    atomic_store(&hz_release, 0);
+    pthread_t scanner, writers[HZ_WRITERS];
+    struct hz_args sargs = { .map = map, .parked = &parked };
+    struct hz_args wargs[HZ_WRITERS];
+    pthread_create(&scanner, NULL, hz_scanner, &sargs);
+    for (int i = 0; i < HZ_WRITERS; i++) {
+        wargs[i] = (struct hz_args){ .map = map, .thread_id = i, .parked = &parked };
+        pthread_create(&writers[i], NULL, hz_writer, &wargs[i]);
+    }
+
+    size_t peak = 0;
+    for (int i = 0; i < HZ_WRITERS; i++) {
+        pthread_join(writers[i], NULL);
+        if (wargs[i].peak > peak) peak = wargs[i].peak;
+    }
+    atomic_store(&hz_release, 1);
+    pthread_join(scanner, NULL);
+
+    /* A parked reader pins its hazards, not everything retired since */
+    size_t bound = (HZ_WRITERS + 1) *
+                   (HAZARD_SCAN_THRESHOLD + HAZARD_MAX_THREADS * HAZARD_PER_THREAD);
+    printf("  %d writers retired %d nodes, peak unreclaimed %zu (bound %zu)\n",
+           HZ_WRITERS, HZ_WRITERS * HZ_ROUNDS * HZ_KEYS, peak, bound);
+    assert(peak < bound);
+    assert(hashmap_count(map) == 64);
+
+    struct scan_totals t;
+    atomic_store(&t.visits, 0);
+    atomic_store(&t.key_sum, 0);
+    assert(hashmap_parallel_for_each(map, 4, scan_visit, &t) == 0);
+    assert(atomic_load(&t.visits) == 64);
+    assert(atomic_load(&t.key_sum) == 64 * 65 / 2);
+
+    hashmap_thread_unregister(map, slot);
+    hashmap_destroy(map);
+    printf("  PASSED\n\n");
+}
+
 /* ── Multi-threaded test ── */
 
 #define MT_THREADS  8
@@ -197,6 +2067,25 @@ int main(void)
 
     test_basic();
     test_many_keys();
+    test_conditional();
+    test_compute_counters();
+    test_update_nomem();
+    test_parallel_for_each();
+    test_snapshot_basic();
+    test_snapshot_concurrent();
+    test_value_ownership();
+    test_stats();
+    test_profile();
+    test_latency();
+    test_memory();
+    test_dump_load();
+    test_frozen();
+    test_wal();
+    test_checkpoint();
+    test_node_pool();
+    test_numa();
+    test_hugepages();
+    test_hazard_reclaim();
     test_multithreaded();
 
     printf("All tests passed.\n");
@@ -0,0 +1,373 @@
+/*
+ * wal.c — Write-ahead log: per-thread record rings and group commit
+ *
+ * Author: G.H. Murray
+ * Date:   2026-02-17
+ */
+
+#define _GNU_SOURCE
+#include "wal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define WAL_MAGIC    "LFHMWLOG"
+#define WAL_VERSION  1
+#define WAL_BATCH_MAX (256u << 20)  /* Larger lengths are corruption */
+
+/* ── Reading ── */
+
+static int wal_header(int fd)
+{
+    uint8_t h[WAL_HEADER] = { 0 };
+    memcpy(h, WAL_MAGIC, 8);
+    put_le32(h + 8, WAL_VERSION);
+    return write_full(fd, h, sizeof(h));
+}
+
+int wal_read(int fd, pbuf_t *out)
+{
+    struct stat sb;
+    if (fstat(fd, &sb) != 0)
+        return -1;
+    size_t size = (size_t)sb.st_size;
+    if (size == 0)
+        return lseek(fd, 0, SEEK_SET) == 0 ? 0 : -1;
+
+    uint8_t h[WAL_HEADER];
+    if (size < WAL_HEADER || pread(fd, h, sizeof(h), 0) != (ssize_t)sizeof(h) ||
+        memcmp(h, WAL_MAGIC, 8) != 0 || get_le32(h + 8) != WAL_VERSION)
+        return -1;
+
+    uint8_t *body = malloc(size - WAL_HEADER + 1);
+    if (!body || lseek(fd, WAL_HEADER, SEEK_SET) != WAL_HEADER ||
+        read_full(fd, body, size - WAL_HEADER) != 0) {
+        free(body);
+        return -1;
+    }
+
+    /* Keep batches up to the first torn or corrupt one */
+    size_t pos = 0, len = size - WAL_HEADER;
+    while (len - pos >= 8) {
+        uint32_t n = get_le32(body + pos);
+        if (n > WAL_BATCH_MAX || n > len - pos - 8 ||
+            crc32c(crc32c(0, body + pos, 4), body + pos + 8, n) !=
+                get_le32(body + pos + 4))
+            break;
+        if (pbuf_reserve(out, n) != 0) {
+            free(body);
+            return -1;
+        }
+        memcpy(out->data + out->len, body + pos + 8, n);
+        out->len += n;
+        pos += 8 + (size_t)n;
+    }
+    free(body);
+
+    off_t end = (off_t)(WAL_HEADER + pos);
+    if ((size_t)end != size && ftruncate(fd, end) != 0)
+        return -1;
+    return lseek(fd, end, SEEK_SET) == end ? 0 : -1;
+}
+
+/* ── Commits ── */
+
+static size_t ring_copy_out(const struct wal_ring *r, size_t cap,
+                            uint64_t from, uint64_t to, uint8_t *dst)
+{
+    size_t n = (size_t)(to - from), at = (size_t)(from & (cap - 1));
+    size_t first = n < cap - at ? n : cap - at;
+    memcpy(dst, r->data + at, first);
+    memcpy(dst + first, r->data, n - first);
+    return n;
+}
+
+/*
+ * Gather every ring into one batch and write it (w->io held). Rings are
+ * released only after the write — and the sync, if the policy has one —
+ * so a waiter woken by `committed` finds its records on disk.
+ */
+static void wal_commit(wal_t *w)
+{
+    pbuf_t *b = &w->batch;
+    b->len = 0;
+    bool ok = pbuf_reserve(b, 8) == 0;
+    b->len = 8;
+
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+        struct wal_ring *r = atomic_load_explicit(&w->rings[i], memory_order_acquire);
+        if (!r) continue;
+        uint64_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+        uint64_t done = atomic_load_explicit(&r->done, memory_order_relaxed);
+        r->taken = tail;
+        if (tail == done) continue;
+        if (!ok || pbuf_reserve(b, (size_t)(tail - done)) != 0) {
+            ok = false;
+            continue;
+        }
+        b->len += ring_copy_out(r, w->ring_bytes, done, tail, b->data + b->len);
+    }
+    if (!ok)
+        atomic_store(&w->failed, true);
+
+    if (ok && b->len > 8) {
+        uint32_t n = (uint32_t)(b->len - 8);
+        put_le32(b->data, n);
+        put_le32(b->data + 4, crc32c(crc32c(0, b->data, 4), b->data + 8, n));
+        if (write_full(w->fd, b->data, b->len) != 0)
+            atomic_store(&w->failed, true);
+        atomic_fetch_add_explicit(&w->batches, 1, memory_order_relaxed);
+        if (w->sync != WAL_SYNC_NONE) {
+            if (fdatasync(w->fd) != 0)
+                atomic_store(&w->failed, true);
+            atomic_fetch_add_explicit(&w->syncs, 1, memory_order_relaxed);
+        }
+    }
+
+    /* Release the space (records are dropped, not retried, on failure) */
+    bool advanced = false;
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+        struct wal_ring *r = atomic_load_explicit(&w->rings[i], memory_order_acquire);
+        if (!r || r->taken == atomic_load_explicit(&r->done, memory_order_relaxed))
+            continue;
+        atomic_store_explicit(&r->done, r->taken, memory_order_release);
+        advanced = true;
+    }
+    if (advanced) {
+        pthread_mutex_lock(&w->lock);
+        pthread_cond_broadcast(&w->committed);
+        pthread_mutex_unlock(&w->lock);
+    }
+}
+
+static void *committer_main(void *arg)
+{
+    wal_t *w = arg;
+
+    pthread_mutex_lock(&w->lock);
+    while (!w->stop) {
+        if (!w->kicked) {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_nsec += (long)(w->interval_ms % 1000) * 1000000L;
+            ts.tv_sec += w->interval_ms / 1000 + ts.tv_nsec / 1000000000L;
+            ts.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&w->kick, &w->lock, &ts);
+        }
+        w->kicked = false;
+        pthread_mutex_unlock(&w->lock);
+
+        pthread_mutex_lock(&w->io);
+        wal_commit(w);
+        pthread_mutex_unlock(&w->io);
+
+        pthread_mutex_lock(&w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+/* Kick the committer and wait until the ring's done reaches `pos` */
+static void wait_done(wal_t *w, struct wal_ring *r, uint64_t pos)
+{
+    pthread_mutex_lock(&w->lock);
+    if (!w->kicked) {
+        w->kicked = true;
+        pthread_cond_signal(&w->kick);
+    }
+    while (atomic_load_explicit(&r->done, memory_order_acquire) < pos)
+        pthread_cond_wait(&w->committed, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+}
+
+/* ── Lifecycle ── */
+
+wal_t *wal_open(int fd, enum wal_sync sync, uint32_t interval_ms,
+                size_t ring_bytes)
+{
+    if (lseek(fd, 0, SEEK_CUR) == 0 && wal_header(fd) != 0)
+        return NULL;
+
+    wal_t *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+
+    size_t cap = WAL_RING_MIN;
+    while (cap < ring_bytes)
+        cap *= 2;
+    w->ring_bytes = cap;
+    w->sync = sync;
+    w->interval_ms = interval_ms ? interval_ms : 10;
+    w->fd = fd;
+
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_mutex_init(&w->io, NULL);
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->kick, &ca);
+    pthread_cond_init(&w->committed, NULL);
+    pthread_condattr_destroy(&ca);
+
+    if (pthread_create(&w->thread, NULL, committer_main, w) != 0) {
+        pthread_cond_destroy(&w->committed);
+        pthread_cond_destroy(&w->kick);
+        pthread_mutex_destroy(&w->lock);
+        pthread_mutex_destroy(&w->io);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+int wal_close(wal_t *w)
+{
+    if (!w) return 0;
+
+    pthread_mutex_lock(&w->lock);
+    w->stop = true;
+    pthread_cond_signal(&w->kick);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    wal_commit(w);
+    if (w->sync != WAL_SYNC_NONE && fdatasync(w->fd) != 0)
+        atomic_store(&w->failed, true);
+    int rc = atomic_load(&w->failed) ? -1 : 0;
+
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+        struct wal_ring *r = atomic_load(&w->rings[i]);
+        if (!r) continue;
+        free(r->data);
+        free(r->scratch.data);
+        free(r);
+    }
+    free(w->batch.data);
+    pthread_cond_destroy(&w->committed);
+    pthread_cond_destroy(&w->kick);
+    pthread_mutex_destroy(&w->lock);
+    pthread_mutex_destroy(&w->io);
+    free(w);
+    return rc;
+}
+
+/* ── Appending ── */
+
+static struct wal_ring *ring_for(wal_t *w, int slot)
+{
+    struct wal_ring *r = atomic_load_explicit(&w->rings[slot], memory_order_relaxed);
+    if (r) return r;
+
+    r = aligned_alloc(64, sizeof(*r));
+    if (!r) return NULL;
+    memset(r, 0, sizeof(*r));
+    r->data = malloc(w->ring_bytes);
+    if (!r->data) {
+        free(r);
+        return NULL;
+    }
+    atomic_store_explicit(&w->rings[slot], r, memory_order_release);
+    return r;
+}
+
+pbuf_t *wal_record(wal_t *w, int slot)
+{
+    struct wal_ring *r = ring_for(w, slot);
+    if (!r) return NULL;
+    r->scratch.len = 0;
+    return &r->scratch;
+}
+
+void wal_fail(wal_t *w)
+{
+    atomic_store(&w->failed, true);
+}
+
+/* A record set larger than the ring: its own batch, after the rings */
+static void wal_write_direct(wal_t *w, const pbuf_t *rec)
+{
+    uint8_t h[8];
+    put_le32(h, (uint32_t)rec->len);
+    put_le32(h + 4, crc32c(crc32c(0, h, 4), rec->data, rec->len));
+
+    pthread_mutex_lock(&w->io);
+    wal_commit(w);
+    if (write_full(w->fd, h, sizeof(h)) != 0 ||
+        write_full(w->fd, rec->data, rec->len) != 0)
+        atomic_store(&w->failed, true);
+    atomic_fetch_add_explicit(&w->batches, 1, memory_order_relaxed);
+    if (w->sync != WAL_SYNC_NONE) {
+        if (fdatasync(w->fd) != 0)
+            atomic_store(&w->failed, true);
+        atomic_fetch_add_explicit(&w->syncs, 1, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&w->io);
+}
+
+int wal_append(wal_t *w, int slot)
+{
+    struct wal_ring *r = atomic_load_explicit(&w->rings[slot], memory_order_relaxed);
+    size_t n = r->scratch.len, cap = w->ring_bytes;
+
+    if (n > cap || n > WAL_BATCH_MAX) {
+        if (n > WAL_BATCH_MAX)
+            wal_fail(w);
+        else
+            wal_write_direct(w, &r->scratch);
+        r->scratch.len = 0;
+        return atomic_load(&w->failed) ? -1 : 0;
+    }
+
+    /* Publish the records whole: a batch never splits one */
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    if (tail + n - atomic_load_explicit(&r->done, memory_order_acquire) > cap)
+        wait_done(w, r, tail + n - cap);
+    size_t at = (size_t)(tail & (cap - 1));
+    size_t first = n < cap - at ? n : cap - at;
+    memcpy(r->data + at, r->scratch.data, first);
+    memcpy(r->data, r->scratch.data + first, n - first);
+    tail += n;
+    atomic_store_explicit(&r->tail, tail, memory_order_release);
+    r->scratch.len = 0;
+
+    if (w->sync == WAL_SYNC_ALWAYS)
+        wait_done(w, r, tail);
+    return atomic_load_explicit(&w->failed, memory_order_relaxed) ? -1 : 0;
+}
+
+int wal_sync(wal_t *w)
+{
+    pthread_mutex_lock(&w->io);
+    wal_commit(w);
+    if (fdatasync(w->fd) != 0)
+        atomic_store(&w->failed, true);
+    atomic_fetch_add_explicit(&w->syncs, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&w->io);
+    return atomic_load(&w->failed) ? -1 : 0;
+}
+
+int wal_rotate(wal_t *w, int fd)
+{
+    pthread_mutex_lock(&w->io);
+    wal_commit(w);
+    if (fdatasync(w->fd) != 0)
+        atomic_store(&w->failed, true);
+    atomic_fetch_add_explicit(&w->syncs, 1, memory_order_relaxed);
+    int rc = atomic_load(&w->failed) ? -1 : 0;
+    if (rc == 0) {
+        if (lseek(fd, 0, SEEK_CUR) == 0 && wal_header(fd) != 0)
+            rc = -1;
+        else
+            w->fd = fd;
+    }
+    pthread_mutex_unlock(&w->io);
+    return rc;
+}
+
+void wal_counters(wal_t *w, uint64_t *batches, uint64_t *syncs)
+{
+    *batches = atomic_load_explicit(&w->batches, memory_order_relaxed);
+    *syncs = atomic_load_explicit(&w->syncs, memory_order_relaxed);
+}
@@ -0,0 +1,135 @@
+/*
+ * wal.h — Write-ahead log: per-thread record rings and group commit
+ *
+ * Each slot appends encoded records to its own ring (one producer, the
+ * slot's thread; one consumer, the committer), so appends take no lock
+ * and touch no shared cache line. The committer drains every ring into
+ * one framed batch and issues one write() and, per the sync policy, one
+ * fdatasync(): every record that arrived while the previous commit was
+ * on disk rides the next one.
+ *
+ * The log keeps no order between slots: records that must replay in
+ * order carry sequence numbers of the caller's, and replay sorts by them.
+ *
+ * File: a 16-byte header ("LFHMWLOG", u32 version, u32 reserved), then
+ * batches of u32 payload length, u32 CRC32C (over the length field and
+ * the payload), payload; all little-endian. Records inside a payload
+ * are the caller's. A torn or corrupt batch ends the log.
+ *
+ * Author: G.H. Murray
+ * Date:   2026-02-17
+ */
+
+#ifndef WAL_H
+#define WAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "epoch.h"
+#include "persist.h"
+
+#define WAL_RING_MIN  4096                 /* Smallest per-slot ring        */
+#define WAL_HEADER    16
+
+enum wal_sync {
+    WAL_SYNC_NONE,       /* write() each commit, never fdatasync      */
+    WAL_SYNC_INTERVAL,   /* write() + fdatasync() each commit         */
+    WAL_SYNC_ALWAYS,     /* as INTERVAL, and appends wait for theirs  */
+};
+
+/* One slot's ring: bytes [done, tail) await the committer */
+struct wal_ring {
+    _Alignas(64) _Atomic uint64_t tail;    /* Appended (producer)      */
+    _Alignas(64) _Atomic uint64_t done;    /* Committed (committer)    */
+    uint64_t          taken;               /* In the batch being built */
+    uint8_t          *data;
+    pbuf_t            scratch;             /* Records being encoded    */
+};
+
+typedef struct wal {
+    _Atomic(struct wal_ring *) rings[EPOCH_MAX_THREADS];  /* Lazy */
+    size_t             ring_bytes;
+    enum wal_sync      sync;
+    uint32_t           interval_ms;
+    _Atomic bool       failed;             /* Sticky write/encode error */
+
+    /* Commits: one at a time, by the committer, wal_sync or rotate */
+    pthread_mutex_t    io;
+    int                fd;
+    pbuf_t             batch;
+    _Atomic uint64_t   batches;
+    _Atomic uint64_t   syncs;
+
+    /* Committer wake-ups and waits for a commit */
+    pthread_mutex_t    lock;
+    pthread_cond_t     kick;               /* Commit now, not at the tick */
+    pthread_cond_t     committed;          /* Some ring's done advanced   */
+    bool               kicked;
+    bool               stop;
+    pthread_t          thread;
+} wal_t;
+
+/*
+ * wal_read — Validate the log at `fd` and collect the payloads of its
+ * intact batches into `out`. A torn tail is truncated away and the
+ * offset left at the end, ready for appending. An empty file yields no
+ * records. Returns 0, or -1 if the header is not a log's or on error.
+ */
+int wal_read(int fd, pbuf_t *out);
+
+/*
+ * wal_open — Start logging to `fd` (positioned at its end; a header is
+ * written first if the offset is 0) and the committer thread.
+ * interval_ms is the commit period; ring_bytes is rounded up to a power
+ * of two >= WAL_RING_MIN. Returns NULL on error.
+ */
+wal_t *wal_open(int fd, enum wal_sync sync, uint32_t interval_ms,
+                size_t ring_bytes);
+
+/*
+ * wal_close — Commit what is buffered, sync (unless WAL_SYNC_NONE),
+ * stop the committer and free the log. No thread may be appending.
+ * The fd stays open. Returns -1 if any write or sync failed.
+ */
+int wal_close(wal_t *w);
+
+/*
+ * wal_record — The slot's record buffer (owner only). Encode one or
+ * more records into it, then wal_append them. NULL if out of memory.
+ */
+pbuf_t *wal_record(wal_t *w, int slot);
+
+/*
+ * wal_append — Move the slot's buffered records into its ring, waiting
+ * for room if the committer is behind; under WAL_SYNC_ALWAYS, also wait
+ * until they are on disk. Returns 0, or -1 once the log has failed.
+ */
+int wal_append(wal_t *w, int slot);
+
+/*
+ * wal_fail — Mark the log failed (a record could not be encoded)
+ */
+void wal_fail(wal_t *w);
+
+/*
+ * wal_sync — Commit everything appended so far and fdatasync, whatever
+ * the policy. Returns 0, or -1 if the log has failed.
+ */
+int wal_sync(wal_t *w);
+
+/*
+ * wal_rotate — wal_sync, then continue in `fd` (header written if its
+ * offset is 0). Records appended after the call returns go to `fd`.
+ */
+int wal_rotate(wal_t *w, int fd);
+
+/*
+ * wal_counters — Batches written and fdatasync calls made so far
+ */
+void wal_counters(wal_t *w, uint64_t *batches, uint64_t *syncs);
+
+#endif /* WAL_H */